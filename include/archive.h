@@ -0,0 +1,105 @@
+/*
+  archive.h
+
+  Archives: libraries of object files with an index of the symbols
+  they export, so that the linker can find the members it needs
+  without looking into the others.
+
+  An archive is a header followed by these sections, each starting at
+  a multiple of OBJ_ALIGN bytes, like those of an object file:
+
+    members  ArcMember records, in the order the objects were given
+    index    ArcSymbol records, sorted by name
+    strings  member and symbol names, NUL-terminated
+    images   the object files themselves, each aligned
+
+  so that the members can be used in place with obj_view once the
+  archive is mapped. Fields are 32-bit little-endian integers.
+*/
+
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include "object.h"
+
+#define ARC_MAGIC 0x4143414d  // "MACA"
+#define ARC_VERSION 1
+
+// The header, at offset 0.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;  // Bytes in the file.
+  uint32_t members, nmembers;
+  uint32_t index, nindex;
+  uint32_t strings, nstrings;  // nstrings is in bytes.
+  uint32_t reserved[7];
+} ArcHeader;
+
+// A member: the object file of size bytes at offset.
+typedef struct {
+  uint32_t name;  // Offset in the strings.
+  uint32_t offset;
+  uint32_t size;
+  uint32_t reserved;
+} ArcMember;
+
+// An exported symbol and the member that defines it. If several do,
+// only the first is indexed.
+typedef struct {
+  uint32_t name;  // Offset in the strings.
+  uint32_t hash;  // obj_hash of the name.
+  uint32_t member;
+  uint32_t reserved;
+} ArcSymbol;
+
+// An archive in memory. The pointers are into its mapping.
+typedef struct {
+  const ArcHeader *header;
+  const ArcMember *members;
+  const ArcSymbol *index;
+  const char *strings;
+
+  void *map;
+  size_t maplen;
+} Archive;
+
+/*
+  Write an archive with the object files of the given names as its
+  members. Like an object file (see obj_save), the archive replaces
+  the old file whole, so that linkers never see it half written.
+  Returns zero on error, with the error message set (see error.h).
+*/
+int arc_write(const char *name, char *const *members, int n);
+
+/*
+  Map the archive with the given name. Returns NULL on error, with the
+  error message set.
+*/
+Archive *arc_open(const char *name);
+
+/*
+  Close an archive. The objects of its members must not be used
+  afterwards.
+*/
+void arc_close(Archive *A);
+
+/*
+  Return the string at the given offset.
+*/
+const char *arc_string(const Archive *A, uint32_t offset);
+
+/*
+  Return the number of the member that defines the given exported
+  symbol, or -1 if there is none.
+*/
+int arc_lookup(const Archive *A, const char *symbol);
+
+/*
+  Return the object of member k, used in place, or NULL, with the
+  error message set, if it is damaged. Close it with obj_close, before
+  the archive.
+*/
+Object *arc_member(const Archive *A, int k);
+
+#endif
@@ -0,0 +1,55 @@
+/*
+  arena.h
+
+  A chunked memory arena. Objects are carved sequentially out of large
+  blocks and are all freed together when the arena is destroyed.
+*/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <stdlib.h>
+
+// The arena.
+typedef struct arena_s *Arena;
+
+/*
+  Return a new and empty arena whose blocks hold block_size bytes
+  each. If block_size is zero, a default size is used.
+*/
+Arena arena_create(size_t block_size);
+
+/*
+  Destroy an arena, freeing every object allocated from it.
+*/
+void arena_destroy(Arena A);
+
+/*
+  Return a pointer to size bytes of memory taken from the arena,
+  suitably aligned for any type. The memory is not initialized.
+
+  Requests larger than the block size get a block of their own.
+
+  If there is a memory allocation error, then crashes with an error
+  message.
+*/
+void *arena_alloc(Arena A, size_t size);
+
+/*
+  Like arena_alloc, but the memory is set to zero.
+*/
+void *arena_calloc(Arena A, size_t size);
+
+/*
+  Copy string s into the arena and return the copy.
+*/
+char *arena_strdup(Arena A, const char *s);
+
+/*
+  Return the number of blocks and the total number of bytes held by
+  the arena (including unused tails of blocks).
+*/
+size_t arena_blocks(Arena A);
+size_t arena_bytes(Arena A);
+
+#endif
@@ -37,6 +37,13 @@ typedef unsigned int OperandType;
 #define RET          -6
 #define PUSH         -7
 
+// A piece of a string, such as a word of a source line: pointer and
+// length. It is not NUL-terminated.
+typedef struct {
+  const char *s;
+  int len;
+} Span;
+
 // Operator.
 typedef struct {
   // Name of operator.
@@ -95,6 +102,13 @@ Operand *operand_create_number(octa num);
 Operand *operand_create_label(const char *label);
 Operand *operand_create_string(const char *str);
 
+/*
+  Like operand_create_label and operand_create_string, taking the
+  first len characters of the given string.
+*/
+Operand *operand_create_label_n(const char *label, int len);
+Operand *operand_create_string_n(const char *str, int len);
+
 /*
   Return copy of given operand.
 */
@@ -0,0 +1,111 @@
+/*
+  assembler.h
+
+  One-pass assembly. Instructions are encoded as they arrive, so code
+  can be produced while the source is still being parsed. A jump to a
+  label that is not defined yet is encoded with a zero displacement
+  and put on the label's chain of fixups, which is patched as soon as
+  the label is defined. Jumps to labels that are never defined become
+  relocations, to be resolved by the linker.
+*/
+
+#ifndef __ASSEMBLER_H__
+#define __ASSEMBLER_H__
+
+#include "asmtypes.h"
+#include "stable.h"
+#include "arena.h"
+
+// A word waiting for the address of a label.
+typedef struct fixup_s {
+  int site;    // Address of the word.
+  int lineno;  // Line of its instruction, for error messages.
+  struct fixup_s *next;
+} Fixup;
+
+// A label. The symbol table of the assembler holds a pointer to the
+// Symbol of each label in EntryData.p.
+typedef struct symbol_s {
+  int addr;        // Address, or -1 if not defined yet.
+  int exported;    // Declared by EXTERN?
+  Fixup *fixups;   // Words to patch when the label is defined.
+
+  // Labels used before being defined are also kept in a list, with
+  // their names, so that asm_finish need not walk the whole table.
+  const char *name;
+  struct symbol_s *next;
+} Symbol;
+
+// A reference to a label not defined in the program: the jump at
+// address site, encoded with a zero displacement, goes to name.
+typedef struct {
+  int site;
+  const char *name;
+} Reloc;
+
+// Start of the code of a source line: the words from addr up to the
+// next mark come from line lineno.
+typedef struct {
+  int addr;
+  int lineno;
+} LineMark;
+
+// The assembler.
+typedef struct {
+  // Code: n words, with room for max.
+  utetra *code;
+  int n, max;
+
+  SymbolTable symbols;
+  Arena arena;  // Symbols and fixups.
+  Symbol *waited;  // Labels used before being defined.
+
+  // Relocations, in order of address; made by asm_finish.
+  Reloc *relocs;
+  int nrelocs;
+
+  // Line table, in order of address: one mark per line that produces
+  // code.
+  LineMark *lines;
+  int nlines, maxlines;
+} Assembler;
+
+/*
+  Create and return a new assembler, with an empty program.
+*/
+Assembler *asm_create();
+
+/*
+  Destroy an assembler.
+*/
+void asm_destroy(Assembler *A);
+
+/*
+  Assemble an instruction at the end of the program, defining its
+  label and patching the jumps waiting for it.
+
+  Returns zero on error, with the error message set (see error.h).
+*/
+int asm_instr(Assembler *A, const Instruction *instr);
+
+/*
+  Assemble the instructions of the list starting at head. Returns zero
+  on error, with *errinstr, if errinstr is non-NULL, pointing to the
+  instruction where the error was found.
+*/
+int asm_list(Assembler *A, const Instruction *head,
+             const Instruction **errinstr);
+
+/*
+  End the program: make a relocation of every jump still waiting for
+  a label. Returns the number of relocations.
+*/
+int asm_finish(Assembler *A);
+
+/*
+  Return the symbol of a label, or NULL if the program neither uses
+  nor defines it.
+*/
+Symbol *asm_symbol(Assembler *A, const char *label);
+
+#endif
@@ -8,6 +8,7 @@
 #define __BUFFER_H__
 
 #include <stdio.h>
+#include "lsource.h"
 
 // Buffer struct.
 typedef struct buffer_s {
@@ -15,6 +16,13 @@ typedef struct buffer_s {
 
   // Buffer max. size and first free position.
   int n, i;
+
+  // Line source over file input, used by read_line.
+  FILE *input;
+  LineSource source;
+
+  // Blocks read ahead in the background by read_line (0: none).
+  int readahead;
 } Buffer;
 
 /*
@@ -28,7 +36,9 @@ Buffer *buffer_create();
 void buffer_destroy(Buffer *B);
 
 /*
-  Reset buffer, eliminating contents.
+  Reset buffer, eliminating contents. Takes constant time: the memory
+  is kept and not cleared, so only the first i characters of data are
+  meaningful after later additions.
 */
 void buffer_reset(Buffer *B);
 
@@ -37,6 +47,18 @@ void buffer_reset(Buffer *B);
 */
 void buffer_push_back(Buffer *B, char c);
 
+/*
+  Add the len characters starting at ptr to the end of the buffer.
+*/
+void buffer_append(Buffer *B, const char *ptr, int len);
+
+/*
+  Make read_line read nblocks blocks of streaming input ahead in a
+  background thread (see lsource_readahead); zero turns this off for
+  files read from then on. Mapped files are not affected.
+*/
+void buffer_readahead(Buffer *B, int nblocks);
+
 /*
   Read a line (i.e., reads up to a newline '\n' character or the
   end-of-file) from the input file and places it into the given
@@ -44,7 +66,13 @@ void buffer_push_back(Buffer *B, char c);
   is resetted before the line is read.
 
   Returns the number of characters read; in particular, returns ZERO
-  if end-of-file is reached before any characters are read.
+  if end-of-file is reached before any characters are read. A NUL
+  character is stored after the line, but not counted.
+
+  The input is read through a line source (see lsource.h) kept in the
+  buffer, so a buffer should be used with a single input file, which
+  should be read only through read_line; passing another file drops
+  what was read ahead from the previous one.
 */
 int read_line(FILE *input, Buffer *B);
 
@@ -0,0 +1,62 @@
+/*
+  cstable.h
+
+  Concurrent symbol table: a hash table split in independently locked
+  stripes, so that threads working on different keys rarely wait for
+  each other. This is the backend behind symbol tables created with
+  kind STABLE_CONCURRENT; see stable.h.
+*/
+
+#ifndef __CSTABLE_H__
+#define __CSTABLE_H__
+
+#include "stable.h"
+
+// The concurrent table.
+typedef struct cstable_s *ConcurrentTable;
+
+// An entry of a snapshot.
+typedef struct {
+  const char *key;
+  EntryData *data;
+} CstableEntry;
+
+/*
+  Return a new and empty concurrent table.
+*/
+ConcurrentTable cstable_create();
+
+/*
+  Destroy a concurrent table. No other thread may be using it.
+*/
+void cstable_destroy(ConcurrentTable C);
+
+/*
+  Insert key, as in stable_insert. Safe to call from many threads at
+  once: for each key exactly one caller gets new != 0. Data pointers
+  stay valid until the table is destroyed; access to the data itself
+  must be synchronized by the callers.
+*/
+InsertionResult cstable_insert(ConcurrentTable C, const char *key);
+
+/*
+  Find key, as in stable_find. Safe to call from many threads at once,
+  also while other threads insert.
+*/
+EntryData *cstable_find(ConcurrentTable C, const char *key);
+
+/*
+  Store in *entries a newly allocated array with the entries of the
+  table, sorted by key, and return their number. Each stripe is
+  copied atomically, but entries inserted by other threads while the
+  snapshot is taken may or may not be included. The caller frees the
+  array.
+*/
+size_t cstable_snapshot(ConcurrentTable C, CstableEntry **entries);
+
+/*
+  Fill *stats, as in stable_stats.
+*/
+void cstable_stats(ConcurrentTable C, StableStats *stats);
+
+#endif
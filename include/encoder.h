@@ -0,0 +1,122 @@
+/*
+  encoder.h
+
+  Translation of instructions into MAC211 machine code. A word of code
+  holds the opcode in its high byte, followed by the X, Y and Z bytes.
+  Addresses are counted in words from the start of the program, and
+  relative addresses in words from the instruction that uses them.
+
+  The immediate version (...I) of an operator is used when its last
+  operand is a number, and the backward version (...B) of a jump when
+  its target precedes it. The pseudo-operators CALL, RET and PUSH are
+  expanded into several words, using the registers in opcodes.h; TETRA
+  and STR give data words, and IS and EXTERN no code at all.
+
+  Jumps to labels, GETA and CALL have versions of different reach (see
+  relax.h for how they are chosen). The short version is the plain
+  instruction, or the usual expansion of CALL. The near version of a
+  conditional jump is the opposite jump over a JMP. A far version
+  builds the address of the target in a register, 32 bits away at
+  most, and gets there with GO. Far versions build the offset in
+  REG_Y, or in REG_X for a GETA into REG_Y; far jumps and CALL also
+  change REG_X.
+*/
+
+#ifndef __ENCODER_H__
+#define __ENCODER_H__
+
+#include "asmtypes.h"
+#include "stable.h"
+
+// Resolution of label operands. find returns 1, storing the address
+// of label in *addr, if it is known; 0 if the label is undefined,
+// which is an error; or -1 to have the jump at address site encoded
+// with a zero displacement, to be set later with encode_patch.
+typedef struct {
+  int (*find)(void *ctx, const char *label, int site, int *addr);
+  void *ctx;
+} LabelResolver;
+
+// Reaches, from the shortest.
+#define REACH_SHORT  0
+#define REACH_NEAR   1
+#define REACH_FAR    2
+
+/*
+  Return the size, in words, of the code of an instruction.
+*/
+int encode_size(const Instruction *instr);
+
+/*
+  Like encode_size, for the version of the given reach.
+*/
+int encode_size_reach(const Instruction *instr, int reach);
+
+/*
+  Return the shortest reach that takes instr, placed at address pc, to
+  the address target of its label operand, or -1 if none does.
+  Instructions that are not jumps, GETA or CALL only have REACH_SHORT.
+*/
+int encode_reach(const Instruction *instr, int pc, int target);
+
+/*
+  Return by how many words the distance from instr, placed at address
+  pc, to target may grow before the version of the given reach no
+  longer gets there (-1 if it already does not).
+*/
+int encode_slack(const Instruction *instr, int pc, int target, int reach);
+
+/*
+  Encode instr, placed at address pc, into out, which must have room
+  for encode_size(instr) words. Label operands are looked up in labels,
+  where the data of a label is its address (EntryData.i).
+
+  Returns the number of words written, or -1 on error, with the error
+  message set (see error.h).
+*/
+int encode(const Instruction *instr, int pc, SymbolTable labels, utetra *out);
+
+/*
+  Like encode, looking label operands up through a resolver.
+*/
+int encode_resolve(const Instruction *instr, int pc, const LabelResolver *r,
+                   utetra *out);
+
+/*
+  Like encode_resolve, in the version of the given reach. Versions
+  other than the short one need the address of the label right away.
+*/
+int encode_relaxed(const Instruction *instr, int pc, int reach,
+                   const LabelResolver *r, utetra *out);
+
+/*
+  Set the displacement of the jump in *w, encoded with a zero
+  displacement, to disp, switching to the backward version if disp is
+  negative. Returns zero, with the error message set, if disp is out
+  of the range of the jump.
+*/
+int encode_patch(utetra *w, int disp);
+
+/*
+  Give addresses to the instructions of the list starting at head,
+  counting from zero, and define their labels in labels (labels of IS
+  lines, which are aliases, are not defined).
+
+  Returns the size of the program in words, or -1 if a label is
+  defined twice, with the error message set and *errinstr, if
+  errinstr is non-NULL, pointing to the offending instruction.
+*/
+int encode_layout(const Instruction *head, SymbolTable labels,
+                  const Instruction **errinstr);
+
+/*
+  Encode the list starting at head, laid out by encode_layout with the
+  same labels, into out, which must have room for the whole program.
+
+  Returns the number of words written, or -1 on error, as for
+  encode_layout.
+*/
+int encode_program(const Instruction *head, SymbolTable labels, utetra *out,
+                   const Instruction **errinstr);
+
+#endif
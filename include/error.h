@@ -2,6 +2,13 @@
   error.h
 
   Error-handling routines. Very, very boring stuff indeed.
+
+  Error messages are kept per thread: a message set in one thread is
+  not seen by get_error_msg, print_error_msg(NULL) or die(NULL) in
+  another, so work done on other threads must hand its messages back
+  to the thread that reports them. The program name is shared by all
+  threads. Messages printed by different threads are never
+  interleaved.
 */
 
 #ifndef __ERROR_H__
@@ -39,6 +46,9 @@ void print_error_msg(const char *msg, ...);
 
 /*
   Print error message like print_error_msg and crashes the program.
+
+  If several threads call die at once, only the first prints its
+  message and exits; the others wait for the program to end.
 */
 void die(const char *msg, ...);
 
@@ -54,4 +64,11 @@ void *emalloc(size_t size);
 */
 char *estrdup(const char *s);
 
+/*
+  Return a NUL-terminated copy of the first n characters of s (or of
+  all of s, if it is shorter). Crashes the program with an error
+  message on failure.
+*/
+char *estrndup(const char *s, size_t n);
+
 #endif
@@ -0,0 +1,48 @@
+/*
+  ftable.h
+
+  Frozen symbol table: a read-only snapshot of a symbol table laid out
+  in a single contiguous block. This is what stable_freeze turns a
+  table into; see stable.h.
+*/
+
+#ifndef __FTABLE_H__
+#define __FTABLE_H__
+
+#include "stable.h"
+
+// The frozen table.
+typedef struct ftable_s *FrozenTable;
+
+/*
+  Return a frozen table holding the n given keys, which must be
+  distinct and sorted in increasing strcmp order, with the given
+  data.
+*/
+FrozenTable ftable_create(size_t n, const char **keys, const EntryData *data);
+
+/*
+  Destroy a frozen table.
+*/
+void ftable_destroy(FrozenTable F);
+
+/*
+  Find key, as in stable_find.
+*/
+EntryData *ftable_find(FrozenTable F, const char *key);
+
+/*
+  Return the number of entries, and the key and data of entry i in
+  increasing key order.
+*/
+size_t ftable_size(FrozenTable F);
+const char *ftable_key(FrozenTable F, size_t i);
+EntryData *ftable_data(FrozenTable F, size_t i);
+
+/*
+  Fill *stats, as in stable_stats. The node count is the number of
+  slots of the hash index.
+*/
+void ftable_stats(FrozenTable F, StableStats *stats);
+
+#endif
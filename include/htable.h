@@ -0,0 +1,83 @@
+/*
+  htable.h
+
+  Open-addressing hash table associating EntryData to strings. This is
+  the backend behind symbol tables created with kind STABLE_HASH; see
+  stable.h for the meaning of each operation. Iteration is done by
+  stable.c over the sorted entries.
+*/
+
+#ifndef __HTABLE_H__
+#define __HTABLE_H__
+
+#include "stable.h"
+
+// The hash table.
+typedef struct htable_s *HashTable;
+
+/*
+  Return a new and empty hash table.
+*/
+HashTable htable_create();
+
+/*
+  Destroy a hash table.
+*/
+void htable_destroy(HashTable H);
+
+/*
+  Insert key, as in stable_insert. Data pointers stay valid until the
+  table is destroyed.
+*/
+InsertionResult htable_insert(HashTable H, const char *key);
+
+/*
+  Find key, as in stable_find.
+*/
+EntryData *htable_find(HashTable H, const char *key);
+
+/*
+  Like htable_insert and htable_find, for a key of length len whose
+  hash, as computed by htable_hash, is already known.
+*/
+InsertionResult htable_insert_hashed(HashTable H, const char *key, size_t len,
+                                     unsigned int hash);
+EntryData *htable_find_hashed(HashTable H, const char *key, size_t len,
+                              unsigned int hash);
+
+/*
+  Store the key and data pointer of every entry, in no particular
+  order, in the arrays keys and data, which must have room for
+  htable_size(H) elements. The table is not modified, and the
+  pointers stay valid until the table is destroyed.
+*/
+void htable_collect(HashTable H, const char **keys, EntryData **data);
+
+/*
+  Sort the entries by key, unless they are sorted since the last
+  insertion, and return their number. Entry i in increasing key order
+  is then given by htable_sorted_key and htable_sorted_data, until the
+  next insertion.
+*/
+size_t htable_sort(HashTable H);
+const char *htable_sorted_key(HashTable H, size_t i);
+EntryData *htable_sorted_data(HashTable H, size_t i);
+
+/*
+  Return the number of entries.
+*/
+size_t htable_size(HashTable H);
+
+/*
+  Fill *stats, as in stable_stats. The node count is the number of
+  slots.
+*/
+void htable_stats(HashTable H, StableStats *stats);
+
+/*
+  Hash of the first len characters of key. Used by every hashed
+  structure over keys, so hashes computed once can be reused.
+*/
+unsigned int htable_hash(const char *key, size_t len);
+
+#endif
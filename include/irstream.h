@@ -0,0 +1,99 @@
+/*
+  irstream.h
+
+  Compact representation of a sequence of instructions: one array per
+  field, operands stored inline as tagged values and strings (labels
+  and string operands) as offsets into a shared pool. Passes over a
+  stream walk contiguous memory instead of a linked list of separately
+  allocated instructions and operands.
+
+  For now streams are only a storage format: they are built from and
+  turned back into instruction lists (see parse_test), and no pass of
+  the assembler, linker or simulator walks them yet; those still work
+  on Instruction lists.
+*/
+
+#ifndef __IRSTREAM_H__
+#define __IRSTREAM_H__
+
+#include "asmtypes.h"
+#include "stable.h"
+
+// Operands of one instruction. The type of operand k is type[k], with
+// OP_NONE if absent; for REGISTER, val[k] is the register number, for
+// NUMBER_TYPE the number and for LABEL and STRING the offset of the
+// string in the pool.
+typedef struct {
+  unsigned char type[3];
+  octa val[3];
+} IROperands;
+
+// The stream. Instruction i is made of op[i], opds[i], label[i],
+// lineno[i] and pos[i].
+typedef struct {
+  // Number of instructions and room in the arrays.
+  int n, max;
+
+  const Operator **op;
+  IROperands *opds;
+
+  // Offset of the label in the pool plus one, or zero if none.
+  unsigned int *label;
+
+  int *lineno, *pos;
+
+  // String pool. Each distinct string is stored once.
+  char *pool;
+  size_t poolsize, poolmax;
+  SymbolTable strings;
+} InstrStream;
+
+/*
+  Create and return a new and empty stream.
+*/
+InstrStream *irs_create();
+
+/*
+  Destroy a stream.
+*/
+void irs_destroy(InstrStream *S);
+
+/*
+  Return the offset in the pool of a copy of str, adding it if it is
+  not there yet.
+*/
+unsigned int irs_intern(InstrStream *S, const char *str);
+
+/*
+  Return the string at offset off of the pool.
+*/
+const char *irs_string(const InstrStream *S, unsigned int off);
+
+/*
+  Return the label of instruction i, or NULL if it has none.
+*/
+const char *irs_label(const InstrStream *S, int i);
+
+/*
+  Append a copy of instr to the stream and return its index.
+*/
+int irs_append(InstrStream *S, const Instruction *instr);
+
+/*
+  Return a new stream with copies of the instructions in the linked
+  list starting at head.
+*/
+InstrStream *irs_from_list(const Instruction *head);
+
+/*
+  Return a new Instruction equal to instruction i of the stream.
+*/
+Instruction *irs_get(const InstrStream *S, int i);
+
+/*
+  Return a new linked list of Instructions equal to the stream, or
+  NULL if the stream is empty.
+*/
+Instruction *irs_to_list(const InstrStream *S);
+
+#endif
@@ -0,0 +1,68 @@
+/*
+  jit.h
+
+  Translation of MAC211 code to x86-64 code, for the simulator.
+
+  sim_run splits the program into basic blocks: runs of instructions
+  from the target of a jump up to the next jump (JMP, J..., GO) or up
+  to an instruction that is left to the interpreter (DIV, SAVE, REST,
+  INT, and any unknown opcode). Blocks are interpreted until they have
+  run JIT_HOT times; then they are translated into native code in an
+  executable region, and run from there. The region is never writable
+  and executable at once: its pages are made writable only while a
+  block is written or a jump between blocks is patched.
+
+  The guest registers stay in the Machine: native code loads and
+  stores them around each instruction, so that its state is that of
+  the interpreter at every instruction boundary, and any instruction
+  can leave to the interpreter. Loads and stores check their address
+  against the memory and leave before faulting, for the interpreter to
+  report the fault; stores below the end of the translated code, or
+  into words the interpreter has decoded, also leave, for the
+  interpreter to run them, decode the words again and drop the
+  translations if they change code.
+
+  Native code has a TLB of its own, with the base of the last page
+  accessed in a host register; accesses to other pages call back into
+  the simulator to look them up.
+
+  A block ending in a jump to a known address leaves through a stub
+  that, once the target is translated, is patched into a direct jump
+  to it, so that hot loops run from block to block without returning
+  to the simulator. Every block starts by taking its length out of the
+  steps left, and returns if there are not enough of them.
+
+  With SIM_JIT_CHECK, blocks are not chained, and every block run
+  natively is also run in the interpreter, on a copy of the machine,
+  and the registers of both compared; at the end of the run, the
+  registers and the memory are compared again.
+*/
+
+#ifndef __JIT_H__
+#define __JIT_H__
+
+#include "sim.h"
+
+// Times a block is interpreted before being translated.
+#define JIT_HOT 8
+
+// The translator of a machine.
+typedef struct jit_s Jit;
+
+/*
+  Return nonzero if native code can be generated on this host.
+*/
+int jit_available();
+
+/*
+  Run M like sim_run, translating hot blocks. Falls back on the
+  interpreter if no executable memory can be had.
+*/
+int jit_run(Machine *M, uocta max_steps);
+
+/*
+  Free the translator J, which may be NULL.
+*/
+void jit_destroy(Jit *J);
+
+#endif
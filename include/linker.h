@@ -0,0 +1,77 @@
+/*
+  linker.h
+
+  The linker: joins object files (see object.h) into one program.
+
+  Objects are laid out one after the other, in the order given, and
+  every phase of the link works on objects independently, so each is
+  spread over a pool of threads: objects are mapped and checked in
+  parallel; their exported symbols are merged into one concurrent
+  table; and each object's code is copied to its own range of the
+  program and its relocations applied there. Problems are gathered per
+  object and reported in input order, so the messages are the same
+  whatever the number of threads.
+
+  Archives (see archive.h) given to the link are searched, in order,
+  for the symbols that the objects leave undefined, and the members
+  that define them are linked after the objects, in the order they are
+  found to be needed. Only the index of an archive and the members
+  pulled in are read.
+*/
+
+#ifndef __LINKER_H__
+#define __LINKER_H__
+
+#include "object.h"
+#include "archive.h"
+#include "stable.h"
+
+// A linked program.
+typedef struct {
+  utetra *code;  // The program: n words.
+  int n;
+
+  int nobjects;
+  Object **objects;  // Objects, NULL for those that failed to load.
+  char **names;      // Their names, for messages, or NULL.
+  int *base;         // Address of each object in the program.
+
+  // Archives searched, whose members are among the objects.
+  Archive **archives;
+  int narchives;
+
+  // Exported symbols; EntryData.u of each is (object + 1) << 32 | k
+  // for the k-th symbol of the object that defines it first.
+  SymbolTable globals;
+
+  // Error messages: failed objects, duplicate and undefined symbols
+  // and jumps out of reach, by object and then by symbol or site.
+  char **errors;
+  int nerrors;
+} Link;
+
+/*
+  Link the object files with the given names, using nthreads threads.
+  Returns the link, whose code is only valid if there are no errors.
+*/
+Link *link_files(char *const *names, int n, int nthreads);
+
+/*
+  Like link_files, pulling in members of the archives with the given
+  names as needed.
+*/
+Link *link_archives(char *const *names, int n, char *const *archives,
+                    int narchives, int nthreads);
+
+/*
+  Like link_files, for objects already in memory. The link takes over
+  the objects, and closes them when destroyed.
+*/
+Link *link_objects(Object **objects, int n, int nthreads);
+
+/*
+  Destroy a link, closing its objects.
+*/
+void link_destroy(Link *L);
+
+#endif
@@ -0,0 +1,77 @@
+/*
+  lsource.h
+
+  Line sources: the common input layer of the tools. A regular file is
+  mapped into memory and lines and words are handed out as views into
+  the mapping, without copying. Pipes, terminals and other inputs that
+  cannot be mapped are read in large blocks into a read-ahead buffer,
+  and views point into that buffer.
+
+  Views are not NUL-terminated, and are valid until the next call on
+  the same source (mapped sources: until the source is closed).
+*/
+
+#ifndef __LSOURCE_H__
+#define __LSOURCE_H__
+
+#include <stdio.h>
+
+// A line source.
+typedef struct lsource_s *LineSource;
+
+/*
+  Open the file with the given name as a line source; if name is NULL
+  or "-", the standard input is used.
+
+  Returns NULL, with errno set, if the file cannot be opened.
+*/
+LineSource lsource_open(const char *name);
+
+/*
+  Return a line source reading the given stream from its current
+  position. The stream is not closed with the source, and must not be
+  read by other means while the source is in use.
+*/
+LineSource lsource_file(FILE *file);
+
+/*
+  Read ahead in the background: a thread reads the next nblocks (at
+  least 2) blocks of input while the caller works on the current one.
+  Use it for pipes fed by another program, so that reading and
+  processing overlap. Returns zero, and does nothing, for mapped
+  sources or if the thread cannot be started. lsource_close stops the
+  thread, even while it waits for input.
+*/
+int lsource_readahead(LineSource L, int nblocks);
+
+/*
+  Close a line source.
+*/
+void lsource_close(LineSource L);
+
+/*
+  Return nonzero if the source is a memory mapping.
+*/
+int lsource_mapped(LineSource L);
+
+/*
+  Return a view of the next line, including its newline character if
+  present, and store its length in *len. Returns NULL at end of input.
+*/
+const char *lsource_line(LineSource L, int *len);
+
+/*
+  Return a view of the next word, that is, of the next maximal run of
+  characters that are not spaces (as in the "C" locale), and store
+  its length in *len. Returns NULL if there are no more words.
+*/
+const char *lsource_word(LineSource L, int *len);
+
+/*
+  Return a view of all the remaining input, which is NUL-terminated,
+  and store its length in *len. Afterwards the source is at end of
+  input. Streaming sources read everything into memory first.
+*/
+const char *lsource_text(LineSource L, size_t *len);
+
+#endif
@@ -12,4 +12,7 @@
 typedef long long octa;
 typedef unsigned long long uocta;
 
+// Unsigned integer type with 32 bits: a MAC211 instruction word.
+typedef unsigned int utetra;
+
 #endif
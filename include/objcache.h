@@ -0,0 +1,81 @@
+/*
+  objcache.h
+
+  Cache of object files, so that unchanged sources are not assembled
+  again.
+
+  Objects are kept in a directory, one file per object, named by a key
+  that hashes everything the object depends on: the source and its
+  name, the options of the assembler, the operator table (see
+  optable_version) and the versions of the object format and of the
+  cache itself. A hit is a hard link to the cached file, or a copy
+  where links cannot be made, and takes no parsing or encoding.
+
+  Entries are written to a temporary file and renamed into place, so
+  that concurrent builds never see partial entries. When the entries
+  take more than the size given to cache_open, the least recently
+  used are removed until they take at most three quarters of it.
+
+  The hash is fast, not cryptographic: the cache trusts whoever can
+  write to its directory.
+
+  The tree has no assembler driver yet, so nothing but cache_test uses
+  the cache; it is meant to sit between a driver and obj_write.
+*/
+
+#ifndef __OBJCACHE_H__
+#define __OBJCACHE_H__
+
+#include <stddef.h>
+
+// Version of the cache, to be raised whenever the encoding of objects
+// changes in ways the other versions do not show.
+#define CACHE_VERSION 1
+
+// Length of a key, in hexadecimal digits.
+#define CACHE_KEY_LEN 32
+
+// The cache.
+typedef struct objcache_s *ObjCache;
+
+/*
+  Open the cache in the given directory, creating the directory if
+  needed, with at most max_bytes of entries. Returns NULL on error,
+  with the error message set (see error.h).
+*/
+ObjCache cache_open(const char *dir, size_t max_bytes);
+
+/*
+  Close a cache.
+*/
+void cache_close(ObjCache C);
+
+/*
+  Store in key, which has room for CACHE_KEY_LEN + 1 characters, the
+  key of the object assembled from the len bytes of src, read from the
+  file named source, with the given options.
+*/
+void cache_key(const char *src, size_t len, const char *source,
+               const char *options, char *key);
+
+/*
+  Look up key and, if it is in the cache, make dest a link to or a
+  copy of its object. Returns 1 on a hit, 0 on a miss, and -1, with
+  the error message set, if dest cannot be written.
+*/
+int cache_get(ObjCache C, const char *key, const char *dest);
+
+/*
+  Store the object image of size bytes under key, evicting old entries
+  if the cache grows too large. Returns zero on error, with the error
+  message set.
+*/
+int cache_put(ObjCache C, const char *key, const void *image, size_t size);
+
+/*
+  Return the number of bytes taken by the entries, as far as this
+  process knows.
+*/
+size_t cache_bytes(ObjCache C);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+  object.h
+
+  Object files: the output of macas and the input of maclk.
+
+  An object file is meant to be mapped into memory and used in place.
+  It is a header followed by sections, each starting at a multiple of
+  OBJ_ALIGN bytes from the start of the file:
+
+    code         the program, one word per instruction word
+    symbols      ObjSymbol records, sorted by name
+    relocations  ObjReloc records, sorted by site
+    lines        ObjLine records, sorted by address
+    strings      the names, NUL-terminated, referred to by offset
+
+  Every field is a 32-bit little-endian integer, so records have fixed
+  widths and the sections are arrays that can be indexed directly.
+*/
+
+#ifndef __OBJECT_H__
+#define __OBJECT_H__
+
+#include "assembler.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#define OBJ_MAGIC 0x4f43414d  // "MACO"
+#define OBJ_VERSION 1
+#define OBJ_ALIGN 16
+
+// Symbol flags.
+#define OBJ_DEFINED 1   // Defined in this object.
+#define OBJ_EXPORTED 2  // Declared by EXTERN.
+
+// The header, at offset 0. Sections are given by offset and count.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size;      // Bytes in the file.
+  uint32_t source;    // Offset of the name of the source file.
+  uint32_t code, ncode;
+  uint32_t symbols, nsymbols;
+  uint32_t relocs, nrelocs;
+  uint32_t lines, nlines;
+  uint32_t strings, nstrings;  // nstrings is in bytes.
+  uint32_t reserved[2];
+} ObjHeader;
+
+// A label used or defined by the object.
+typedef struct {
+  uint32_t name;   // Offset in the strings.
+  uint32_t hash;   // obj_hash of the name.
+  uint32_t addr;   // Address in words, if defined.
+  uint32_t flags;
+} ObjSymbol;
+
+// The jump at word site, encoded with a zero displacement, goes to
+// symbols[symbol], which the object does not define.
+typedef struct {
+  uint32_t site;
+  uint32_t symbol;
+} ObjReloc;
+
+// The words from addr up to the next record come from line lineno.
+typedef struct {
+  uint32_t addr;
+  uint32_t lineno;
+} ObjLine;
+
+// An object in memory. The pointers are into the image.
+typedef struct {
+  const ObjHeader *header;
+  const utetra *code;
+  const ObjSymbol *symbols;
+  const ObjReloc *relocs;
+  const ObjLine *lines;
+  const char *strings;
+
+  // Mapping, if the object was opened from a file.
+  void *map;
+  size_t maplen;
+} Object;
+
+/*
+  Return the hash of a symbol name, as stored in ObjSymbol.hash.
+*/
+uint32_t obj_hash(const char *name);
+
+/*
+  Return the image of the object file of a finished assembler (see
+  asm_finish), with the name of its source, or NULL, and store its
+  size in *size. The image is allocated with malloc.
+*/
+void *obj_build(const Assembler *A, const char *source, size_t *size);
+
+/*
+  Write an object image of size bytes, or an archive (see archive.h),
+  to the file with the given name.
+  The image goes to a new file that is synced to disk and then
+  replaces the old one, so that readers never see a partial object,
+  even after a crash, and other links to the old file (see objcache.h)
+  keep it as it was. Returns zero on error, with the
+  error message set (see error.h).
+*/
+int obj_save(const void *image, size_t size, const char *name);
+
+/*
+  Write the object file of a finished assembler, as obj_save does.
+*/
+int obj_write(const Assembler *A, const char *source, const char *name);
+
+/*
+  Map the object file with the given name. Returns NULL on error,
+  with the error message set.
+*/
+Object *obj_open(const char *name);
+
+/*
+  Return an object using the image of size bytes in place, which must
+  stay valid while the object is in use and be aligned to OBJ_ALIGN
+  bytes. Returns NULL, with the error message set, if the image is not
+  a valid object file. On big-endian hosts the image must have been
+  converted to the host byte order, as obj_open does (see obj_swap).
+*/
+Object *obj_view(const void *image, size_t size);
+
+/*
+  Convert an object image of size bytes from the byte order of files
+  to that of the host, in place. Does nothing on little-endian hosts.
+*/
+void obj_swap(void *image, size_t size);
+
+/*
+  Close an object, unmapping its file if it was opened by obj_open.
+*/
+void obj_close(Object *O);
+
+/*
+  Return the string at the given offset.
+*/
+const char *obj_string(const Object *O, uint32_t offset);
+
+/*
+  Return the symbol with the given name, or NULL.
+*/
+const ObjSymbol *obj_find(const Object *O, const char *name);
+
+#endif
@@ -116,4 +116,9 @@
 #define INT     0xfe
 #define NOP     0xff
 
+// Registers used by the expansions of the pseudo-operators.
+#define REG_SP  253  // Stack pointer; the stack grows upwards.
+#define REG_X   252  // Scratch register for return addresses.
+#define REG_Y   251  // Scratch register for far addresses.
+
 #endif
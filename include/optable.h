@@ -12,8 +12,27 @@
 /*
   Return pointer to operator given its name.
 
-  If the operator is in the table, returns NULL.
+  If the operator is not in the table, returns NULL. Lookups take
+  constant time, hits and misses alike.
 */
 const Operator *optable_find(const char *name);
 
+/*
+  Like optable_find, but ignoring the case of letters in name.
+*/
+const Operator *optable_find_nocase(const char *name);
+
+/*
+  Like optable_find, for the name made of the first len characters of
+  the given string, which need not be NUL-terminated.
+*/
+const Operator *optable_find_span(const char *name, int len);
+
+/*
+  Return the version of the operator table: a hash of the names,
+  opcodes and operand types of all operators, which changes whenever
+  any of them does.
+*/
+uocta optable_version();
+
 #endif
@@ -17,14 +17,49 @@
 
   - s -- line of assembly code.
 
-  - alias_table -- table of aliases used so far.
+  - alias_table -- table of aliases used so far, or NULL. As in
+    parse_source, label operands naming an alias are replaced by a
+    copy of its operand, and an IS line defines its label as an alias
+    in the table. If NULL, operands are left as written.
 
   Returns nonzero on success, zero to signal an error. On success,
   *instr contains the parsed instruction, unless the line was
-  empty. On error, *errptr, if non-NULL, points to the character in s
-  where the error was found.
+  empty. On error, such as a command without an operator, the error
+  message is set and *errptr, if non-NULL, points to the character in
+  s where the error was found.
 */
 int parse(const char *s, SymbolTable alias_table, Instruction **instr,
           const char **errptr);
 
+/*
+  Parse a whole source text.
+
+  INPUT:
+
+  - src -- the source, a NUL-terminated string of lines.
+
+  - alias_table -- table of aliases; IS lines define aliases, which
+    replace label operands on the lines that follow them.
+
+  Returns nonzero on success, zero to signal an error. On success,
+  *head points to the linked list of parsed instructions, in source
+  order, with lineno set to their line numbers (counted from 1). On
+  error, *head is NULL, the error message is set, starting with the
+  line number, and *errptr, if non-NULL, points to the character in
+  src where the error was found.
+*/
+int parse_source(const char *src, SymbolTable alias_table, Instruction **head,
+                 const char **errptr);
+
+/*
+  Like parse_source, but the source is split at line boundaries into
+  chunks that are parsed by nthreads threads. Aliases are resolved
+  afterwards, in source order, so the result is the same as that of
+  parse_source. Errors found by the threads are reported by the
+  calling thread, as parse_source reports them.
+*/
+int parse_source_parallel(const char *src, SymbolTable alias_table,
+                          Instruction **head, const char **errptr,
+                          int nthreads);
+
 #endif
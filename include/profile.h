@@ -0,0 +1,69 @@
+/*
+  profile.h
+
+  Execution profiles of simulated programs, by source line and by
+  label. A profile puts together the counts a machine kept while
+  running (see sim_profile), the line table of the assembler that made
+  the program, and its labels: the code of a label goes from its
+  address up to the next label.
+*/
+
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "sim.h"
+#include "assembler.h"
+#include <stdio.h>
+
+// Counts of the code of a source line or of a label.
+typedef struct {
+  int lineno;         // Line, for lines.
+  const char *label;  // Name, for labels; NULL for code before any.
+  int addr;           // First word.
+  uocta count, cycles;
+} ProfileEntry;
+
+// A profile.
+typedef struct {
+  // Lines that made code, by line number, and labels, by address.
+  ProfileEntry *lines, *labels;
+  int nlines, nlabels;
+
+  // Instructions run and cycles, in all.
+  uocta count, cycles;
+} Profile;
+
+/*
+  Fill costs, for sim_profile, with the cycles of each opcode in a
+  simple in-order pipeline: 1 for most instructions, 3 for loads and
+  stores, 4 for multiplications, 20 for divisions, 2 for jumps, GO and
+  GETA, 8 for SAVE and REST and 50 for INT.
+*/
+void profile_costs(unsigned costs[256]);
+
+/*
+  Return the profile of the runs of M, which must be profiling, on the
+  program assembled by A.
+*/
+Profile *profile_create(const Machine *M, Assembler *A);
+
+/*
+  Destroy a profile.
+*/
+void profile_destroy(Profile *P);
+
+/*
+  Write the flat profile: the labels and then the top source lines
+  that took the most cycles, with their share of the cycles in all.
+  Lines are shown with their text if source, the text of the program,
+  is not NULL.
+*/
+void profile_flat(FILE *out, const Profile *P, const char *source, int top);
+
+/*
+  Write source, the text of the program, with the count and cycles of
+  every line that made code in front of it.
+*/
+void profile_annotate(FILE *out, const Profile *P, const char *source);
+
+#endif
@@ -0,0 +1,41 @@
+/*
+  relax.h
+
+  Branch relaxation: the choice of the version of every jump, GETA and
+  CALL (see encoder.h), the shortest that reaches its target.
+
+  Every instruction starts in its short version, and versions only
+  grow. A jump whose target is within its reach with some words to
+  spare cannot be pushed out of it until the program grows by more
+  than that, so jumps wait on a worklist ordered by that slack, and
+  only those whose slack may have been used up are checked again,
+  instead of passing over the whole program until nothing changes.
+*/
+
+#ifndef __RELAX_H__
+#define __RELAX_H__
+
+#include "asmtypes.h"
+#include "stable.h"
+
+/*
+  Like encode_layout, choosing the version of every instruction. On
+  success, *reach is set to a new array, to be freed by the caller,
+  with the reach of each instruction of the list, in order.
+
+  Returns the size of the program in words, or -1 on error, with the
+  error message set and *errinstr, if errinstr is non-NULL, pointing
+  to the offending instruction.
+*/
+int relax_layout(const Instruction *head, SymbolTable labels,
+                 unsigned char **reach, const Instruction **errinstr);
+
+/*
+  Like encode_program, for a list laid out by relax_layout with the
+  same labels, using the versions it chose.
+*/
+int relax_program(const Instruction *head, SymbolTable labels,
+                  const unsigned char *reach, utetra *out,
+                  const Instruction **errinstr);
+
+#endif
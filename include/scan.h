@@ -0,0 +1,56 @@
+/*
+  scan.h
+
+  Delimiter scanning for the assembly language lexer. Each scan has a
+  portable version and, on x86, SSE2 and AVX2 versions that examine 16
+  or 32 characters at a time; the fastest one the processor supports
+  is chosen on first use. All versions give identical results.
+
+  Spaces are the characters ' ', '\t', '\n', '\v', '\f' and '\r', as
+  for isspace in the "C" locale.
+*/
+
+#ifndef __SCAN_H__
+#define __SCAN_H__
+
+#include <stddef.h>
+
+// Implementations of the scans.
+typedef enum {
+  SCAN_SCALAR,
+  SCAN_SSE2,
+  SCAN_AVX2
+} ScanKernel;
+
+/*
+  Return the number of characters of s before the first NUL, '*',
+  newline or ';'.
+*/
+size_t scan_command(const char *s);
+
+/*
+  Return the number of characters of s before the first NUL, '*',
+  space, ',' or ';'.
+*/
+size_t scan_word(const char *s);
+
+/*
+  Return the number of characters at the start of s that are spaces,
+  ',' or ';'.
+*/
+size_t scan_skip(const char *s);
+
+/*
+  Use the given implementation from now on. Returns zero, and changes
+  nothing, if it is not supported by this build or processor. Not to
+  be called while other threads are scanning.
+*/
+int scan_select(ScanKernel kernel);
+
+/*
+  Return the implementation in use, choosing it if no scan has been
+  run yet. Threads started after this call see the same choice.
+*/
+ScanKernel scan_kernel();
+
+#endif
@@ -0,0 +1,195 @@
+/*
+  sim.h
+
+  Simulator of the MAC211 computer.
+
+  The machine has 256 general registers of 64 bits, two special ones
+  (rH, the high half of products, and rR, the remainder of divisions)
+  and a byte-addressed big-endian memory, from address 0, holding both
+  the program and its data. Memory is sparse (see vmem.h): it may be
+  as large as SIM_MEMSIZE_MAX, and only the pages written take room.
+  Instructions are words at multiples of 4, in the first SIM_CODE_SIZE
+  bytes of memory;
+  the displacements of jumps and GETA count words from the instruction
+  itself, and addresses in registers are byte addresses.
+
+  Instructions take $X, $Y and $Z, where the last is the byte Z itself
+  in the immediate (...I) versions. Loads and stores go to $Y + $Z,
+  rounded down to a multiple of the size. Besides the obvious ones:
+
+    DIV, DIVU   $X <- $Y / $Z, rR <- remainder; division by zero gives
+                quotient 0 and remainder $Y
+    MUL, MULU   $X <- low 64 bits of the product, rH <- high 64 bits
+    CMP, CMPU   $X <- -1, 0 or 1 as $Y is less, equal or greater
+    SR          arithmetic shift; SRU logical
+    NEG, NEGU   $X <- Y - $Z, Y being the byte Y itself
+    NXOR        $X <- ~($Y ^ $Z)
+    GETA        $X <- address of the word YZ words away
+    SETW        $X <- YZ
+    GO          jump to $X + 4YZ (GOB: - 4YZ), and $X <- address of
+                the next instruction
+    SAVE        store $Y, ..., $Z at $X and advance $X past them
+    REST        move $X back over $Y, ..., $Z and load them from $X
+    INT         interrupt XYZ: 0 halts, 1 writes the character in
+                $255, 2 the NUL-terminated string at $255, 3 the
+                signed decimal number in $255; others are handed to
+                the trap function of the machine, if any
+
+  The interpreter dispatches through a table of 256 entries, one per
+  opcode. With GCC and compatible compilers the table holds the
+  addresses of the handlers and each handler jumps straight to the
+  next (computed goto); elsewhere it is a switch.
+
+  Words are decoded once, when first executed, into a side array
+  indexed by the word address: the handler, the register fields, the
+  immediate and, for jumps, the target word. The array covers memory
+  from address 0 up to the highest word executed so far; stores into
+  it mark the words they change to be decoded again.
+
+  Loads and stores go through the last page accessed (a TLB of one
+  entry) and look the page up in the table only when they leave it.
+  As accesses are aligned, they never cross pages, and are single
+  loads and stores with a byte swap.
+
+  With a profile (see sim_profile), the loop also counts, for each
+  word, the times it is run and the cycles it takes in a cost model;
+  this loop is a separate copy, so that runs without a profile do not
+  pay for it.
+
+  On x86-64 Linux, sim_run can also translate the basic blocks run
+  most often to native code (see jit.h), and leave the rest to the
+  interpreter.
+*/
+
+#ifndef __SIM_H__
+#define __SIM_H__
+
+#include "mactypes.h"
+#include "vmem.h"
+#include <stdio.h>
+
+// Results of sim_run.
+#define SIM_HALTED 0   // INT 0.
+#define SIM_LIMIT  1   // The step limit was reached.
+#define SIM_FAULT  -1  // Bad instruction or address; see error.h.
+
+// Largest memory, and the part of it that can hold code.
+#define SIM_MEMSIZE_MAX VMEM_SIZE
+#define SIM_CODE_SIZE   ((uocta) 1 << 28)
+
+// Tiers of sim_run.
+#define SIM_INTERPRET 0  // Interpreter only.
+#define SIM_JIT       1  // Native code for hot blocks, where available.
+#define SIM_JIT_CHECK 2  // The same, checked against the interpreter.
+
+// A decoded instruction.
+typedef struct {
+  const void *handler;  // With computed goto.
+  utetra arg;           // Immediate, or target word of a jump.
+  unsigned char op, x, y, z;
+} Decoded;
+
+// Operator of the words not decoded since they were last written.
+#define SIM_UNDECODED 0x5d
+
+// Times a word was run, and the cycles it took, in a profile.
+typedef struct {
+  uocta count, cycles;
+} SimCount;
+
+// The machine.
+typedef struct machine_s {
+  uocta reg[256];
+  uocta rH, rR;
+  uocta pc;     // Address of the next instruction.
+  uocta steps;  // Instructions executed.
+
+  VMem mem;
+  uocta memsize;  // Addresses are below memsize.
+
+  // The last page accessed, by number, and its bytes.
+  uocta tlb_page;
+  unsigned char *tlb_data;
+
+  FILE *out;  // Output of INT 1 to 3; stdout by default.
+
+  // Interrupts other than 0 to 3: return zero to fault.
+  int (*trap)(struct machine_s *M, unsigned code);
+  void *ctx;
+
+  int portable;  // Use the switch even if computed goto is available.
+
+  // Decoded words from address 0, and the loop that decoded them.
+  Decoded *decoded;
+  uocta ndecoded;
+  int decoded_loop;
+  uocta code_writes;  // Stores to decoded instructions, and flushes.
+
+  int tier;            // SIM_INTERPRET by default.
+  struct jit_s *jit;   // State of the translator.
+  uocta native_steps;  // Instructions run as native code.
+
+  // Profile, if profiling: counts of the words from address 0, and
+  // cycles of each opcode.
+  int profiling;
+  SimCount *counts;
+  uocta ncounts;
+  unsigned costs[256];
+} Machine;
+
+/*
+  Return a new machine with memsize bytes of memory, at most
+  SIM_MEMSIZE_MAX, all zero, as are its registers.
+*/
+Machine *sim_create(uocta memsize);
+
+/*
+  Destroy a machine.
+*/
+void sim_destroy(Machine *M);
+
+/*
+  Load the n words of code at address 0, set pc to 0 and the stack
+  pointer (REG_SP) to the first octa after the code. Returns zero,
+  with the error message set, if they do not fit.
+*/
+int sim_load(Machine *M, const utetra *code, int n);
+
+/*
+  Forget the decoded instructions; needed only after code is written
+  to M->mem other than by the program itself or sim_load.
+
+  Tools reading or writing M->mem outside of a run do it with the
+  functions of vmem.h.
+*/
+void sim_flush(Machine *M);
+
+/*
+  Run at most max_steps instructions (0: no limit), in the tier of the
+  machine, or interpreted if profiling. Returns SIM_HALTED, SIM_LIMIT
+  or SIM_FAULT.
+*/
+int sim_run(Machine *M, uocta max_steps);
+
+/*
+  Like sim_run, with the interpreter whatever the tier.
+*/
+int sim_interpret(Machine *M, uocta max_steps);
+
+/*
+  Start keeping a profile of the runs of M in M->counts, which covers
+  the words run so far, indexed by word address, and grows with them.
+  costs gives the cycles of each opcode (see profile.h), or is NULL
+  for one cycle per instruction. Profiled runs are interpreted, whatever
+  the tier. The counts are kept when called again, with the new costs
+  applying from then on.
+*/
+void sim_profile(Machine *M, const unsigned *costs);
+
+/*
+  Return nonzero if computed goto is available; sim_run then uses it
+  unless the portable flag of the machine is set.
+*/
+int sim_threaded();
+
+#endif
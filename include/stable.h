@@ -8,6 +8,7 @@
 #define __STABLE_H__
 
 #include "asmtypes.h"
+#include <stddef.h>
 
 // The symbol table.
 typedef struct stable_s *SymbolTable;
@@ -28,11 +29,40 @@ typedef struct {
   EntryData *data;  // Data associated with entry.
 } InsertionResult;
 
+// Memory statistics, filled by stable_stats.
+typedef struct {
+  size_t entries;  // Number of keys in the table.
+  size_t nodes;    // Number of internal nodes (tree nodes or slots).
+  size_t bytes;    // Bytes of memory held by the table.
+} StableStats;
+
+// Cursor over the entries of a symbol table.
+typedef struct stable_iter_s *StableIter;
+
+// Symbol table implementations.
+typedef enum {
+  STABLE_TST,   // Ternary search tree.
+  STABLE_HASH,  // Open-addressing hash table; faster point queries,
+                // keys are sorted only when visited.
+  STABLE_CONCURRENT  // Lock-striped hash table; see below.
+} StableKind;
+
 /*
-  Return a new symbol table.
+  Return a new symbol table, implemented as a ternary search tree.
 */
 SymbolTable stable_create();
 
+/*
+  Return a new symbol table of the given kind. Every operation below
+  works the same on every kind.
+
+  Only tables of kind STABLE_CONCURRENT may be used by several threads
+  at once, and then only through stable_insert, stable_find,
+  stable_visit, the cursor functions and stable_stats. Visits and
+  cursors work on a sorted snapshot taken when they begin.
+*/
+SymbolTable stable_create_kind(StableKind kind);
+
 /*
   Destroy a given symbol table.
 */
@@ -44,7 +74,8 @@ void stable_destroy(SymbolTable table);
   If there is already an entry with the given key, then a struct
   InsertionResult is returned with new == 0 and data pointing to the
   data associated with the entry. Otherwise, a struct is returned with
-  new != 0 and data pointing to the data field of the new entry.
+  new != 0 and data pointing to the data field of the new entry, which
+  is zeroed.
 
   If there is not enough space on the table, or if there is a memory
   allocation error, then crashes with an error message.
@@ -71,5 +102,50 @@ EntryData *stable_find(SymbolTable table, const char *key);
 int stable_visit(SymbolTable table,
                  int (*visit)(const char *key, EntryData *data));
 
+/*
+  Return a cursor over the entries whose keys start with prefix (all
+  entries if prefix is NULL or empty), in increasing key order. On a
+  tree only the subtree below the prefix is walked; other kinds
+  binary-search their sorted entries.
+
+  No entries may be inserted while the cursor is in use, except on a
+  ternary search tree table.
+*/
+StableIter stable_iter_begin(SymbolTable table, const char *prefix);
+
+/*
+  Advance the cursor. Returns zero if there are no more entries;
+  otherwise stores the key and the data of the next entry in *key and
+  *data (unless they are NULL) and returns nonzero. The key string
+  belongs to the cursor and is valid until the next call.
+
+  No memory is allocated, except to grow the cursor's stack and key
+  buffer on unusually deep trees.
+*/
+int stable_iter_next(StableIter it, const char **key, EntryData **data);
+
+/*
+  Destroy a cursor.
+*/
+void stable_iter_end(StableIter it);
+
+/*
+  Freeze the table: turn it into a read-only snapshot laid out in one
+  contiguous block, with a hash index over keys kept in sorted order.
+  Use it once a table is complete and only lookups follow.
+
+  Afterwards stable_find and stable_visit work as before, but the
+  data pointers obtained before freezing are no longer valid, and
+  stable_insert crashes with an error message unless the key is
+  already in the table (in which case new == 0). Freezing a frozen
+  table does nothing.
+*/
+void stable_freeze(SymbolTable table);
+
+/*
+  Fill *stats with the number of entries, the number of internal
+  nodes and the total memory held by the table.
+*/
+void stable_stats(SymbolTable table, StableStats *stats);
 
 #endif
@@ -0,0 +1,74 @@
+/*
+  vmem.h
+
+  Sparse memory of the simulator: a space of VMEM_SIZE bytes, in pages
+  of VMEM_PAGE_SIZE bytes found through a table of two levels. Pages
+  and second-level tables are allocated when first written; reading
+  memory never written gives zero.
+*/
+
+#ifndef __VMEM_H__
+#define __VMEM_H__
+
+#include "mactypes.h"
+#include <stddef.h>
+
+// Bits of addresses and of offsets in a page.
+#define VMEM_BITS      48
+#define VMEM_PAGE_BITS 16
+
+#define VMEM_SIZE      ((uocta) 1 << VMEM_BITS)
+#define VMEM_PAGE_SIZE ((uocta) 1 << VMEM_PAGE_BITS)
+
+// Never the number (address >> VMEM_PAGE_BITS) of a page.
+#define VMEM_NO_PAGE (~(uocta) 0)
+
+// The memory.
+typedef struct vmem_s *VMem;
+
+// A page of zeros, for reading pages not allocated.
+extern const unsigned char vmem_zeros[VMEM_PAGE_SIZE];
+
+/*
+  Return a new memory, all zero.
+*/
+VMem vmem_create();
+
+/*
+  Destroy a memory, freeing its pages.
+*/
+void vmem_destroy(VMem V);
+
+/*
+  Return the page holding address a, which must be below VMEM_SIZE.
+  If it is not allocated, allocates it if alloc is nonzero, and
+  returns NULL otherwise.
+
+  If there is a memory allocation error, then crashes with an error
+  message.
+*/
+unsigned char *vmem_page(VMem V, uocta a, int alloc);
+
+/*
+  Copy n bytes from address a to buf, and from buf to address a. The
+  addresses must be below VMEM_SIZE.
+*/
+void vmem_read(VMem V, uocta a, void *buf, size_t n);
+void vmem_write(VMem V, uocta a, const void *buf, size_t n);
+
+/*
+  Return nonzero if A and B hold the same bytes.
+*/
+int vmem_equal(VMem A, VMem B);
+
+/*
+  Make the contents of to those of from.
+*/
+void vmem_copy(VMem to, VMem from);
+
+/*
+  Return the number of pages allocated.
+*/
+uocta vmem_pages(VMem V);
+
+#endif
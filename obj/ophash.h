@@ -0,0 +1,528 @@
+/*
+  ophash.h
+
+  Generated by mkophash. Do not edit.
+*/
+
+#define OPHASH_BITS 8
+#define OPHASH_MULT 0x8b8e6cb9d7a25c5fULL
+
+// Packed name of the operator in each slot, or zero.
+static const uocta ophash_keys[256] = {
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000425453ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000045564153ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000055504d43ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x000000000047454eULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000004152544554ULL,
+  0x000000004c4c4143ULL,
+  0x0000000000000000ULL,
+  0x0000000000444441ULL,
+  0x0000000000000000ULL,
+  0x0000000000504d4aULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000564944ULL,
+  0x000000000057444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00000000554f5453ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00000000554c554dULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000055425553ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x000000000042444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000054534552ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000504d43ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000055545453ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000005a4aULL,
+  0x0000000000000000ULL,
+  0x0000000048535550ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000504f4eULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000057544553ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00000000554f444cULL,
+  0x0000000000000000ULL,
+  0x0000000000004c53ULL,
+  0x00000000004f5453ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00000000004c554dULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00000000524f584eULL,
+  0x0000000000000000ULL,
+  0x0000000000425553ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000554c53ULL,
+  0x0000000055575453ULL,
+  0x0000000000000000ULL,
+  0x000000005554444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000545453ULL,
+  0x0000000000004f47ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x000000000000524fULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000444e41ULL,
+  0x0000000000504e4aULL,
+  0x0000000055425453ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000004e4aULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000524f58ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000544552ULL,
+  0x000000005547454eULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000525453ULL,
+  0x0000000000000000ULL,
+  0x00000000004f444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x000000000000504aULL,
+  0x0000000055444441ULL,
+  0x0000000000000000ULL,
+  0x00000000004e4e4aULL,
+  0x0000000000544e49ULL,
+  0x0000000000005253ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x00004e5245545845ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000055564944ULL,
+  0x000000005557444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000575453ULL,
+  0x0000000000000000ULL,
+  0x000000000054444cULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000041544547ULL,
+  0x00000000005a4e4aULL,
+  0x0000000000000000ULL,
+  0x0000000000555253ULL,
+  0x0000000000005349ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x0000000000000000ULL,
+  0x000000005542444cULL,
+};
+
+// Index in the operator table of the operator in each slot.
+static const unsigned char ophash_index[256] = {
+  0,
+  0,
+  44,
+  0,
+  0,
+  0,
+  38,
+  0,
+  0,
+  0,
+  0,
+  5,
+  0,
+  0,
+  0,
+  0,
+  30,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  55,
+  3,
+  0,
+  0,
+  0,
+  13,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  6,
+  26,
+  0,
+  0,
+  0,
+  0,
+  0,
+  47,
+  0,
+  0,
+  29,
+  0,
+  0,
+  0,
+  0,
+  0,
+  54,
+  0,
+  0,
+  0,
+  0,
+  0,
+  20,
+  0,
+  0,
+  0,
+  0,
+  0,
+  36,
+  0,
+  0,
+  0,
+  0,
+  0,
+  4,
+  0,
+  0,
+  0,
+  0,
+  50,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  19,
+  0,
+  35,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  32,
+  0,
+  0,
+  0,
+  39,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  23,
+  0,
+  40,
+  46,
+  0,
+  0,
+  28,
+  0,
+  0,
+  0,
+  33,
+  0,
+  53,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  41,
+  52,
+  0,
+  25,
+  0,
+  0,
+  49,
+  10,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  34,
+  0,
+  0,
+  0,
+  0,
+  0,
+  2,
+  16,
+  45,
+  0,
+  0,
+  0,
+  0,
+  14,
+  0,
+  0,
+  0,
+  56,
+  0,
+  0,
+  37,
+  31,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  48,
+  0,
+  22,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  18,
+  1,
+  0,
+  15,
+  11,
+  42,
+  0,
+  0,
+  8,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  7,
+  27,
+  0,
+  0,
+  0,
+  51,
+  0,
+  24,
+  0,
+  0,
+  0,
+  9,
+  17,
+  0,
+  43,
+  12,
+  0,
+  0,
+  0,
+  0,
+  0,
+  0,
+  21,
+};
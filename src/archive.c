@@ -0,0 +1,344 @@
+/*
+  archive.c
+*/
+
+#define _DEFAULT_SOURCE
+
+#include "archive.h"
+#include "error.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define le32(x) __builtin_bswap32(x)
+#else
+#define le32(x) (x)
+#endif
+
+
+static uint32_t align(size_t offset)
+{
+  return (offset + OBJ_ALIGN - 1) & ~(size_t) (OBJ_ALIGN - 1);
+}
+
+
+// A symbol to index.
+typedef struct {
+  const char *name;
+  uint32_t member;
+} Export;
+
+static int compare_exports(const void *a, const void *b)
+{
+  const Export *x = a, *y = b;
+  int c = strcmp(x->name, y->name);
+
+  return c ? c : (x->member > y->member) - (x->member < y->member);
+}
+
+
+static const char *base_name(const char *path)
+{
+  const char *slash = strrchr(path, '/');
+
+  return slash ? slash + 1 : path;
+}
+
+
+// Read the first size bytes of the named file into buf.
+static int read_file(const char *name, void *buf, size_t size)
+{
+  FILE *file = fopen(name, "rb");
+
+  if (!file || fread(buf, 1, size, file) != size) {
+    set_error_msg("cannot read '%s':", name);
+    if (file)
+      fclose(file);
+    return 0;
+  }
+  fclose(file);
+
+  return 1;
+}
+
+
+int arc_write(const char *name, char *const *members, int n)
+{
+  Object **objs = emalloc((n + 1) * sizeof(Object *));
+  size_t nexports = 0;
+  int ok = 0;
+
+  for (int i = 0; i < n; i++) {
+    objs[i] = obj_open(members[i]);
+    if (!objs[i]) {
+      while (i--)
+        obj_close(objs[i]);
+      free(objs);
+      return 0;
+    }
+    nexports += objs[i]->header->nsymbols;
+  }
+
+  // Exported symbols, sorted by name, the first member of each
+  Export *exports = emalloc((nexports + 1) * sizeof(Export));
+  size_t k = 0;
+
+  for (int i = 0; i < n; i++)
+    for (uint32_t j = 0; j < objs[i]->header->nsymbols; j++) {
+      const ObjSymbol *s = &objs[i]->symbols[j];
+
+      if ((s->flags & (OBJ_DEFINED | OBJ_EXPORTED))
+          == (OBJ_DEFINED | OBJ_EXPORTED)) {
+        exports[k].name = obj_string(objs[i], s->name);
+        exports[k++].member = i;
+      }
+    }
+  qsort(exports, k, sizeof(Export), compare_exports);
+  nexports = 0;
+  for (size_t j = 0; j < k; j++)
+    if (!nexports || strcmp(exports[j].name, exports[nexports - 1].name))
+      exports[nexports++] = exports[j];
+
+  ArcHeader h;
+  size_t nstrings = 0;
+
+  for (int i = 0; i < n; i++)
+    nstrings += strlen(base_name(members[i])) + 1;
+  for (size_t j = 0; j < nexports; j++)
+    nstrings += strlen(exports[j].name) + 1;
+
+  memset(&h, 0, sizeof(h));
+  h.magic = ARC_MAGIC;
+  h.version = ARC_VERSION;
+  h.members = align(sizeof(ArcHeader));
+  h.nmembers = n;
+  h.index = align(h.members + (size_t) n * sizeof(ArcMember));
+  h.nindex = nexports;
+  h.strings = align(h.index + nexports * sizeof(ArcSymbol));
+  h.nstrings = nstrings;
+
+  size_t size = align(h.strings + nstrings);
+  for (int i = 0; i < n; i++)
+    size = align(size + objs[i]->header->size);
+  h.size = size;
+
+  char *image = calloc(size, 1);
+  if (!image)
+    die("Failed to allocate archive image.");
+
+  ArcMember *m = (ArcMember *) (image + h.members);
+  ArcSymbol *index = (ArcSymbol *) (image + h.index);
+  char *strings = image + h.strings;
+  size_t pos = 0, offset = align(h.strings + nstrings);
+
+  for (int i = 0; i < n; i++) {
+    const char *base = base_name(members[i]);
+    uint32_t msize = objs[i]->header->size;
+
+    m[i].name = le32((uint32_t) pos);
+    m[i].offset = le32((uint32_t) offset);
+    m[i].size = le32(msize);
+    strcpy(strings + pos, base);
+    pos += strlen(base) + 1;
+
+    // The file as it is, not the object converted to the host order
+    if (!read_file(members[i], image + offset, msize))
+      goto done;
+    offset = align(offset + msize);
+  }
+
+  for (size_t j = 0; j < nexports; j++) {
+    index[j].name = le32((uint32_t) pos);
+    index[j].hash = le32(obj_hash(exports[j].name));
+    index[j].member = le32(exports[j].member);
+    strcpy(strings + pos, exports[j].name);
+    pos += strlen(exports[j].name) + 1;
+  }
+
+  uint32_t *words = (uint32_t *) &h;
+  for (size_t i = 0; i < sizeof(h) / sizeof(uint32_t); i++)
+    words[i] = le32(words[i]);
+  memcpy(image, &h, sizeof(h));
+
+  // Replaced whole, as object files are
+  ok = obj_save(image, size, name);
+
+done:
+  free(image);
+  free(exports);
+  for (int i = 0; i < n; i++)
+    obj_close(objs[i]);
+  free(objs);
+
+  return ok;
+}
+
+
+// Is the section at offset with n records of the given size within an
+// image of size bytes?
+static int section_ok(uint32_t offset, uint32_t n, size_t recsize,
+                      uint32_t size)
+{
+  return offset % OBJ_ALIGN == 0 && offset <= size
+         && n <= (size - offset) / recsize;
+}
+
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+// Convert the records of a mapped archive and its members to the host
+// order.
+static void swap_archive(void *map, size_t size)
+{
+  uint32_t *w = map;
+  size_t n = size / sizeof(uint32_t);
+
+  if (size < sizeof(ArcHeader))
+    return;
+  if (le32(((ArcHeader *) map)->strings) / sizeof(uint32_t) < n)
+    n = le32(((ArcHeader *) map)->strings) / sizeof(uint32_t);
+  for (size_t i = 0; i < n; i++)
+    w[i] = le32(w[i]);
+
+  const ArcHeader *h = map;
+
+  if (section_ok(h->members, h->nmembers, sizeof(ArcMember), size))
+    for (uint32_t k = 0; k < h->nmembers; k++) {
+      const ArcMember *m = (ArcMember *) ((char *) map + h->members) + k;
+
+      if (m->offset % OBJ_ALIGN == 0 && m->offset <= size
+          && m->size <= size - m->offset)
+        obj_swap((char *) map + m->offset, m->size);
+    }
+}
+#endif
+
+
+Archive *arc_open(const char *name)
+{
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st)) {
+    set_error_msg("cannot open '%s':", name);
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+
+  size_t size = st.st_size;
+  int prot = PROT_READ;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  prot |= PROT_WRITE;
+#endif
+
+  void *map = size ? mmap(0, size, prot, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+
+  close(fd);
+  if (map == MAP_FAILED) {
+    set_error_msg(size ? "cannot map '%s':" : "'%s': not an archive", name);
+    return 0;
+  }
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  swap_archive(map, size);
+#endif
+
+  const ArcHeader *h = map;
+  const char *problem = 0;
+
+  if (size < sizeof(ArcHeader) || h->magic != ARC_MAGIC)
+    problem = "not an archive";
+  else if (h->version != ARC_VERSION)
+    problem = "unknown archive version";
+  else if (h->size > size
+           || !section_ok(h->members, h->nmembers, sizeof(ArcMember), h->size)
+           || !section_ok(h->index, h->nindex, sizeof(ArcSymbol), h->size)
+           || !section_ok(h->strings, h->nstrings, 1, h->size)
+           || !h->nstrings || ((char *) map)[h->strings + h->nstrings - 1])
+    problem = "truncated or corrupt archive";
+
+  Archive *A = emalloc(sizeof(Archive));
+
+  A->header = h;
+  A->members = (const ArcMember *) ((char *) map + h->members);
+  A->index = (const ArcSymbol *) ((char *) map + h->index);
+  A->strings = (const char *) map + h->strings;
+  A->map = map;
+  A->maplen = size;
+
+  // Names within the strings, members within the file
+  for (uint32_t k = 0; !problem && k < h->nmembers; k++) {
+    const ArcMember *m = &A->members[k];
+
+    if (m->name >= h->nstrings || m->offset % OBJ_ALIGN
+        || m->offset > h->size || m->size > h->size - m->offset)
+      problem = "truncated or corrupt archive";
+  }
+  for (uint32_t k = 0; !problem && k < h->nindex; k++)
+    if (A->index[k].name >= h->nstrings
+        || A->index[k].member >= h->nmembers)
+      problem = "truncated or corrupt archive";
+
+  if (problem) {
+    set_error_msg("'%s': %s", name, problem);
+    arc_close(A);
+    return 0;
+  }
+
+  return A;
+}
+
+
+void arc_close(Archive *A)
+{
+  munmap(A->map, A->maplen);
+  free(A);
+}
+
+
+const char *arc_string(const Archive *A, uint32_t offset)
+{
+  return A->strings + offset;
+}
+
+
+int arc_lookup(const Archive *A, const char *symbol)
+{
+  uint32_t a = 0, b = A->header->nindex;
+
+  while (a < b) {
+    uint32_t mid = a + (b - a) / 2;
+    int c = strcmp(A->strings + A->index[mid].name, symbol);
+
+    if (!c)
+      return A->index[mid].member;
+    if (c < 0)
+      a = mid + 1;
+    else
+      b = mid;
+  }
+
+  return -1;
+}
+
+
+Object *arc_member(const Archive *A, int k)
+{
+  const ArcMember *m = &A->members[k];
+  Object *O = obj_view((const char *) A->map + m->offset, m->size);
+
+  if (!O) {
+    char msg[1024];
+
+    snprintf(msg, sizeof(msg), "%s", get_error_msg());
+    set_error_msg("member '%s': %s", arc_string(A, m->name), msg);
+  }
+
+  return O;
+}
@@ -0,0 +1,147 @@
+/*
+  arena.c
+*/
+
+#include "arena.h"
+#include "error.h"
+#include <stddef.h>
+#include <string.h>
+
+// Default block size.
+#define ARENA_DEFAULT_BLOCK 16384
+
+// Every allocation is rounded up to a multiple of this.
+#define ARENA_ALIGN 16
+
+// A block of memory. The usable space follows the header.
+typedef struct block_s {
+  struct block_s *next;
+
+  // Size of usable space.
+  size_t size;
+} Block;
+
+// Size of the block header, rounded so that data stays aligned.
+#define BLOCK_HEADER \
+  ((sizeof(Block) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+struct arena_s {
+  // Blocks are kept in a linked list, most recent first.
+  Block *head;
+
+  // Free region of the current block.
+  char *cur, *end;
+
+  size_t block_size;
+  size_t nblocks, nbytes;
+};
+
+
+Arena arena_create(size_t block_size)
+{
+  Arena A = emalloc(sizeof(struct arena_s));
+
+  A->head = 0;
+  A->cur = A->end = 0;
+  A->block_size = block_size ? block_size : ARENA_DEFAULT_BLOCK;
+  A->nblocks = A->nbytes = 0;
+
+  return A;
+}
+
+
+void arena_destroy(Arena A)
+{
+  Block *b = A->head;
+
+  while (b) {
+    Block *next = b->next;
+    free(b);
+    b = next;
+  }
+
+  free(A);
+}
+
+
+// Add a new block with at least size usable bytes.
+static Block *arena_grow(Arena A, size_t size)
+{
+  Block *b = emalloc(BLOCK_HEADER + size);
+
+  b->size = size;
+  A->nblocks++;
+  A->nbytes += BLOCK_HEADER + size;
+
+  return b;
+}
+
+
+void *arena_alloc(Arena A, size_t size)
+{
+  size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+  if (size > A->block_size) {
+    // Oversized request: a private block, linked behind the current
+    // one so the free region of the current block is not lost.
+    Block *b = arena_grow(A, size);
+
+    if (A->head) {
+      b->next = A->head->next;
+      A->head->next = b;
+    }
+    else {
+      b->next = 0;
+      A->head = b;
+    }
+
+    return (char *) b + BLOCK_HEADER;
+  }
+
+  if ((size_t) (A->end - A->cur) < size) {
+    Block *b = arena_grow(A, A->block_size);
+
+    b->next = A->head;
+    A->head = b;
+    A->cur = (char *) b + BLOCK_HEADER;
+    A->end = A->cur + b->size;
+  }
+
+  void *ret = A->cur;
+  A->cur += size;
+
+  return ret;
+}
+
+
+void *arena_calloc(Arena A, size_t size)
+{
+  void *ret = arena_alloc(A, size);
+
+  memset(ret, 0, size);
+
+  return ret;
+}
+
+
+char *arena_strdup(Arena A, const char *s)
+{
+  size_t len = strlen(s) + 1;
+  char *ret = arena_alloc(A, len);
+
+  memcpy(ret, s, len);
+
+  return ret;
+}
+
+
+size_t arena_blocks(Arena A)
+{
+  return A->nblocks;
+}
+
+
+size_t arena_bytes(Arena A)
+{
+  return A->nbytes;
+}
@@ -51,6 +51,27 @@ Operand *operand_create_string(const char *str)
 }
 
 
+Operand *operand_create_label_n(const char *label, int len)
+{
+  Operand *ret = emalloc(sizeof(Operand));
+
+  ret->type = LABEL;
+  ret->value.label = estrndup(label, len);
+
+  return ret;
+}
+
+Operand *operand_create_string_n(const char *str, int len)
+{
+  Operand *ret = emalloc(sizeof(Operand));
+
+  ret->type = STRING;
+  ret->value.str = estrndup(str, len);
+
+  return ret;
+}
+
+
 Operand *operand_dup(const Operand *opd)
 {
   Operand *ret = emalloc(sizeof(Operand));
@@ -0,0 +1,220 @@
+/*
+  assembler.c
+*/
+
+#include "assembler.h"
+#include "encoder.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+Assembler *asm_create()
+{
+  Assembler *A = emalloc(sizeof(Assembler));
+
+  A->n = 0;
+  A->max = 1024;
+  A->code = emalloc(A->max * sizeof(utetra));
+  A->symbols = stable_create_kind(STABLE_HASH);
+  A->arena = arena_create(0);
+  A->waited = 0;
+  A->relocs = 0;
+  A->nrelocs = 0;
+  A->maxlines = 1024;
+  A->nlines = 0;
+  A->lines = emalloc(A->maxlines * sizeof(LineMark));
+
+  return A;
+}
+
+
+void asm_destroy(Assembler *A)
+{
+  free(A->code);
+  stable_destroy(A->symbols);
+  arena_destroy(A->arena);
+  free(A->relocs);
+  free(A->lines);
+  free(A);
+}
+
+
+// Return the symbol of label, creating it if needed.
+static Symbol *get_symbol(Assembler *A, const char *label)
+{
+  InsertionResult res = stable_insert(A->symbols, label);
+
+  if (res.new) {
+    Symbol *sym = arena_alloc(A->arena, sizeof(Symbol));
+
+    sym->addr = -1;
+    sym->exported = 0;
+    sym->fixups = 0;
+    sym->name = 0;
+    sym->next = 0;
+    res.data->p = sym;
+  }
+
+  return res.data->p;
+}
+
+
+Symbol *asm_symbol(Assembler *A, const char *label)
+{
+  EntryData *data = stable_find(A->symbols, label);
+
+  return data ? data->p : 0;
+}
+
+
+// What the encoder is resolving labels for.
+typedef struct {
+  Assembler *A;
+  int lineno;
+} Resolution;
+
+// Labels already defined are resolved; others get a fixup.
+static int find_or_wait(void *ctx, const char *label, int site, int *addr)
+{
+  Resolution *r = ctx;
+  Symbol *sym = get_symbol(r->A, label);
+
+  if (sym->addr >= 0) {
+    *addr = sym->addr;
+    return 1;
+  }
+
+  if (!sym->name) {
+    sym->name = arena_strdup(r->A->arena, label);
+    sym->next = r->A->waited;
+    r->A->waited = sym;
+  }
+
+  Fixup *f = arena_alloc(r->A->arena, sizeof(Fixup));
+
+  f->site = site;
+  f->lineno = r->lineno;
+  f->next = sym->fixups;
+  sym->fixups = f;
+
+  return -1;
+}
+
+
+// Define label at the current address and patch its fixup chain.
+static int define(Assembler *A, const char *label)
+{
+  Symbol *sym = get_symbol(A, label);
+
+  if (sym->addr >= 0) {
+    set_error_msg("label '%s' defined twice", label);
+    return 0;
+  }
+
+  sym->addr = A->n;
+  for (Fixup *f = sym->fixups; f; f = f->next)
+    if (!encode_patch(&A->code[f->site], sym->addr - f->site)) {
+      set_error_msg("line %d: jump to '%s' too far", f->lineno, label);
+      return 0;
+    }
+  sym->fixups = 0;
+
+  return 1;
+}
+
+
+int asm_instr(Assembler *A, const Instruction *instr)
+{
+  const Operator *op = instr->op;
+
+  // IS lines define aliases, which the parser has substituted
+  if (op && op->opcode == IS)
+    return 1;
+
+  if (instr->label && !define(A, instr->label))
+    return 0;
+
+  if (op && op->opcode == EXTERN) {
+    if (instr->opds[0] && instr->opds[0]->type == LABEL)
+      get_symbol(A, instr->opds[0]->value.label)->exported = 1;
+    return 1;
+  }
+
+  int size = encode_size(instr);
+
+  if (A->n + size > A->max) {
+    while (A->n + size > A->max)
+      A->max *= 2;
+    A->code = realloc(A->code, A->max * sizeof(utetra));
+    if (!A->code)
+      die("Failed to grow code buffer.");
+  }
+
+  Resolution res = { A, instr->lineno };
+  LabelResolver r = { find_or_wait, &res };
+  int n = encode_resolve(instr, A->n, &r, A->code + A->n);
+
+  if (n < 0)
+    return 0;
+
+  if (n > 0) {
+    if (A->nlines == A->maxlines) {
+      A->maxlines *= 2;
+      A->lines = realloc(A->lines, A->maxlines * sizeof(LineMark));
+      if (!A->lines)
+        die("Failed to grow line table.");
+    }
+    A->lines[A->nlines].addr = A->n;
+    A->lines[A->nlines++].lineno = instr->lineno;
+  }
+
+  A->n += n;
+  return 1;
+}
+
+
+int asm_list(Assembler *A, const Instruction *head,
+             const Instruction **errinstr)
+{
+  for (; head; head = head->next)
+    if (!asm_instr(A, head)) {
+      if (errinstr)
+        *errinstr = head;
+      return 0;
+    }
+
+  return 1;
+}
+
+
+static int compare_relocs(const void *a, const void *b)
+{
+  const Reloc *r = a, *s = b;
+
+  return (r->site > s->site) - (r->site < s->site);
+}
+
+
+int asm_finish(Assembler *A)
+{
+  int max = 0;
+
+  A->nrelocs = 0;
+  for (Symbol *sym = A->waited; sym; sym = sym->next) {
+    for (Fixup *f = sym->fixups; f; f = f->next) {
+      if (A->nrelocs == max) {
+        max = max ? 2 * max : 64;
+        A->relocs = realloc(A->relocs, max * sizeof(Reloc));
+        if (!A->relocs)
+          die("Failed to grow relocation table.");
+      }
+      A->relocs[A->nrelocs].site = f->site;
+      A->relocs[A->nrelocs++].name = sym->name;
+    }
+  }
+
+  qsort(A->relocs, A->nrelocs, sizeof(Reloc), compare_relocs);
+
+  return A->nrelocs;
+}
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
+#include <string.h>
 
 Buffer *buffer_create()
 {
@@ -11,53 +12,85 @@ Buffer *buffer_create()
     B->n = 50;
     B->data = emalloc(B->n * sizeof(char));
     B->i = 0;
+    B->input = NULL;
+    B->source = NULL;
+    B->readahead = 0;
     return B;
 } 
 
 void buffer_destroy(Buffer *B)
 {
     free(B->data);
+    if (B->source)
+        lsource_close(B->source);
     free(B);
 }
 
 void buffer_reset(Buffer *B)
 {
-	for (; B->i > 0; (B->i)--)
-		B->data[B->i] = 0;
+    B->i = 0;
+}
+
+// Make room for at least n characters in the buffer
+static void buffer_reserve(Buffer *B, int n)
+{
+    if (n <= B->n)
+        return;
+
+    while (B->n < n)
+        B->n *= 2;
+
+    char *data = realloc(B->data, B->n * sizeof(char));
+    if (data == NULL)
+        die("Out of memory: failed to reallocate Buffer\n");
+    B->data = data;
 }
 
 void buffer_push_back(Buffer *B, char c)
 {
     //If Buffer is full
     if (B->i == B->n)
-    {
-        B->n *= 2;
-        B->data = realloc(B->data, B->n * sizeof(char));
-        if (B->data == NULL)
-        {
-            free(B->data);
-            free(B);
-            die("Out of memory: failed to reallocate Bufferi\n");
-        }
-    }
+        buffer_reserve(B, B->i + 1);
 
-	B->data[B->i] = c;
+    B->data[B->i] = c;
     B->i++;
-    
+}
+
+void buffer_append(Buffer *B, const char *ptr, int len)
+{
+    buffer_reserve(B, B->i + len);
+    memcpy(B->data + B->i, ptr, len);
+    B->i += len;
+}
+
+void buffer_readahead(Buffer *B, int nblocks)
+{
+    B->readahead = nblocks;
 }
 
 int read_line(FILE *input, Buffer *B)
 {
-    int c = 0, cnum = 0;
     buffer_reset(B);
-    while(c != 10 && c != EOF)
+
+    // Data read ahead from another file is dropped
+    if (B->input != input)
     {
-        c = fgetc(input);
-        if (c != EOF)
-        {
-            buffer_push_back(B, (char)c);
-            cnum++;
-        }
+        if (B->source)
+            lsource_close(B->source);
+        B->input = input;
+        B->source = lsource_file(input);
+        if (B->readahead)
+            lsource_readahead(B->source, B->readahead);
     }
-    return cnum;
+
+    int len;
+    const char *line = lsource_line(B->source, &len);
+    if (line)
+        buffer_append(B, line, len);
+
+    // Terminate the line, without counting the terminator
+    buffer_reserve(B, B->i + 1);
+    B->data[B->i] = 0;
+
+    return B->i;
 }
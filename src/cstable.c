@@ -0,0 +1,175 @@
+/*
+  cstable.c
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "cstable.h"
+#include "htable.h"
+#include "error.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Number of stripes; a power of two. The top bits of a key's hash
+// choose its stripe, the low bits its slot inside the stripe.
+#define STRIPE_BITS 6
+#define NSTRIPES (1 << STRIPE_BITS)
+
+// A stripe. Padded so that locks of different stripes do not share a
+// cache line.
+typedef struct {
+  pthread_rwlock_t lock;
+  HashTable table;
+  char pad[64];
+} Stripe;
+
+struct cstable_s {
+  Stripe stripes[NSTRIPES];
+};
+
+
+ConcurrentTable cstable_create()
+{
+  ConcurrentTable C = emalloc(sizeof(struct cstable_s));
+
+  for (int i = 0; i < NSTRIPES; i++) {
+    if (pthread_rwlock_init(&C->stripes[i].lock, 0))
+      die("Failed to initialize symbol table lock.");
+    C->stripes[i].table = htable_create();
+  }
+
+  return C;
+}
+
+
+void cstable_destroy(ConcurrentTable C)
+{
+  for (int i = 0; i < NSTRIPES; i++) {
+    pthread_rwlock_destroy(&C->stripes[i].lock);
+    htable_destroy(C->stripes[i].table);
+  }
+
+  free(C);
+}
+
+
+static Stripe *stripe_of(ConcurrentTable C, unsigned int hash)
+{
+  return &C->stripes[hash >> (32 - STRIPE_BITS)];
+}
+
+
+InsertionResult cstable_insert(ConcurrentTable C, const char *key)
+{
+  size_t len = strlen(key);
+  unsigned int hash = htable_hash(key, len);
+  Stripe *s = stripe_of(C, hash);
+
+  // Most insertions of labels and aliases hit existing keys, which
+  // only need the shared lock.
+  pthread_rwlock_rdlock(&s->lock);
+  EntryData *data = htable_find_hashed(s->table, key, len, hash);
+  pthread_rwlock_unlock(&s->lock);
+
+  if (data) {
+    InsertionResult result = { 0, data };
+    return result;
+  }
+
+  // Look again under the exclusive lock: another thread may have
+  // inserted the key in between, and then it got new != 0.
+  pthread_rwlock_wrlock(&s->lock);
+  InsertionResult result = htable_insert_hashed(s->table, key, len, hash);
+  pthread_rwlock_unlock(&s->lock);
+
+  return result;
+}
+
+
+EntryData *cstable_find(ConcurrentTable C, const char *key)
+{
+  size_t len = strlen(key);
+  unsigned int hash = htable_hash(key, len);
+  Stripe *s = stripe_of(C, hash);
+
+  pthread_rwlock_rdlock(&s->lock);
+  EntryData *data = htable_find_hashed(s->table, key, len, hash);
+  pthread_rwlock_unlock(&s->lock);
+
+  return data;
+}
+
+
+static int compar(const void *a, const void *b)
+{
+  return strcmp(((const CstableEntry *) a)->key,
+                ((const CstableEntry *) b)->key);
+}
+
+
+size_t cstable_snapshot(ConcurrentTable C, CstableEntry **entries)
+{
+  size_t n = 0, max = 64;
+  CstableEntry *ret = emalloc(max * sizeof(CstableEntry));
+  const char **keys = 0;
+  EntryData **data = 0;
+  size_t maxstripe = 0;
+
+  for (int i = 0; i < NSTRIPES; i++) {
+    Stripe *s = &C->stripes[i];
+
+    pthread_rwlock_rdlock(&s->lock);
+
+    size_t k = htable_size(s->table);
+    if (k > maxstripe) {
+      maxstripe = k;
+      free(keys);
+      free(data);
+      keys = emalloc(k * sizeof(char *));
+      data = emalloc(k * sizeof(EntryData *));
+    }
+    if (k) htable_collect(s->table, keys, data);
+
+    pthread_rwlock_unlock(&s->lock);
+
+    // Keys and data pointers stay valid without the lock.
+    if (n + k > max) {
+      while (n + k > max) max *= 2;
+      ret = realloc(ret, max * sizeof(CstableEntry));
+      if (!ret) die("Failed to reallocate symbol table snapshot.");
+    }
+    for (size_t j = 0; j < k; j++) {
+      ret[n].key = keys[j];
+      ret[n++].data = data[j];
+    }
+  }
+
+  free(keys);
+  free(data);
+
+  qsort(ret, n, sizeof(CstableEntry), compar);
+  *entries = ret;
+
+  return n;
+}
+
+
+void cstable_stats(ConcurrentTable C, StableStats *stats)
+{
+  stats->entries = stats->nodes = 0;
+  stats->bytes = sizeof(struct cstable_s);
+
+  for (int i = 0; i < NSTRIPES; i++) {
+    StableStats st;
+    Stripe *s = &C->stripes[i];
+
+    pthread_rwlock_rdlock(&s->lock);
+    htable_stats(s->table, &st);
+    pthread_rwlock_unlock(&s->lock);
+
+    stats->entries += st.entries;
+    stats->nodes += st.nodes;
+    stats->bytes += st.bytes;
+  }
+}
@@ -0,0 +1,612 @@
+/*
+  encoder.c
+*/
+
+#include "encoder.h"
+#include "error.h"
+#include "opcodes.h"
+#include <string.h>
+
+// Ways of encoding an operator.
+enum {
+  FORM_NONE,   // No code: IS, EXTERN
+  FORM_XYZ,    // X, Y and Z fields; Z may be immediate
+  FORM_RRR,    // Three registers: SAVE, REST
+  FORM_JUMP2,  // Register and two-byte relative address
+  FORM_JUMP3,  // Three-byte relative address: JMP
+  FORM_WYDE,   // Register and two-byte number: SETW
+  FORM_INT,    // Three-byte number: INT
+  FORM_NOP,
+  FORM_TETRA,
+  FORM_STR,
+  FORM_CALL,
+  FORM_RET,
+  FORM_PUSH
+};
+
+// Form of an operator, from its opcode and operand types.
+#define FORM_OF(opc, t1, t2, t3)                \
+  ((opc) == IS || (opc) == EXTERN ? FORM_NONE   \
+   : (opc) == TETRA ? FORM_TETRA                \
+   : (opc) == STR ? FORM_STR                    \
+   : (opc) == CALL ? FORM_CALL                  \
+   : (opc) == RET ? FORM_RET                    \
+   : (opc) == PUSH ? FORM_PUSH                  \
+   : (t3) == IMMEDIATE ? FORM_XYZ               \
+   : (t3) == REGISTER ? FORM_RRR                \
+   : (t2) == ADDR2 ? FORM_JUMP2                 \
+   : (t1) == ADDR3 ? FORM_JUMP3                 \
+   : (t2) == BYTE2 ? FORM_WYDE                  \
+   : (t1) == BYTE3 ? FORM_INT                   \
+   : FORM_NOP)
+
+// Pseudo-opcodes are negative; forms are indexed by opcode + PSEUDO.
+#define PSEUDO 8
+
+// Form of each operator, indexed by opcode.
+static const unsigned char forms[PSEUDO + 256] = {
+#define OPERATOR(n, opc, t1, t2, t3) \
+  [(opc) + PSEUDO] = FORM_OF(opc, t1, t2, t3),
+#include "operators.def"
+#undef OPERATOR
+};
+
+// Size in words of the code of each form, but STR.
+static const unsigned char sizes[] = {
+  [FORM_NONE] = 0, [FORM_XYZ] = 1, [FORM_RRR] = 1, [FORM_JUMP2] = 1,
+  [FORM_JUMP3] = 1, [FORM_WYDE] = 1, [FORM_INT] = 1, [FORM_NOP] = 1,
+  [FORM_TETRA] = 1, [FORM_STR] = 0, [FORM_CALL] = 4, [FORM_RET] = 3,
+  [FORM_PUSH] = 2
+};
+
+
+// Sizes of the far address sequence, and of a far jump (the sequence
+// and a GO).
+#define FAR_ADDR 9
+#define FAR_JUMP 10
+
+// Opposite of each conditional jump, for near and far versions.
+static const unsigned char opposite[256] = {
+  [JZ] = JNZ, [JNZ] = JZ, [JP] = JNP, [JNP] = JP, [JN] = JNN, [JNN] = JN
+};
+
+
+static inline utetra word(int opc, unsigned x, unsigned y, unsigned z)
+{
+  return (utetra) opc << 24 | x << 16 | y << 8 | z;
+}
+
+
+// Characters of a string operand, without its quotes.
+static const char *str_body(const Operand *opd, int *len)
+{
+  const char *s = opd->value.str;
+  int n = strlen(s);
+
+  if (n && s[0] == '"') {
+    s++;
+    n--;
+    if (n && s[n - 1] == '"')
+      n--;
+  }
+
+  *len = n;
+  return s;
+}
+
+
+int encode_size(const Instruction *instr)
+{
+  if (!instr->op)
+    return 0;
+
+  int form = forms[instr->op->opcode + PSEUDO];
+
+  if (form == FORM_STR) {
+    int len;
+
+    if (!instr->opds[0] || instr->opds[0]->type != STRING)
+      return 0;
+    str_body(instr->opds[0], &len);
+    return (len + 4) / 4;  // With the final NUL
+  }
+
+  return sizes[form];
+}
+
+
+int encode_size_reach(const Instruction *instr, int reach)
+{
+  if (reach == REACH_SHORT || !instr->op)
+    return encode_size(instr);
+
+  int opc = instr->op->opcode;
+
+  switch (forms[opc + PSEUDO]) {
+  case FORM_JUMP2:
+    if (opc == GETA)
+      return FAR_ADDR;
+    return reach == REACH_NEAR ? 2 : 1 + FAR_JUMP;
+  case FORM_JUMP3:
+    return FAR_JUMP;
+  case FORM_CALL:
+    return 3 + FAR_JUMP;
+  }
+
+  return encode_size(instr);
+}
+
+
+// Range of the version of the given reach of an operator: the jump
+// in it is *offset words into the code, and its displacement has
+// *bits bits. Returns zero if there is no such version.
+static int reach_range(int opc, int reach, int *offset, int *bits)
+{
+  int form = forms[opc + PSEUDO];
+
+  if (reach == REACH_FAR) {
+    *bits = 31;
+    if (form == FORM_JUMP2 && opc != GO)
+      *offset = opc == GETA ? 0 : 1;
+    else if (form == FORM_JUMP3 || form == FORM_CALL)
+      *offset = form == FORM_CALL ? 3 : 0;
+    else
+      return 0;
+    return 1;
+  }
+
+  switch (form) {
+  case FORM_JUMP2:
+    if (reach == REACH_SHORT) {
+      *offset = 0;
+      *bits = 16;
+      return 1;
+    }
+    *offset = 1;
+    *bits = 24;
+    return opc != GO && opc != GETA;
+  case FORM_JUMP3:
+  case FORM_CALL:
+    *offset = form == FORM_CALL ? 3 : 0;
+    *bits = 24;
+    return reach == REACH_SHORT;
+  }
+
+  return 0;
+}
+
+
+// How far from the limit of its range is displacement d, or -1 if
+// beyond it.
+static octa room(octa d, int bits)
+{
+  octa max = ((octa) 1 << bits) - 1;
+
+  return (d < 0 ? -d : d) <= max ? max - (d < 0 ? -d : d) : -1;
+}
+
+
+int encode_reach(const Instruction *instr, int pc, int target)
+{
+  int offset, bits;
+
+  if (!instr->op || !reach_range(instr->op->opcode, REACH_SHORT, &offset,
+                                 &bits))
+    return REACH_SHORT;
+
+  for (int reach = REACH_SHORT; reach <= REACH_FAR; reach++)
+    if (reach_range(instr->op->opcode, reach, &offset, &bits)
+        && room((octa) target - pc - offset, bits) >= 0)
+      return reach;
+
+  return -1;
+}
+
+
+int encode_slack(const Instruction *instr, int pc, int target, int reach)
+{
+  int offset, bits;
+
+  if (!instr->op || !reach_range(instr->op->opcode, reach, &offset, &bits))
+    return 0x7fffffff;
+
+  octa r = room((octa) target - pc - offset, bits);
+
+  return r > 0x7fffffff ? 0x7fffffff : r;
+}
+
+
+// Check the operands of instr against the types of its operator.
+static int check_operands(const Instruction *instr)
+{
+  const Operator *op = instr->op;
+
+  for (int k = 0; k < 3; k++) {
+    const Operand *opd = instr->opds[k];
+
+    if (!opd) {
+      if (op->opd_types[k] != OP_NONE) {
+        set_error_msg("%s: missing operand %d", op->name, k + 1);
+        return 0;
+      }
+    }
+    else if (!(opd->type & op->opd_types[k])) {
+      set_error_msg("%s: invalid operand %d", op->name, k + 1);
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+
+// Value of a byte field: a register or a one-byte number.
+static int field(const Instruction *instr, int k, unsigned *f)
+{
+  const Operand *opd = instr->opds[k];
+
+  if (opd->type == REGISTER) {
+    *f = opd->value.reg;
+    return 1;
+  }
+
+  if (opd->value.num < 0 || opd->value.num > 0xff) {
+    set_error_msg("%s: operand %d out of range", instr->op->name, k + 1);
+    return 0;
+  }
+
+  *f = opd->value.num;
+  return 1;
+}
+
+
+// Number operand k of instr, checked to be in [min, max].
+static int number(const Instruction *instr, int k, octa min, octa max,
+                  octa *n)
+{
+  *n = instr->opds[k]->value.num;
+
+  if (*n < min || *n > max) {
+    set_error_msg("%s: operand %d out of range", instr->op->name, k + 1);
+    return 0;
+  }
+
+  return 1;
+}
+
+
+// Relative address of operand k of instr, for the jump at site: a
+// label or a number.
+static int target(const Instruction *instr, int k, int site,
+                  const LabelResolver *r, octa *disp)
+{
+  const Operand *opd = instr->opds[k];
+  int addr;
+
+  if (opd->type != LABEL) {
+    *disp = opd->value.num;
+    return 1;
+  }
+
+  switch (r->find(r->ctx, opd->value.label, site, &addr)) {
+  case 1:
+    *disp = addr - site;
+    return 1;
+  case -1:
+    *disp = 0;
+    return 1;
+  }
+
+  set_error_msg("%s: undefined label '%s'", instr->op->name,
+                opd->value.label);
+  return 0;
+}
+
+
+// Encode a jump with opcode opc (forward version) and the displacement
+// in bits bits, below X field x (only if bits is 16).
+static int jump(const Instruction *instr, int opc, unsigned x, octa disp,
+                int bits, utetra *out)
+{
+  octa mag = disp < 0 ? -disp : disp;
+
+  if (mag >> bits) {
+    set_error_msg("%s: target too far", instr->op->name);
+    return 0;
+  }
+
+  if (disp < 0)
+    opc++;
+  if (bits == 16)
+    *out = word(opc, x, mag >> 8, mag & 0xff);
+  else
+    *out = word(opc, mag >> 16, (mag >> 8) & 0xff, mag & 0xff);
+
+  return 1;
+}
+
+
+int encode_patch(utetra *w, int disp)
+{
+  int opc = *w >> 24;
+  int bits = opc == JMP ? 24 : 16;
+  int mag = disp < 0 ? -disp : disp;
+
+  if (mag >> bits) {
+    set_error_msg("jump target too far");
+    return 0;
+  }
+
+  utetra x = bits == 16 ? *w & 0xff0000 : 0;
+
+  if (disp < 0)
+    opc++;
+  *w = (utetra) opc << 24 | x | mag;
+
+  return 1;
+}
+
+
+// Labels with their addresses in a SymbolTable.
+static int find_in_table(void *ctx, const char *label, int site, int *addr)
+{
+  EntryData *data = stable_find(ctx, label);
+
+  if (!data)
+    return 0;
+
+  *addr = data->i;
+  return 1;
+}
+
+
+int encode(const Instruction *instr, int pc, SymbolTable labels, utetra *out)
+{
+  LabelResolver r = { find_in_table, labels };
+
+  return encode_resolve(instr, pc, &r, out);
+}
+
+
+int encode_resolve(const Instruction *instr, int pc, const LabelResolver *r,
+                   utetra *out)
+{
+  const Operator *op = instr->op;
+
+  if (!op) {
+    set_error_msg("unknown operator");
+    return -1;
+  }
+
+  if (!check_operands(instr))
+    return -1;
+
+  int opc = op->opcode;
+  unsigned x, y, z;
+  octa n;
+
+  switch (forms[opc + PSEUDO]) {
+  case FORM_NONE:
+    return 0;
+
+  case FORM_XYZ:
+    if (!field(instr, 0, &x) || !field(instr, 1, &y) || !field(instr, 2, &z))
+      return -1;
+    if (instr->opds[2]->type != REGISTER)
+      opc++;
+    *out = word(opc, x, y, z);
+    return 1;
+
+  case FORM_RRR:
+    *out = word(opc, instr->opds[0]->value.reg, instr->opds[1]->value.reg,
+                instr->opds[2]->value.reg);
+    return 1;
+
+  case FORM_JUMP2:
+    if (!target(instr, 1, pc, r, &n)
+        || !jump(instr, opc, instr->opds[0]->value.reg, n, 16, out))
+      return -1;
+    return 1;
+
+  case FORM_JUMP3:
+    if (!target(instr, 0, pc, r, &n) || !jump(instr, opc, 0, n, 24, out))
+      return -1;
+    return 1;
+
+  case FORM_WYDE:
+    if (!number(instr, 1, 0, 0xffff, &n))
+      return -1;
+    *out = word(opc, instr->opds[0]->value.reg, n >> 8, n & 0xff);
+    return 1;
+
+  case FORM_INT:
+    if (!number(instr, 0, 0, 0xffffff, &n))
+      return -1;
+    *out = word(opc, n >> 16, (n >> 8) & 0xff, n & 0xff);
+    return 1;
+
+  case FORM_NOP:
+    *out = word(opc, 0, 0, 0);
+    return 1;
+
+  case FORM_TETRA:
+    if (!number(instr, 0, -0x80000000LL, 0xffffffffLL, &n))
+      return -1;
+    *out = (utetra) n;
+    return 1;
+
+  case FORM_STR: {
+    int len;
+    const char *s = str_body(instr->opds[0], &len);
+    int size = (len + 4) / 4;
+
+    // Bytes in order, high byte first, padded with NULs
+    for (int i = 0; i < size; i++) {
+      utetra w = 0;
+
+      for (int j = 0; j < 4; j++) {
+        int c = 4 * i + j < len ? (unsigned char) s[4 * i + j] : 0;
+        w = w << 8 | c;
+      }
+      out[i] = w;
+    }
+    return size;
+  }
+
+  case FORM_CALL:
+    // Push the address of the word after the jump and jump
+    out[0] = word(GETA, REG_X, 0, 4);
+    out[1] = word(STOUI, REG_X, REG_SP, 0);
+    out[2] = word(ADDUI, REG_SP, REG_SP, 8);
+    if (!target(instr, 0, pc + 3, r, &n)
+        || !jump(instr, JMP, 0, n, 24, out + 3))
+      return -1;
+    return 4;
+
+  case FORM_RET:
+    // Pop the return address and the given number of arguments
+    if (!number(instr, 0, 0, 30, &n))
+      return -1;
+    out[0] = word(SUBUI, REG_SP, REG_SP, 8 * (n + 1));
+    out[1] = word(LDOUI, REG_X, REG_SP, 8 * n);
+    out[2] = word(GO, REG_X, 0, 0);
+    return 3;
+
+  case FORM_PUSH:
+    out[0] = word(STOUI, instr->opds[0]->value.reg, REG_SP, 0);
+    out[1] = word(ADDUI, REG_SP, REG_SP, 8);
+    return 2;
+  }
+
+  set_error_msg("%s: cannot be encoded", op->name);
+  return -1;
+}
+
+
+// Put in register r the address d words away from out[0]. Addresses
+// in registers are in bytes, four per word. The offset is built in
+// REG_Y, or in REG_X when r is REG_Y itself.
+static void far_address(utetra *out, int r, int d)
+{
+  int y = r == REG_Y ? REG_X : REG_Y;
+
+  out[0] = word(GETA, r, 0, 0);
+  out[1] = word(SETW, y, (d >> 24) & 0xff, (d >> 16) & 0xff);
+  out[2] = word(SLI, y, y, 48);
+  out[3] = word(SRI, y, y, 40);  // Sign-extended high wyde
+  out[4] = word(ORI, y, y, (d >> 8) & 0xff);
+  out[5] = word(SLI, y, y, 8);
+  out[6] = word(ORI, y, y, d & 0xff);
+  out[7] = word(SLI, y, y, 2);
+  out[8] = word(ADD, r, r, y);
+}
+
+
+int encode_relaxed(const Instruction *instr, int pc, int reach,
+                   const LabelResolver *r, utetra *out)
+{
+  if (reach == REACH_SHORT)
+    return encode_resolve(instr, pc, r, out);
+
+  if (!check_operands(instr))
+    return -1;
+
+  const Operator *op = instr->op;
+  int opc = op->opcode, form = forms[opc + PSEUDO];
+  int k = form == FORM_JUMP2 ? 1 : 0;
+  const Operand *opd = instr->opds[k];
+  int t;
+
+  if (opd->type != LABEL || r->find(r->ctx, opd->value.label, pc, &t) != 1) {
+    set_error_msg("%s: the target of a long jump must be a known label",
+                  op->name);
+    return -1;
+  }
+
+  int size = encode_size_reach(instr, reach);
+  unsigned x = instr->opds[0]->value.reg;
+
+  if (encode_reach(instr, pc, t) > reach) {
+    set_error_msg("%s: target too far", op->name);
+    return -1;
+  }
+
+  switch (form) {
+  case FORM_JUMP2:
+    if (opc == GETA) {
+      far_address(out, x, t - pc);
+      break;
+    }
+    out[0] = word(opposite[opc], x, 0, size);
+    if (reach == REACH_NEAR) {
+      jump(instr, JMP, 0, t - pc - 1, 24, out + 1);
+      break;
+    }
+    far_address(out + 1, REG_X, t - pc - 1);
+    out[1 + FAR_ADDR] = word(GO, REG_X, 0, 0);
+    break;
+
+  case FORM_JUMP3:
+    far_address(out, REG_X, t - pc);
+    out[FAR_ADDR] = word(GO, REG_X, 0, 0);
+    break;
+
+  case FORM_CALL:
+    out[0] = word(GETA, REG_X, 0, size);
+    out[1] = word(STOUI, REG_X, REG_SP, 0);
+    out[2] = word(ADDUI, REG_SP, REG_SP, 8);
+    far_address(out + 3, REG_X, t - pc - 3);
+    out[3 + FAR_ADDR] = word(GO, REG_X, 0, 0);
+    break;
+
+  default:
+    return encode_resolve(instr, pc, r, out);
+  }
+
+  return size;
+}
+
+
+int encode_layout(const Instruction *head, SymbolTable labels,
+                  const Instruction **errinstr)
+{
+  int pc = 0;
+
+  for (; head; head = head->next) {
+    if (head->label && !(head->op && head->op->opcode == IS)) {
+      InsertionResult res = stable_insert(labels, head->label);
+
+      if (!res.new) {
+        set_error_msg("label '%s' defined twice", head->label);
+        if (errinstr)
+          *errinstr = head;
+        return -1;
+      }
+      res.data->i = pc;
+    }
+
+    pc += encode_size(head);
+  }
+
+  return pc;
+}
+
+
+int encode_program(const Instruction *head, SymbolTable labels, utetra *out,
+                   const Instruction **errinstr)
+{
+  int pc = 0;
+
+  for (; head; head = head->next) {
+    int n = encode(head, pc, labels, out + pc);
+
+    if (n < 0) {
+      if (errinstr)
+        *errinstr = head;
+      return -1;
+    }
+    pc += n;
+  }
+
+  return pc;
+}
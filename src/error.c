@@ -2,18 +2,29 @@
   error.c
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "error.h"
 #include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <unistd.h>
 
 // The program name.
 static char prog_name[1024] = "";
 
-// The error message.
-static char error_msg[1024];
+// The error message. Each thread has its own.
+static __thread char error_msg[1024];
+
+// Serializes writes to stderr, so that messages from different threads
+// are not mixed.
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Set by the first thread to crash the program.
+static int dying = 0;
 
 
 void set_prog_name(const char *name)
@@ -38,6 +49,41 @@ void set_error_msg(const char *msg, ...)
 }
 
 
+// Print the error message set, as described in error.h.
+static void print_msg()
+{
+  int len = strlen(error_msg);
+  int err = errno;
+
+  pthread_mutex_lock(&output_lock);
+
+  if (len && error_msg[len - 1] == ':' && err) {
+    char syserr[256];
+
+    if (strerror_r(err, syserr, sizeof(syserr)))
+      snprintf(syserr, sizeof(syserr), "error %d", err);
+    fprintf(stderr, "%s: %s %s\n", prog_name, error_msg, syserr);
+  }
+  else {
+    if (len && error_msg[len - 1] == ':')
+      error_msg[len - 1] = '.';
+    fprintf(stderr, "%s: %s\n", prog_name, error_msg);
+  }
+
+  pthread_mutex_unlock(&output_lock);
+}
+
+
+// Only one thread may crash the program: any other that tries waits
+// for the first to exit.
+static void start_dying()
+{
+  if (__sync_lock_test_and_set(&dying, 1))
+    for (;;)
+      pause();
+}
+
+
 void print_error_msg(const char *msg, ...)
 {
   if (msg) {
@@ -48,22 +94,14 @@ void print_error_msg(const char *msg, ...)
     va_end(arglist);
   }
 
-  int len = strlen(error_msg);
-
-  if (error_msg[len - 1] == ':' && errno) {
-    fprintf(stderr, "%s: %s %s\n", prog_name, error_msg,
-            strerror(errno));
-    return;
-  }
-  else if (error_msg[len - 1] == ':')
-    error_msg[len - 1] = '.';
-
-  fprintf(stderr, "%s: %s\n", prog_name, error_msg);
+  print_msg();
 }
 
 
 void die(const char *msg, ...)
 {
+  start_dying();
+
   if (msg) {
     va_list arglist;
     
@@ -72,17 +110,7 @@ void die(const char *msg, ...)
     va_end(arglist);
   }
 
-  int len = strlen(error_msg);
-
-  if (error_msg[len - 1] == ':' && errno) {
-    fprintf(stderr, "%s: %s %s\n", prog_name, error_msg,
-            strerror(errno));
-    exit(-1);
-  }
-  else if (error_msg[len - 1] == ':')
-    error_msg[len - 1] = '.';
-
-  fprintf(stderr, "%s: %s\n", prog_name, error_msg);
+  print_msg();
   exit(-1);
 }
 
@@ -93,6 +121,7 @@ void *emalloc(size_t size)
   void *ret = malloc(size);
 
   if (!ret) {
+    start_dying();
     print_error_msg("call to malloc failed:");
     exit(-1);
   }
@@ -107,6 +136,7 @@ char *estrdup(const char *s)
   char *ret = malloc(strlen(s) + 1);
 
   if (!ret) {
+    start_dying();
     print_error_msg("call to estrdup failed:");
     exit(-1);
   }
@@ -115,3 +145,26 @@ char *estrdup(const char *s)
 
   return ret;
 }
+
+
+char *estrndup(const char *s, size_t n)
+{
+  size_t len = 0;
+
+  while (len < n && s[len])
+    len++;
+
+  errno = 0;
+  char *ret = malloc(len + 1);
+
+  if (!ret) {
+    start_dying();
+    print_error_msg("call to estrndup failed:");
+    exit(-1);
+  }
+
+  memcpy(ret, s, len);
+  ret[len] = 0;
+
+  return ret;
+}
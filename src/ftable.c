@@ -0,0 +1,128 @@
+/*
+  ftable.c
+*/
+
+#include "ftable.h"
+#include "htable.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// An entry; the key is at offset off of the string pool.
+typedef struct {
+  unsigned int off, len;
+  EntryData data;
+} FEntry;
+
+// A slot of the hash index; idx is the entry index plus one, or zero
+// if the slot is empty.
+typedef struct {
+  unsigned int hash, idx;
+} FSlot;
+
+// The header is followed, in the same block, by the entries (sorted
+// by key), the slots and the string pool.
+struct ftable_s {
+  size_t n, nslots, size;
+  FEntry *entries;
+  FSlot *slots;
+  char *pool;
+};
+
+
+FrozenTable ftable_create(size_t n, const char **keys, const EntryData *data)
+{
+  size_t poolsize = 0;
+
+  for (size_t i = 0; i < n; i++)
+    poolsize += strlen(keys[i]) + 1;
+
+  // At most half the slots are used, so misses end quickly.
+  size_t nslots = 2;
+  while (nslots < 2 * n)
+    nslots *= 2;
+
+  size_t head = (sizeof(struct ftable_s) + 15) & ~(size_t) 15;
+  size_t size = head + n * sizeof(FEntry) + nslots * sizeof(FSlot) + poolsize;
+  FrozenTable F = emalloc(size);
+
+  F->n = n;
+  F->nslots = nslots;
+  F->size = size;
+  F->entries = (FEntry *) ((char *) F + head);
+  F->slots = (FSlot *) (F->entries + n);
+  F->pool = (char *) (F->slots + nslots);
+  memset(F->slots, 0, nslots * sizeof(FSlot));
+
+  size_t off = 0, mask = nslots - 1;
+
+  for (size_t i = 0; i < n; i++) {
+    size_t len = strlen(keys[i]);
+    FEntry *e = &F->entries[i];
+
+    e->off = off;
+    e->len = len;
+    e->data = data[i];
+    memcpy(F->pool + off, keys[i], len + 1);
+    off += len + 1;
+
+    unsigned int hash = htable_hash(keys[i], len);
+    size_t j = hash & mask;
+    while (F->slots[j].idx)
+      j = (j + 1) & mask;
+    F->slots[j].hash = hash;
+    F->slots[j].idx = i + 1;
+  }
+
+  return F;
+}
+
+
+void ftable_destroy(FrozenTable F)
+{
+  free(F);
+}
+
+
+EntryData *ftable_find(FrozenTable F, const char *key)
+{
+  size_t len = strlen(key);
+  unsigned int hash = htable_hash(key, len);
+  size_t mask = F->nslots - 1;
+
+  for (size_t j = hash & mask; F->slots[j].idx; j = (j + 1) & mask) {
+    if (F->slots[j].hash != hash) continue;
+
+    FEntry *e = &F->entries[F->slots[j].idx - 1];
+    if (e->len == len && !memcmp(F->pool + e->off, key, len))
+      return &e->data;
+  }
+
+  return 0;
+}
+
+
+size_t ftable_size(FrozenTable F)
+{
+  return F->n;
+}
+
+
+const char *ftable_key(FrozenTable F, size_t i)
+{
+  return F->pool + F->entries[i].off;
+}
+
+
+EntryData *ftable_data(FrozenTable F, size_t i)
+{
+  return &F->entries[i].data;
+}
+
+
+void ftable_stats(FrozenTable F, StableStats *stats)
+{
+  stats->entries = F->n;
+  stats->nodes = F->nslots;
+  stats->bytes = F->size;
+}
@@ -0,0 +1,246 @@
+/*
+  htable.c
+*/
+
+#include "htable.h"
+#include "arena.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Initial number of slots; always a power of two.
+#define INITIAL_SLOTS 64
+
+// An entry. The key is stored inline right after the record, and
+// entries live in the table's arena so their data never moves.
+typedef struct {
+  unsigned int hash;
+  unsigned int len;
+  EntryData data;
+  char key[];
+} Entry;
+
+// A slot keeps the hash next to the pointer so most mismatches are
+// rejected without touching the entry.
+typedef struct {
+  unsigned int hash;
+  Entry *entry;
+} Slot;
+
+struct htable_s {
+  Slot *slots;
+
+  // Number of slots (power of two) and of entries.
+  size_t nslots, nentries;
+
+  Arena entries;
+
+  // Entries sorted by key, built lazily by htable_sort.
+  Entry **sorted;
+  size_t nsorted;
+};
+
+
+unsigned int htable_hash(const char *key, size_t len)
+{
+  // FNV-1a.
+  unsigned int h = 2166136261u;
+
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char) key[i];
+    h *= 16777619u;
+  }
+
+  return h;
+}
+
+
+HashTable htable_create()
+{
+  HashTable H = emalloc(sizeof(struct htable_s));
+
+  H->nslots = INITIAL_SLOTS;
+  H->nentries = 0;
+  H->slots = emalloc(H->nslots * sizeof(Slot));
+  memset(H->slots, 0, H->nslots * sizeof(Slot));
+  H->entries = arena_create(0);
+  H->sorted = 0;
+  H->nsorted = 0;
+
+  return H;
+}
+
+
+void htable_destroy(HashTable H)
+{
+  arena_destroy(H->entries);
+  free(H->slots);
+  free(H->sorted);
+  free(H);
+}
+
+
+// Return slot where key is or should be placed.
+static Slot *lookup(HashTable H, const char *key, size_t len,
+                    unsigned int hash)
+{
+  size_t mask = H->nslots - 1;
+
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Slot *s = &H->slots[i];
+
+    if (!s->entry)
+      return s;
+    if (s->hash == hash && s->entry->len == len
+        && !memcmp(s->entry->key, key, len))
+      return s;
+  }
+}
+
+
+// Double the number of slots, reusing the stored hashes.
+static void grow(HashTable H)
+{
+  Slot *old = H->slots;
+  size_t nold = H->nslots;
+
+  H->nslots *= 2;
+  H->slots = emalloc(H->nslots * sizeof(Slot));
+  memset(H->slots, 0, H->nslots * sizeof(Slot));
+
+  size_t mask = H->nslots - 1;
+
+  for (size_t i = 0; i < nold; i++) {
+    if (!old[i].entry) continue;
+
+    size_t j = old[i].hash & mask;
+    while (H->slots[j].entry)
+      j = (j + 1) & mask;
+    H->slots[j] = old[i];
+  }
+
+  free(old);
+}
+
+
+InsertionResult htable_insert(HashTable H, const char *key)
+{
+  size_t len = strlen(key);
+
+  return htable_insert_hashed(H, key, len, htable_hash(key, len));
+}
+
+
+InsertionResult htable_insert_hashed(HashTable H, const char *key, size_t len,
+                                     unsigned int hash)
+{
+  InsertionResult result;
+  Slot *s = lookup(H, key, len, hash);
+
+  if (s->entry) {
+    result.new = 0;
+    result.data = &s->entry->data;
+    return result;
+  }
+
+  // Keep load factor below 3/4.
+  if ((H->nentries + 1) * 4 > H->nslots * 3) {
+    grow(H);
+    s = lookup(H, key, len, hash);
+  }
+
+  Entry *e = arena_alloc(H->entries, sizeof(Entry) + len + 1);
+  e->hash = hash;
+  e->len = len;
+  memset(&e->data, 0, sizeof(EntryData));
+  memcpy(e->key, key, len + 1);
+
+  s->hash = hash;
+  s->entry = e;
+  H->nentries++;
+
+  result.new = 1;
+  result.data = &e->data;
+  return result;
+}
+
+
+EntryData *htable_find(HashTable H, const char *key)
+{
+  size_t len = strlen(key);
+
+  return htable_find_hashed(H, key, len, htable_hash(key, len));
+}
+
+
+EntryData *htable_find_hashed(HashTable H, const char *key, size_t len,
+                              unsigned int hash)
+{
+  Slot *s = lookup(H, key, len, hash);
+
+  return s->entry ? &s->entry->data : 0;
+}
+
+
+static int compar(const void *a, const void *b)
+{
+  return strcmp((*(Entry * const *) a)->key, (*(Entry * const *) b)->key);
+}
+
+
+size_t htable_sort(HashTable H)
+{
+  if (H->nsorted != H->nentries) {
+    free(H->sorted);
+    H->sorted = emalloc((H->nentries ? H->nentries : 1) * sizeof(Entry *));
+
+    size_t n = 0;
+    for (size_t i = 0; i < H->nslots; i++)
+      if (H->slots[i].entry)
+        H->sorted[n++] = H->slots[i].entry;
+
+    qsort(H->sorted, n, sizeof(Entry *), compar);
+    H->nsorted = n;
+  }
+
+  return H->nsorted;
+}
+
+
+const char *htable_sorted_key(HashTable H, size_t i)
+{
+  return H->sorted[i]->key;
+}
+
+
+EntryData *htable_sorted_data(HashTable H, size_t i)
+{
+  return &H->sorted[i]->data;
+}
+
+
+void htable_collect(HashTable H, const char **keys, EntryData **data)
+{
+  size_t n = 0;
+
+  for (size_t i = 0; i < H->nslots; i++)
+    if (H->slots[i].entry) {
+      keys[n] = H->slots[i].entry->key;
+      data[n++] = &H->slots[i].entry->data;
+    }
+}
+
+
+size_t htable_size(HashTable H)
+{
+  return H->nentries;
+}
+
+
+void htable_stats(HashTable H, StableStats *stats)
+{
+  stats->entries = H->nentries;
+  stats->nodes = H->nslots;
+  stats->bytes = sizeof(struct htable_s) + H->nslots * sizeof(Slot)
+    + arena_bytes(H->entries) + H->nsorted * sizeof(Entry *);
+}
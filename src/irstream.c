@@ -0,0 +1,191 @@
+/*
+  irstream.c
+*/
+
+#include "irstream.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+// Reallocate p to size bytes, crashing on failure.
+static void *erealloc(void *p, size_t size)
+{
+  p = realloc(p, size);
+
+  if (!p)
+    die("Failed to grow instruction stream.");
+
+  return p;
+}
+
+
+InstrStream *irs_create()
+{
+  InstrStream *S = emalloc(sizeof(InstrStream));
+
+  S->n = 0;
+  S->max = 64;
+  S->op = emalloc(S->max * sizeof(const Operator *));
+  S->opds = emalloc(S->max * sizeof(IROperands));
+  S->label = emalloc(S->max * sizeof(unsigned int));
+  S->lineno = emalloc(S->max * sizeof(int));
+  S->pos = emalloc(S->max * sizeof(int));
+
+  S->poolsize = 0;
+  S->poolmax = 1024;
+  S->pool = emalloc(S->poolmax);
+  S->strings = stable_create_kind(STABLE_HASH);
+
+  return S;
+}
+
+
+void irs_destroy(InstrStream *S)
+{
+  free(S->op);
+  free(S->opds);
+  free(S->label);
+  free(S->lineno);
+  free(S->pos);
+  free(S->pool);
+  stable_destroy(S->strings);
+  free(S);
+}
+
+
+unsigned int irs_intern(InstrStream *S, const char *str)
+{
+  InsertionResult res = stable_insert(S->strings, str);
+
+  if (!res.new)
+    return res.data->u;
+
+  size_t len = strlen(str) + 1;
+
+  if (S->poolsize + len > S->poolmax) {
+    while (S->poolsize + len > S->poolmax)
+      S->poolmax *= 2;
+    S->pool = erealloc(S->pool, S->poolmax);
+  }
+
+  memcpy(S->pool + S->poolsize, str, len);
+  res.data->u = S->poolsize;
+  S->poolsize += len;
+
+  return res.data->u;
+}
+
+
+const char *irs_string(const InstrStream *S, unsigned int off)
+{
+  return S->pool + off;
+}
+
+
+const char *irs_label(const InstrStream *S, int i)
+{
+  return S->label[i] ? S->pool + S->label[i] - 1 : 0;
+}
+
+
+int irs_append(InstrStream *S, const Instruction *instr)
+{
+  if (S->n == S->max) {
+    S->max *= 2;
+    S->op = erealloc(S->op, S->max * sizeof(const Operator *));
+    S->opds = erealloc(S->opds, S->max * sizeof(IROperands));
+    S->label = erealloc(S->label, S->max * sizeof(unsigned int));
+    S->lineno = erealloc(S->lineno, S->max * sizeof(int));
+    S->pos = erealloc(S->pos, S->max * sizeof(int));
+  }
+
+  int i = S->n++;
+  IROperands *opds = &S->opds[i];
+
+  S->op[i] = instr->op;
+  S->label[i] = instr->label ? irs_intern(S, instr->label) + 1 : 0;
+  S->lineno[i] = instr->lineno;
+  S->pos[i] = instr->pos;
+
+  for (int k = 0; k < 3; k++) {
+    const Operand *opd = instr->opds[k];
+
+    opds->type[k] = opd ? opd->type : OP_NONE;
+    opds->val[k] = 0;
+    if (!opd) continue;
+
+    switch (opd->type) {
+    case REGISTER:
+      opds->val[k] = opd->value.reg;
+      break;
+    case LABEL:
+    case STRING:
+      opds->val[k] = irs_intern(S, opd->value.str);
+      break;
+    default:
+      opds->val[k] = opd->value.num;
+      break;
+    }
+  }
+
+  return i;
+}
+
+
+InstrStream *irs_from_list(const Instruction *head)
+{
+  InstrStream *S = irs_create();
+
+  for (; head; head = head->next)
+    irs_append(S, head);
+
+  return S;
+}
+
+
+Instruction *irs_get(const InstrStream *S, int i)
+{
+  const IROperands *opds = &S->opds[i];
+  Operand *ops[3];
+
+  for (int k = 0; k < 3; k++) {
+    switch (opds->type[k]) {
+    case OP_NONE:
+      ops[k] = 0;
+      break;
+    case REGISTER:
+      ops[k] = operand_create_register(opds->val[k]);
+      break;
+    case LABEL:
+      ops[k] = operand_create_label(S->pool + opds->val[k]);
+      break;
+    case STRING:
+      ops[k] = operand_create_string(S->pool + opds->val[k]);
+      break;
+    default:
+      ops[k] = operand_create_number(opds->val[k]);
+      ops[k]->type = opds->type[k];
+      break;
+    }
+  }
+
+  Instruction *ret = instr_create(irs_label(S, i), S->op[i], ops);
+  ret->lineno = S->lineno[i];
+  ret->pos = S->pos[i];
+
+  return ret;
+}
+
+
+Instruction *irs_to_list(const InstrStream *S)
+{
+  Instruction *head = 0, **tail = &head;
+
+  for (int i = 0; i < S->n; i++) {
+    *tail = irs_get(S, i);
+    tail = &(*tail)->next;
+  }
+
+  return head;
+}
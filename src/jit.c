@@ -0,0 +1,1016 @@
+/*
+  jit.c
+*/
+
+#define _DEFAULT_SOURCE
+
+#include "jit.h"
+#include "opcodes.h"
+#include "simcode.h"
+#include "error.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_NATIVE 1
+#include <sys/mman.h>
+#include <unistd.h>
+#else
+#define JIT_NATIVE 0
+#endif
+
+#if JIT_NATIVE
+
+// Longest block, in instructions, and a bound on its native code.
+#define MAX_BLOCK 128
+#define MAX_BLOCK_CODE (MAX_BLOCK * 224 + 256)
+
+// Size of the executable region. It is never writable and executable
+// at once: pages are made writable only while code is written to them.
+#define REGION_SIZE (16 << 20)
+
+// Ways out of native code.
+#define EXIT_JUMP  0  // To ctx.pc.
+#define EXIT_CHAIN 1  // The same, through the stub at ctx.stub.
+#define EXIT_SIDE  2  // Before the instruction at ctx.pc, to interpret.
+
+// State shared with native code, which keeps its address in rbx.
+typedef struct {
+  uocta left;  // Steps left.
+  uocta pc;
+  uocta *reg;
+  VMem mem;
+  uocta code_limit;  // End of the translated code.
+  const Decoded *decoded;  // Words decoded by the interpreter,
+  uocta decoded_limit;     // up to this address.
+  uocta limit[4];    // Last addresses of accesses of 1, 2, 4 and 8 bytes.
+  unsigned char *stub;
+
+  // The last page accessed, and the host address of its guest address
+  // 0, which native code keeps in r12: the host address of a guest
+  // address in the page is their sum.
+  uocta tlb_page;
+  unsigned char *tlb_base;
+} Context;
+
+// A basic block.
+typedef struct {
+  uocta pc;
+  int len;     // Instructions.
+  int native;  // Can it be translated?
+  int count;   // Times interpreted.
+  unsigned char *entry;
+} Block;
+
+struct jit_s {
+  // Executable region: entry and exit code, then blocks up to free.
+  unsigned char *region, *start, *free, *end;
+  unsigned char *epilogue;
+  int (*enter)(Context *ctx, const void *entry);
+
+  // Blocks by address, with open addressing.
+  Block **blocks;
+  size_t nblocks, size;
+
+  uocta code_limit;
+  uocta code_writes;  // Value of M->code_writes the blocks are valid for.
+
+  Machine *shadow;  // Copy of the machine, for SIM_JIT_CHECK.
+};
+
+
+// The word at pc.
+static utetra fetch(Machine *M, uocta pc)
+{
+  unsigned char p[4];
+
+  vmem_read(M->mem, pc, p, 4);
+  return (utetra) p[0] << 24 | (utetra) p[1] << 16 | (utetra) p[2] << 8 | p[3];
+}
+
+// Can op be translated? Does it end a block?
+static int native_op(unsigned op)
+{
+  if (op <= NXORI)
+    return (op & ~1) != DIV && (op & ~1) != DIVU;
+  return op <= SETW || op == NOP;
+}
+
+static int ends_block(unsigned op)
+{
+  return op >= JMP && op <= GOB;
+}
+
+/* Code generation */
+
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R12 = 12 };
+
+// Condition codes.
+enum {
+  CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_S = 0x8, CC_NS = 0x9,
+  CC_L = 0xc, CC_LE = 0xe, CC_G = 0xf
+};
+
+// A jump to the side exit of the k-th instruction, or to the exit for
+// lack of steps if k is -1, to be patched.
+typedef struct {
+  unsigned char *at;
+  int k;
+} Fixup;
+
+// A jump to the code looking up the page of the address in rax, to be
+// patched, and where to go back.
+typedef struct {
+  unsigned char *at, *back;
+  int write;
+} Miss;
+
+typedef struct {
+  unsigned char *p;
+  Fixup fix[4 * MAX_BLOCK + 1];
+  int nfix;
+  Miss miss[MAX_BLOCK];
+  int nmiss;
+} Code;
+
+static void emit(Code *c, int b)
+{
+  *c->p++ = b;
+}
+
+static void emit32(Code *c, utetra v)
+{
+  memcpy(c->p, &v, 4);
+  c->p += 4;
+}
+
+static void emit64(Code *c, uocta v)
+{
+  memcpy(c->p, &v, 8);
+  c->p += 8;
+}
+
+// Make the pages of the region from from to to writable, or executable
+// again.
+static void writable(unsigned char *from, unsigned char *to, int write)
+{
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  unsigned char *start = (unsigned char *) ((uintptr_t) from & ~(page - 1));
+
+  if (mprotect(start, to - start,
+               write ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC))
+    die("cannot change the protection of native code:");
+}
+
+// Make the rel32 at at point to to.
+static void patch(unsigned char *at, const unsigned char *to)
+{
+  int d = to - (at + 4);
+
+  memcpy(at, &d, 4);
+}
+
+// REX prefix with W and the high bits of the reg and rm fields, if
+// needed.
+static void rex(Code *c, int w, int reg, int rm)
+{
+  int v = 0x40 | w << 3 | (reg >> 3) << 2 | rm >> 3;
+
+  if (v != 0x40)
+    emit(c, v);
+}
+
+// Opcode op, with 0x0f first if it has two bytes.
+static void opcode(Code *c, int op)
+{
+  if (op > 0xff)
+    emit(c, op >> 8);
+  emit(c, op & 0xff);
+}
+
+// Instruction op with operands reg and register rm.
+static void op_reg(Code *c, int w, int op, int reg, int rm)
+{
+  rex(c, w, reg, rm);
+  opcode(c, op);
+  emit(c, 0xc0 | (reg & 7) << 3 | (rm & 7));
+}
+
+// The same with operand [base + disp] instead of rm.
+static void op_mem(Code *c, int w, int op, int reg, int base, int disp)
+{
+  int mod = disp >= -128 && disp < 128 ? 1 : 2;
+
+  rex(c, w, reg, base);
+  opcode(c, op);
+  emit(c, mod << 6 | (reg & 7) << 3 | (base & 7));
+  if ((base & 7) == RSP)
+    emit(c, 0x24);
+  if (mod == 1)
+    emit(c, disp & 0xff);
+  else
+    emit32(c, disp);
+}
+
+// The same with operand [r12 + rax]: guest memory at address rax, once
+// its page is in the TLB.
+static void op_guest(Code *c, int w, int op, int reg)
+{
+  rex(c, w, reg, R12);
+  opcode(c, op);
+  emit(c, (reg & 7) << 3 | RSP);
+  emit(c, RAX << 3 | (R12 & 7));
+}
+
+static void mov_imm(Code *c, int r, uocta v)
+{
+  if (v <= 0xffffffffu) {
+    rex(c, 0, 0, r);
+    emit(c, 0xb8 + (r & 7));
+    emit32(c, v);
+  }
+  else if ((octa) v >= -0x80000000LL) {
+    op_reg(c, 1, 0xc7, 0, r);
+    emit32(c, v);
+  }
+  else {
+    rex(c, 1, 0, r);
+    emit(c, 0xb8 + (r & 7));
+    emit64(c, v);
+  }
+}
+
+static void bswap(Code *c, int w, int r)
+{
+  rex(c, w, 0, r);
+  emit(c, 0x0f);
+  emit(c, 0xc8 + (r & 7));
+}
+
+// Swap the bytes of cx.
+static void bswap16_cx(Code *c)
+{
+  emit(c, 0x66);
+  op_reg(c, 0, 0xc1, 0, RCX);  // rol cx, 8
+  emit(c, 8);
+}
+
+// Guest register g to and from host register r.
+static void get(Code *c, int r, unsigned g)
+{
+  op_mem(c, 1, 0x8b, r, RBP, 8 * g);
+}
+
+static void put(Code *c, unsigned g, int r)
+{
+  op_mem(c, 1, 0x89, r, RBP, 8 * g);
+}
+
+#define CTX(field) ((int) offsetof(Context, field))
+
+// Conditional jump to the side exit of instruction k.
+static void exit_if(Code *c, int cc, int k)
+{
+  emit(c, 0x0f);
+  emit(c, 0x80 | cc);
+  c->fix[c->nfix].at = c->p;
+  c->fix[c->nfix++].k = k;
+  emit32(c, 0);
+}
+
+static void set_pc(Code *c, uocta pc)
+{
+  mov_imm(c, RAX, pc);
+  op_mem(c, 1, 0x89, RAX, RBX, CTX(pc));
+}
+
+static void leave(Jit *J, Code *c, int status)
+{
+  mov_imm(c, RAX, status);
+  emit(c, 0xe9);
+  emit32(c, 0);
+  patch(c->p - 4, J->epilogue);
+}
+
+// Leave for target, through a stub that starts with a jump to the
+// next instruction, to be patched into a jump to the target block.
+static void chain_exit(Jit *J, Code *c, uocta target)
+{
+  unsigned char *stub = c->p;
+
+  emit(c, 0xe9);
+  emit32(c, 0);
+  set_pc(c, target);
+  emit(c, 0x48);  // lea rax, [rip + stub]
+  emit(c, 0x8d);
+  emit(c, 0x05);
+  emit32(c, 0);
+  patch(c->p - 4, stub);
+  op_mem(c, 1, 0x89, RAX, RBX, CTX(stub));
+  leave(J, c, EXIT_CHAIN);
+}
+
+// Address of an access of n bytes at $y + rcx in rax, leaving before
+// instruction k if outside of memory.
+static void address(Code *c, unsigned y, int n, int k)
+{
+  get(c, RAX, y);
+  op_reg(c, 1, 0x01, RCX, RAX);  // add rax, rcx
+  if (n > 1) {
+    op_reg(c, 1, 0x83, 4, RAX);  // and rax, -n
+    emit(c, -n & 0xff);
+  }
+  op_mem(c, 1, 0x3b, RAX, RBX, CTX(limit) + 8 * ((n > 1) + (n > 2) + (n > 4)));
+  exit_if(c, CC_A, k);
+}
+
+// Leave before instruction k, a store of n bytes at the address in
+// rax, if it writes a word the interpreter has decoded, for it to mark
+// the word to be decoded again.
+static void guard_decoded(Code *c, int n, int k)
+{
+  op_mem(c, 1, 0x3b, RAX, RBX, CTX(decoded_limit));
+  emit(c, 0x73);  // jae past
+  emit(c, 0);
+
+  unsigned char *skip = c->p;
+
+  op_reg(c, 1, 0x89, RAX, RDX);  // mov rdx, rax
+  op_reg(c, 1, 0xc1, 5, RDX);    // shr rdx, 2
+  emit(c, 2);
+  op_reg(c, 1, 0x69, RDX, RDX);  // imul rdx, rdx, sizeof(Decoded)
+  emit32(c, sizeof(Decoded));
+  op_mem(c, 1, 0x03, RDX, RBX, CTX(decoded));
+  for (int i = 0; i < (n == 8 ? 2 : 1); i++) {
+    op_mem(c, 0, 0x80, 7, RDX,  // cmp byte [rdx + op], SIM_UNDECODED
+           i * (int) sizeof(Decoded) + (int) offsetof(Decoded, op));
+    emit(c, SIM_UNDECODED);
+    exit_if(c, CC_NE, k);
+  }
+  skip[-1] = c->p - skip;
+}
+
+// Make sure the page of the address in rax is the one in the TLB.
+static void map(Code *c, int write)
+{
+  op_reg(c, 1, 0x89, RAX, RDX);  // mov rdx, rax
+  op_reg(c, 1, 0xc1, 5, RDX);    // shr rdx, VMEM_PAGE_BITS
+  emit(c, VMEM_PAGE_BITS);
+  op_mem(c, 1, 0x3b, RDX, RBX, CTX(tlb_page));
+  emit(c, 0x0f);
+  emit(c, 0x80 | CC_NE);
+  emit32(c, 0);
+  c->miss[c->nmiss].at = c->p - 4;
+  c->miss[c->nmiss].back = c->p;
+  c->miss[c->nmiss++].write = write;
+}
+
+// Put the page of guest address a in the TLB of ctx, and return the
+// new base. Pages that are not allocated are only read, from the page
+// of zeros, and left out of the TLB.
+static unsigned char *map_page(Context *ctx, uocta a, int write)
+{
+  unsigned char *page = vmem_page(ctx->mem, a, write);
+
+  if (page)
+    ctx->tlb_page = a >> VMEM_PAGE_BITS;
+  else {
+    page = (unsigned char *) vmem_zeros;
+    ctx->tlb_page = VMEM_NO_PAGE;
+  }
+  ctx->tlb_base = (unsigned char *)
+    ((uintptr_t) page - (uintptr_t) (a & ~(VMEM_PAGE_SIZE - 1)));
+  return ctx->tlb_base;
+}
+
+// Call map_page for the address in rax and go back.
+static void map_miss(Code *c, const Miss *m)
+{
+  patch(m->at, c->p);
+  emit(c, 0x50);  // push rax
+  emit(c, 0x51);  // push rcx
+  op_reg(c, 1, 0x89, RBX, RDI);
+  op_reg(c, 1, 0x89, RAX, RSI);
+  mov_imm(c, RDX, m->write);
+  rex(c, 1, 0, RAX);  // mov rax, map_page
+  emit(c, 0xb8);
+  emit64(c, (uintptr_t) map_page);
+  op_reg(c, 0, 0xff, 2, RAX);  // call rax
+  op_reg(c, 1, 0x89, RAX, R12);
+  emit(c, 0x59);  // pop rcx
+  emit(c, 0x58);  // pop rax
+  emit(c, 0xe9);
+  emit32(c, 0);
+  patch(c->p - 4, m->back);
+}
+
+// Translate the k-th instruction of a block, w at pc, which does not
+// end it.
+static void translate_instr(Code *c, utetra w, uocta pc, int k)
+{
+  unsigned op = w >> 24, x = (w >> 16) & 0xff, y = (w >> 8) & 0xff;
+  unsigned z = w & 0xff;
+  int n = 1 << ((op >> 1) & 3), sign = op < LDBU;
+
+  switch (op) {
+  case SETW:
+    mov_imm(c, RAX, w & 0xffff);
+    put(c, x, RAX);
+    return;
+  case GETA:
+  case GETAB:
+    mov_imm(c, RAX, op == GETA ? pc + 4 * (uocta) (w & 0xffff)
+                               : pc - 4 * (uocta) (w & 0xffff));
+    put(c, x, RAX);
+    return;
+  case NOP:
+    return;
+  }
+
+  // The last operand in rcx
+  if (op & 1)
+    mov_imm(c, RCX, z);
+  else
+    get(c, RCX, z);
+
+  if (op <= LDOUI) {
+    address(c, y, n, k);
+    map(c, 0);
+    switch (n) {
+    case 1:
+      op_guest(c, sign, sign ? 0x0fbe : 0x0fb6, RCX);  // movsx, movzx
+      break;
+    case 2:
+      op_guest(c, 0, 0x0fb7, RCX);  // movzx ecx, word
+      bswap16_cx(c);
+      op_reg(c, sign, sign ? 0x0fbf : 0x0fb7, RCX, RCX);
+      break;
+    case 4:
+      op_guest(c, 0, 0x8b, RCX);
+      bswap(c, 0, RCX);
+      if (sign)
+        op_reg(c, 1, 0x63, RCX, RCX);  // movsxd rcx, ecx
+      break;
+    default:
+      op_guest(c, 1, 0x8b, RCX);
+      bswap(c, 1, RCX);
+    }
+    put(c, x, RCX);
+    return;
+  }
+
+  if (op <= STOUI) {
+    address(c, y, n, k);
+    op_mem(c, 1, 0x3b, RAX, RBX, CTX(code_limit));
+    exit_if(c, CC_B, k);
+    guard_decoded(c, n, k);
+    map(c, 1);
+    get(c, RCX, x);
+    switch (n) {
+    case 1:
+      op_guest(c, 0, 0x88, RCX);
+      break;
+    case 2:
+      bswap16_cx(c);
+      emit(c, 0x66);
+      op_guest(c, 0, 0x89, RCX);
+      break;
+    default:
+      bswap(c, n == 8, RCX);
+      op_guest(c, n == 8, 0x89, RCX);
+    }
+    return;
+  }
+
+  switch (op & ~1) {
+  case ADD:
+  case ADDU:
+    get(c, RAX, y);
+    op_reg(c, 1, 0x01, RCX, RAX);
+    break;
+  case SUB:
+  case SUBU:
+    get(c, RAX, y);
+    op_reg(c, 1, 0x29, RCX, RAX);
+    break;
+  case AND:
+  case OR:
+  case XOR:
+  case NXOR:
+    get(c, RAX, y);
+    op_reg(c, 1, (op & ~1) == AND ? 0x21 : (op & ~1) == OR ? 0x09 : 0x31,
+           RCX, RAX);
+    if ((op & ~1) == NXOR)
+      op_reg(c, 1, 0xf7, 2, RAX);  // not rax
+    break;
+  case MUL:
+  case MULU:
+    get(c, RAX, y);
+    op_reg(c, 1, 0xf7, (op & ~1) == MUL ? 5 : 4, RCX);  // imul, mul
+    op_mem(c, 1, 0x89, RDX, RBP,
+           (int) (offsetof(Machine, rH) - offsetof(Machine, reg)));
+    break;
+  case CMP:
+  case CMPU:
+    get(c, RAX, y);
+    op_reg(c, 1, 0x39, RCX, RAX);  // cmp rax, rcx
+    op_reg(c, 0, 0x0f90 | ((op & ~1) == CMP ? CC_G : CC_A), 0, RDX);
+    op_reg(c, 0, 0x0f90 | ((op & ~1) == CMP ? CC_L : CC_B), 0, RCX);
+    op_reg(c, 0, 0x0fb6, RDX, RDX);
+    op_reg(c, 0, 0x0fb6, RCX, RCX);
+    op_reg(c, 1, 0x29, RCX, RDX);
+    put(c, x, RDX);
+    return;
+  case SL:
+  case SLU:
+  case SR:
+  case SRU: {
+    int ext = (op & ~1) == SR ? 7 : (op & ~1) == SRU ? 5 : 4;
+
+    get(c, RAX, y);
+    if (op & 1) {
+      if (z < 64 || ext == 7) {
+        op_reg(c, 1, 0xc1, ext, RAX);
+        emit(c, z < 64 ? z : 63);
+      }
+      else
+        op_reg(c, 0, 0x31, RAX, RAX);  // xor eax, eax
+    }
+    else if (ext == 7) {
+      op_reg(c, 1, 0x83, 7, RCX);  // cmp rcx, 63
+      emit(c, 63);
+      mov_imm(c, RDX, 63);
+      op_reg(c, 1, 0x0f40 | CC_A, RCX, RDX);  // cmova rcx, rdx
+      op_reg(c, 1, 0xd3, 7, RAX);             // sar rax, cl
+    }
+    else {
+      op_reg(c, 1, 0xd3, ext, RAX);  // shl or shr rax, cl
+      op_reg(c, 0, 0x31, RDX, RDX);
+      op_reg(c, 1, 0x83, 7, RCX);
+      emit(c, 63);
+      op_reg(c, 1, 0x0f40 | CC_A, RAX, RDX);  // cmova rax, rdx
+    }
+    break;
+  }
+  case NEG:
+  case NEGU:
+    mov_imm(c, RAX, y);
+    op_reg(c, 1, 0x29, RCX, RAX);
+    break;
+  }
+
+  put(c, x, RAX);
+}
+
+
+// Length of the block at pc, and whether it can be translated.
+static void scan(Machine *M, Block *B)
+{
+  uocta a = B->pc;
+
+  B->len = 0;
+  while (B->len < MAX_BLOCK && a / 4 < code_words(M)) {
+    unsigned op = fetch(M, a) >> 24;
+
+    if (!native_op(op))
+      break;
+    B->len++;
+    a += 4;
+    if (ends_block(op))
+      break;
+  }
+
+  B->native = B->len > 0;
+  if (!B->len)
+    B->len = 1;
+}
+
+
+static void flush(Jit *J)
+{
+  for (size_t i = 0; i < J->size; i++) {
+    free(J->blocks[i]);
+    J->blocks[i] = 0;
+  }
+  J->nblocks = 0;
+  J->free = J->start;
+  J->code_limit = 0;
+}
+
+
+// Translate block B, which can be. Returns its entry.
+static unsigned char *translate(Jit *J, Machine *M, Block *B)
+{
+  Code c;
+  int k, ended = 0;
+
+  scan(M, B);
+  if (!B->native)
+    return 0;
+  if (J->end - J->free < MAX_BLOCK_CODE)
+    return 0;
+
+  writable(J->free, J->free + MAX_BLOCK_CODE, 1);
+  c.p = J->free;
+  c.nfix = 0;
+  c.nmiss = 0;
+
+  // Take the steps of the block, or leave
+  op_mem(&c, 1, 0x81, 7, RBX, CTX(left));  // cmp [left], len
+  emit32(&c, B->len);
+  exit_if(&c, CC_B, -1);
+  op_mem(&c, 1, 0x81, 5, RBX, CTX(left));  // sub [left], len
+  emit32(&c, B->len);
+
+  uocta pc = B->pc;
+
+  for (k = 0; k < B->len && !ended; k++, pc += 4) {
+    utetra w = fetch(M, pc);
+    unsigned op = w >> 24, x = (w >> 16) & 0xff;
+
+    if (!ends_block(op)) {
+      translate_instr(&c, w, pc, k);
+      continue;
+    }
+
+    ended = 1;
+    if (op == GO || op == GOB) {
+      get(&c, RAX, x);
+      mov_imm(&c, RCX, 4 * (uocta) (w & 0xffff));
+      op_reg(&c, 1, op == GO ? 0x01 : 0x29, RCX, RAX);
+      mov_imm(&c, RCX, pc + 4);
+      put(&c, x, RCX);
+      op_mem(&c, 1, 0x89, RAX, RBX, CTX(pc));
+      leave(J, &c, EXIT_JUMP);
+    }
+    else if (op == JMP || op == JMPB)
+      chain_exit(J, &c, jump_target(w, pc));
+    else {
+      static const int cc[] = { CC_E, CC_NE, CC_G, CC_S, CC_NS, CC_LE };
+
+      get(&c, RAX, x);
+      op_reg(&c, 1, 0x85, RAX, RAX);  // test rax, rax
+      emit(&c, 0x0f);
+      emit(&c, 0x80 | cc[(op - JZ) / 2]);
+      emit32(&c, 0);
+      unsigned char *taken = c.p - 4;
+      chain_exit(J, &c, pc + 4);
+      patch(taken, c.p);
+      chain_exit(J, &c, jump_target(w, pc));
+    }
+  }
+  if (!ended)
+    chain_exit(J, &c, pc);
+
+  // Side exits, giving back the steps of the instructions not run
+  unsigned char *stub = 0;
+  for (int i = 0; i < c.nfix; i++) {
+    k = c.fix[i].k;
+    if (!i || k != c.fix[i - 1].k) {
+      stub = c.p;
+      if (k < 0) {
+        set_pc(&c, B->pc);
+        leave(J, &c, EXIT_JUMP);
+      }
+      else {
+        op_mem(&c, 1, 0x81, 0, RBX, CTX(left));  // add [left], len - k
+        emit32(&c, B->len - k);
+        set_pc(&c, B->pc + 4 * (uocta) k);
+        leave(J, &c, EXIT_SIDE);
+      }
+    }
+    patch(c.fix[i].at, stub);
+  }
+  for (int i = 0; i < c.nmiss; i++)
+    map_miss(&c, &c.miss[i]);
+
+  writable(J->free, J->free + MAX_BLOCK_CODE, 0);
+
+  unsigned char *entry = J->free;
+
+  J->free = c.p;
+  if (B->pc + 4 * (uocta) B->len > J->code_limit)
+    J->code_limit = B->pc + 4 * (uocta) B->len;
+
+  return entry;
+}
+
+
+static Jit *jit_create()
+{
+  unsigned char *region = mmap(0, REGION_SIZE, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (region == MAP_FAILED)
+    return 0;
+
+  Jit *J = emalloc(sizeof(Jit));
+  Code c;
+
+  memset(J, 0, sizeof(Jit));
+  J->region = region;
+  J->end = region + REGION_SIZE;
+  J->size = 1024;
+  J->blocks = calloc(J->size, sizeof(Block *));
+  if (!J->blocks)
+    die("Failed to allocate block table.");
+
+  // enter(ctx, entry): save the registers native code uses, load them
+  // and jump to entry, with the stack aligned for calls
+  c.p = region;
+  J->enter = (int (*)(Context *, const void *)) (void *) c.p;
+  emit(&c, 0x53);  // push rbx
+  emit(&c, 0x55);  // push rbp
+  emit(&c, 0x41);  // push r12
+  emit(&c, 0x54);
+  op_reg(&c, 1, 0x89, RDI, RBX);
+  op_mem(&c, 1, 0x8b, RBP, RBX, CTX(reg));
+  op_mem(&c, 1, 0x8b, R12, RBX, CTX(tlb_base));
+  op_reg(&c, 0, 0xff, 4, RSI);  // jmp rsi
+
+  // Leave, with the exit in eax
+  J->epilogue = c.p;
+  emit(&c, 0x41);  // pop r12
+  emit(&c, 0x5c);
+  emit(&c, 0x5d);  // pop rbp
+  emit(&c, 0x5b);  // pop rbx
+  emit(&c, 0xc3);
+
+  J->start = J->free = c.p;
+
+  // Without executable memory, leave everything to the interpreter
+  if (mprotect(region, REGION_SIZE, PROT_READ | PROT_EXEC)) {
+    munmap(region, REGION_SIZE);
+    free(J->blocks);
+    free(J);
+    return 0;
+  }
+
+  return J;
+}
+
+
+void jit_destroy(Jit *J)
+{
+  if (!J)
+    return;
+
+  flush(J);
+  free(J->blocks);
+  munmap(J->region, REGION_SIZE);
+  if (J->shadow) {
+    fclose(J->shadow->out);
+    sim_destroy(J->shadow);
+  }
+  free(J);
+}
+
+
+static size_t slot(Jit *J, uocta pc)
+{
+  size_t i = (size_t) ((pc >> 2) * 0x9e3779b97f4a7c15ull >> 32) & (J->size - 1);
+
+  while (J->blocks[i] && J->blocks[i]->pc != pc)
+    i = (i + 1) & (J->size - 1);
+  return i;
+}
+
+
+// The block at pc, or NULL if pc is not the address of a word.
+static Block *find(Jit *J, Machine *M, uocta pc)
+{
+  if ((pc & 3) || pc / 4 >= code_words(M))
+    return 0;
+
+  size_t i = slot(J, pc);
+
+  if (J->blocks[i])
+    return J->blocks[i];
+
+  Block *B = emalloc(sizeof(Block));
+
+  B->pc = pc;
+  B->count = 0;
+  B->entry = 0;
+  scan(M, B);
+  J->blocks[i] = B;
+
+  if (++J->nblocks * 2 > J->size) {
+    Block **old = J->blocks;
+    size_t n = J->size;
+
+    J->size *= 2;
+    J->blocks = calloc(J->size, sizeof(Block *));
+    if (!J->blocks)
+      die("Failed to grow block table.");
+    for (size_t j = 0; j < n; j++)
+      if (old[j])
+        J->blocks[slot(J, old[j]->pc)] = old[j];
+    free(old);
+  }
+
+  return B;
+}
+
+
+// Make the shadow machine a copy of M.
+static void sync_shadow(Jit *J, Machine *M)
+{
+  Machine *S = J->shadow;
+
+  if (!S) {
+    S = J->shadow = sim_create(M->memsize);
+    S->out = fopen("/dev/null", "w");
+    if (!S->out)
+      die("cannot open '/dev/null':");
+  }
+
+  vmem_copy(S->mem, M->mem);
+  S->tlb_page = VMEM_NO_PAGE;
+  memcpy(S->reg, M->reg, sizeof(M->reg));
+  S->rH = M->rH;
+  S->rR = M->rR;
+  S->pc = M->pc;
+  S->trap = M->trap;
+  S->ctx = M->ctx;
+  S->portable = M->portable;
+  sim_flush(S);
+}
+
+
+// Compare M with the shadow machine. Returns zero, with the error
+// message set, if they differ after where.
+static int same_state(Jit *J, Machine *M, const char *where)
+{
+  Machine *S = J->shadow;
+
+  if (S->pc != M->pc) {
+    set_error_msg("jit check: %s: pc %#llx, should be %#llx", where, M->pc,
+                  S->pc);
+    return 0;
+  }
+  for (int r = 0; r < 256; r++)
+    if (S->reg[r] != M->reg[r]) {
+      set_error_msg("jit check: %s: $%d is %#llx, should be %#llx", where, r,
+                    M->reg[r], S->reg[r]);
+      return 0;
+    }
+  if (S->rH != M->rH || S->rR != M->rR) {
+    set_error_msg("jit check: %s: rH or rR differs", where);
+    return 0;
+  }
+
+  return 1;
+}
+
+// Run the shadow machine as far as the block B run natively, and
+// compare.
+static int check_block(Jit *J, Machine *M, const Block *B, uocta steps)
+{
+  char where[32];
+
+  sim_interpret(J->shadow, steps);
+  snprintf(where, sizeof(where), "block at %#llx", B->pc);
+  return same_state(J, M, where);
+}
+
+
+// Interpret at most steps instructions, and as many in the shadow
+// machine if checking.
+static int interpret(Jit *J, Machine *M, uocta steps, uocta *left,
+                     int check)
+{
+  uocta before = M->steps;
+  int result = sim_interpret(M, steps);
+  uocta done = M->steps - before;
+
+  *left -= done;
+  if (check && done)
+    sim_interpret(J->shadow, done);
+  return result;
+}
+
+
+int jit_available()
+{
+  return 1;
+}
+
+
+int jit_run(Machine *M, uocta max_steps)
+{
+  if (!M->jit && !(M->jit = jit_create()))
+    return sim_interpret(M, max_steps);
+
+  Jit *J = M->jit;
+  int check = M->tier == SIM_JIT_CHECK;
+  uocta left = max_steps ? max_steps : ~(uocta) 0;
+  Context ctx;
+  int result;
+
+  if (check)
+    sync_shadow(J, M);
+
+  ctx.reg = M->reg;
+  ctx.mem = M->mem;
+  ctx.tlb_page = VMEM_NO_PAGE;
+  ctx.tlb_base = 0;
+  for (int i = 0; i < 4; i++)
+    ctx.limit[i] = M->memsize - (1 << i);
+
+  for (;;) {
+    if (M->code_writes != J->code_writes) {
+      flush(J);
+      J->code_writes = M->code_writes;
+    }
+    if (!left) {
+      result = SIM_LIMIT;
+      break;
+    }
+
+    Block *B = find(J, M, M->pc);
+
+    if (B && B->native && !B->entry && B->count >= JIT_HOT
+        && !(B->entry = translate(J, M, B))) {
+      // Out of room: start again
+      flush(J);
+      continue;
+    }
+
+    if (!B || !B->entry || (uocta) B->len > left) {
+      if (B)
+        B->count++;
+      result = interpret(J, M, B && (uocta) B->len < left ? B->len : left,
+                         &left, check);
+      if (result != SIM_LIMIT)
+        break;
+      continue;
+    }
+
+    ctx.left = left;
+    ctx.pc = M->pc;
+    ctx.code_limit = J->code_limit;
+    ctx.decoded = M->decoded;
+    ctx.decoded_limit = 4 * M->ndecoded;
+
+    int status = J->enter(&ctx, B->entry);
+    uocta done = left - ctx.left;
+
+    M->steps += done;
+    M->native_steps += done;
+    M->pc = ctx.pc;
+    left = ctx.left;
+
+    if (check && done && !check_block(J, M, B, done)) {
+      result = SIM_FAULT;
+      break;
+    }
+
+    if (status == EXIT_SIDE) {
+      result = interpret(J, M, 1, &left, check);
+      if (result != SIM_LIMIT)
+        break;
+    }
+    else if (status == EXIT_CHAIN && !check) {
+      Block *T = find(J, M, M->pc);
+
+      if (T && T->entry) {
+        writable(ctx.stub + 1, ctx.stub + 5, 1);
+        patch(ctx.stub + 1, T->entry);
+        writable(ctx.stub + 1, ctx.stub + 5, 0);
+      }
+    }
+  }
+
+  // The shadow machine has run everything M did
+  if (check && result != SIM_FAULT) {
+    if (!same_state(J, M, "end of run"))
+      result = SIM_FAULT;
+    else if (!vmem_equal(J->shadow->mem, M->mem)) {
+      set_error_msg("jit check: memory differs");
+      result = SIM_FAULT;
+    }
+  }
+
+  return result;
+}
+
+#else
+
+int jit_available()
+{
+  return 0;
+}
+
+int jit_run(Machine *M, uocta max_steps)
+{
+  return sim_interpret(M, max_steps);
+}
+
+void jit_destroy(Jit *J)
+{
+}
+
+#endif
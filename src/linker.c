@@ -0,0 +1,439 @@
+/*
+  linker.c
+*/
+
+#include "linker.h"
+#include "encoder.h"
+#include "error.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Messages about one object, in the order found.
+typedef struct {
+  char **msgs;
+  int n, max;
+} Problems;
+
+// A phase of the link: work done on every object by a pool of threads.
+typedef struct phase_s {
+  Link *L;
+  Problems *problems;  // Of each object
+  int next;            // Next object, taken atomically
+  void (*work)(struct phase_s *P, int i);
+} Phase;
+
+
+static void report(Problems *p, const char *msg, ...)
+{
+  char buf[1024];
+  va_list args;
+
+  va_start(args, msg);
+  vsnprintf(buf, sizeof(buf), msg, args);
+  va_end(args);
+
+  if (p->n == p->max) {
+    p->max = p->max ? 2 * p->max : 4;
+    p->msgs = realloc(p->msgs, p->max * sizeof(char *));
+    if (!p->msgs)
+      die("Failed to grow error list.");
+  }
+  p->msgs[p->n++] = estrdup(buf);
+}
+
+
+// Name of object i for messages: its file, or else its source.
+static const char *object_name(const Phase *P, int i)
+{
+  if (P->L->names && P->L->names[i])
+    return P->L->names[i];
+
+  const Object *O = P->L->objects[i];
+
+  return obj_string(O, O->header->source);
+}
+
+
+static void *worker(void *arg)
+{
+  Phase *P = arg;
+  int i;
+
+  while ((i = __sync_fetch_and_add(&P->next, 1)) < P->L->nobjects)
+    P->work(P, i);
+
+  return 0;
+}
+
+
+// Run work on every object with nthreads threads, the caller being
+// one of them.
+static void run(Phase *P, void (*work)(Phase *P, int i), int nthreads)
+{
+  if (nthreads > P->L->nobjects)
+    nthreads = P->L->nobjects;
+
+  pthread_t *threads = emalloc((nthreads > 1 ? nthreads : 1)
+                               * sizeof(pthread_t));
+  int started = 0;
+
+  P->work = work;
+  P->next = 0;
+  for (; started < nthreads - 1; started++)
+    if (pthread_create(&threads[started], 0, worker, P))
+      break;
+  worker(P);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], 0);
+  free(threads);
+}
+
+
+static void load(Phase *P, int i)
+{
+  P->L->objects[i] = obj_open(P->L->names[i]);
+  if (!P->L->objects[i])
+    report(&P->problems[i], "%s", get_error_msg());
+}
+
+
+// Exported symbols go to the global table, each keeping the first of
+// the objects that define it.
+static void merge(Phase *P, int i)
+{
+  const Object *O = P->L->objects[i];
+
+  for (uint32_t k = 0; k < O->header->nsymbols; k++) {
+    const ObjSymbol *s = &O->symbols[k];
+
+    if ((s->flags & (OBJ_DEFINED | OBJ_EXPORTED))
+        != (OBJ_DEFINED | OBJ_EXPORTED))
+      continue;
+
+    EntryData *data = stable_insert(P->L->globals,
+                                    obj_string(O, s->name)).data;
+    uocta key = (uocta) (i + 1) << 32 | k;
+    uocta old = __atomic_load_n(&data->u, __ATOMIC_RELAXED);
+
+    while ((!old || key < old)
+           && !__atomic_compare_exchange_n(&data->u, &old, key, 1,
+                                           __ATOMIC_RELAXED,
+                                           __ATOMIC_RELAXED))
+      ;
+  }
+}
+
+
+// Address of the global symbol in data.
+static int global_address(const Link *L, const EntryData *data)
+{
+  int owner = (data->u >> 32) - 1;
+  uint32_t k = data->u & 0xffffffff;
+
+  return L->base[owner] + L->objects[owner]->symbols[k].addr;
+}
+
+
+// Copy the code of the object to its place and apply its relocations.
+static void resolve(Phase *P, int i)
+{
+  Link *L = P->L;
+  const Object *O = L->objects[i];
+  const ObjHeader *h = O->header;
+  Problems *p = &P->problems[i];
+  utetra *code = L->code + L->base[i];
+
+  memcpy(code, O->code, h->ncode * sizeof(utetra));
+
+  for (uint32_t k = 0; k < h->nsymbols; k++) {
+    const ObjSymbol *s = &O->symbols[k];
+    const char *name = obj_string(O, s->name);
+
+    if (!(s->flags & OBJ_DEFINED)) {
+      if (!stable_find(L->globals, name))
+        report(p, "%s: undefined symbol '%s'", object_name(P, i), name);
+    }
+    else if (s->flags & OBJ_EXPORTED) {
+      EntryData *data = stable_find(L->globals, name);
+      int owner = (data->u >> 32) - 1;
+
+      if (owner != i)
+        report(p, "%s: symbol '%s' already defined in %s",
+               object_name(P, i), name, object_name(P, owner));
+    }
+  }
+
+  for (uint32_t r = 0; r < h->nrelocs; r++) {
+    const ObjReloc *rel = &O->relocs[r];
+    const char *name = obj_string(O, O->symbols[rel->symbol].name);
+    EntryData *data = stable_find(L->globals, name);
+
+    if (!data)
+      continue;  // Reported above
+
+    int site = L->base[i] + rel->site;
+
+    if (!encode_patch(&L->code[site], global_address(L, data) - site))
+      report(p, "%s: word %u: jump to '%s' out of reach",
+             object_name(P, i), rel->site, name);
+  }
+}
+
+
+// Gather the problems of every object, in order.
+static void gather(Phase *P)
+{
+  Link *L = P->L;
+  int total = 0;
+
+  for (int i = 0; i < L->nobjects; i++)
+    total += P->problems[i].n;
+
+  L->errors = realloc(L->errors, (L->nerrors + total + 1) * sizeof(char *));
+  if (!L->errors)
+    die("Failed to grow error list.");
+
+  for (int i = 0; i < L->nobjects; i++) {
+    Problems *p = &P->problems[i];
+
+    memcpy(L->errors + L->nerrors, p->msgs, p->n * sizeof(char *));
+    L->nerrors += p->n;
+    free(p->msgs);
+    p->msgs = 0;
+    p->n = p->max = 0;
+  }
+}
+
+
+static Link *new_link(int n)
+{
+  Link *L = emalloc(sizeof(Link));
+
+  L->code = 0;
+  L->n = 0;
+  L->nobjects = n;
+  L->objects = emalloc((n + 1) * sizeof(Object *));
+  L->names = 0;
+  L->base = emalloc((n + 1) * sizeof(int));
+  L->archives = 0;
+  L->narchives = 0;
+  L->globals = stable_create_kind(STABLE_CONCURRENT);
+  L->errors = 0;
+  L->nerrors = 0;
+
+  return L;
+}
+
+
+// Objects of a link being gathered, with room for max.
+typedef struct {
+  Phase *P;
+  int max;
+  SymbolTable known;  // Symbols defined, or already looked up
+  unsigned char **pulled;  // Members of each archive in the link
+} Pull;
+
+
+// Mark the exported symbols of object i as defined.
+static void add_exports(Pull *U, int i)
+{
+  const Object *O = U->P->L->objects[i];
+
+  for (uint32_t k = 0; k < O->header->nsymbols; k++)
+    if ((O->symbols[k].flags & (OBJ_DEFINED | OBJ_EXPORTED))
+        == (OBJ_DEFINED | OBJ_EXPORTED))
+      stable_insert(U->known, obj_string(O, O->symbols[k].name));
+}
+
+
+// Add member k of archive a to the objects of the link.
+static void add_member(Pull *U, const char *arcname, int a, int k)
+{
+  Link *L = U->P->L;
+  const Archive *A = L->archives[a];
+
+  if (L->nobjects == U->max) {
+    U->max *= 2;
+    L->objects = realloc(L->objects, U->max * sizeof(Object *));
+    L->names = realloc(L->names, U->max * sizeof(char *));
+    L->base = realloc(L->base, U->max * sizeof(int));
+    U->P->problems = realloc(U->P->problems, U->max * sizeof(Problems));
+    if (!L->objects || !L->names || !L->base || !U->P->problems)
+      die("Failed to grow object list.");
+  }
+
+  const char *member = arc_string(A, A->members[k].name);
+  int i = L->nobjects++;
+
+  L->names[i] = emalloc(strlen(arcname) + strlen(member) + 3);
+  sprintf(L->names[i], "%s(%s)", arcname, member);
+  memset(&U->P->problems[i], 0, sizeof(Problems));
+
+  L->objects[i] = arc_member(A, k);
+  if (L->objects[i])
+    add_exports(U, i);
+  else
+    report(&U->P->problems[i], "%s", get_error_msg());
+}
+
+
+// Pull in the members of the archives that define the symbols the
+// objects leave undefined, and then those that the members leave
+// undefined, and so on. Each symbol is looked up once, through the
+// indexes.
+static void pull_members(Phase *P, char *const *arcnames)
+{
+  Link *L = P->L;
+  Pull U = { P, L->nobjects + 1, stable_create_kind(STABLE_HASH), 0 };
+
+  U.pulled = emalloc((L->narchives + 1) * sizeof(unsigned char *));
+  for (int a = 0; a < L->narchives; a++) {
+    U.pulled[a] = calloc(L->archives[a]->header->nmembers + 1, 1);
+    if (!U.pulled[a])
+      die("Failed to allocate member flags.");
+  }
+
+  for (int i = 0; i < L->nobjects; i++)
+    add_exports(&U, i);
+
+  for (int i = 0; i < L->nobjects; i++) {
+    const Object *O = L->objects[i];
+
+    for (uint32_t k = 0; O && k < O->header->nsymbols; k++) {
+      const char *name = obj_string(O, O->symbols[k].name);
+
+      if ((O->symbols[k].flags & OBJ_DEFINED)
+          || !stable_insert(U.known, name).new)
+        continue;
+
+      for (int a = 0; a < L->narchives; a++) {
+        int m = arc_lookup(L->archives[a], name);
+
+        if (m < 0)
+          continue;
+        if (!U.pulled[a][m]) {
+          U.pulled[a][m] = 1;
+          add_member(&U, arcnames[a], a, m);
+          O = L->objects[i];  // The list may have moved
+        }
+        break;
+      }
+    }
+  }
+
+  for (int a = 0; a < L->narchives; a++)
+    free(U.pulled[a]);
+  free(U.pulled);
+  stable_destroy(U.known);
+}
+
+
+// Link objects already loaded.
+static Link *link_loaded(Phase *P, int nthreads)
+{
+  Link *L = P->L;
+
+  L->n = 0;
+  for (int i = 0; i < L->nobjects; i++) {
+    L->base[i] = L->n;
+    L->n += L->objects[i]->header->ncode;
+  }
+  L->code = emalloc((L->n + 1) * sizeof(utetra));
+
+  run(P, merge, nthreads);
+  run(P, resolve, nthreads);
+  gather(P);
+  free(P->problems);
+
+  return L;
+}
+
+
+Link *link_files(char *const *names, int n, int nthreads)
+{
+  return link_archives(names, n, 0, 0, nthreads);
+}
+
+
+Link *link_archives(char *const *names, int n, char *const *archives,
+                    int narchives, int nthreads)
+{
+  Phase P;
+  Link *L = new_link(n);
+
+  P.L = L;
+  P.problems = calloc(n + 1, sizeof(Problems));
+  if (!P.problems)
+    die("Failed to allocate error lists.");
+
+  L->names = emalloc((n + 1) * sizeof(char *));
+  for (int i = 0; i < n; i++)
+    L->names[i] = estrdup(names[i]);
+
+  run(&P, load, nthreads);
+  gather(&P);
+
+  L->archives = emalloc((narchives + 1) * sizeof(Archive *));
+  for (int a = 0; a < narchives && !L->nerrors; a++) {
+    L->archives[a] = arc_open(archives[a]);
+    if (!L->archives[a]) {
+      L->errors = realloc(L->errors, (L->nerrors + 1) * sizeof(char *));
+      if (!L->errors)
+        die("Failed to grow error list.");
+      L->errors[L->nerrors++] = estrdup(get_error_msg());
+    }
+    else
+      L->narchives++;
+  }
+
+  if (!L->nerrors) {
+    pull_members(&P, archives);
+    gather(&P);
+  }
+  if (L->nerrors) {
+    free(P.problems);
+    return L;
+  }
+
+  return link_loaded(&P, nthreads);
+}
+
+
+Link *link_objects(Object **objects, int n, int nthreads)
+{
+  Phase P;
+
+  P.L = new_link(n);
+  memcpy(P.L->objects, objects, n * sizeof(Object *));
+  P.problems = calloc(n + 1, sizeof(Problems));
+  if (!P.problems)
+    die("Failed to allocate error lists.");
+
+  return link_loaded(&P, nthreads);
+}
+
+
+void link_destroy(Link *L)
+{
+  for (int i = 0; i < L->nobjects; i++) {
+    if (L->objects[i])
+      obj_close(L->objects[i]);
+    if (L->names)
+      free(L->names[i]);
+  }
+  for (int a = 0; a < L->narchives; a++)
+    arc_close(L->archives[a]);
+  for (int i = 0; i < L->nerrors; i++)
+    free(L->errors[i]);
+  free(L->archives);
+  free(L->errors);
+  free(L->objects);
+  free(L->names);
+  free(L->base);
+  free(L->code);
+  stable_destroy(L->globals);
+  free(L);
+}
@@ -0,0 +1,486 @@
+/*
+  lsource.c
+*/
+
+#define _DEFAULT_SOURCE
+
+#include "lsource.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+// Size of the blocks read by streaming sources.
+#define READ_BLOCK 65536
+
+// Room kept in front of the data of a read-ahead block, where the
+// unconsumed end of the previous block is copied when the block is
+// taken.
+#define KEEP 4096
+
+// Size of read-ahead blocks, and of the buffer of a source using them.
+#define RA_SIZE (KEEP + READ_BLOCK + 1)
+
+// Background reader: a producer thread reads blocks into a ring, from
+// which fill takes them. fill swaps the buffer of the source with the
+// block it takes, so data is not copied out of the ring.
+typedef struct {
+  pthread_t thread;
+  int fd;
+
+  // Protects the counters and stop; the producer waits on emptied for
+  // room in the ring, the consumer on filled for a block.
+  pthread_mutex_t lock;
+  pthread_cond_t filled, emptied;
+
+  int nblocks;
+  char **blocks;  // Data of block i starts at blocks[i] + KEEP
+  ssize_t *lens;  // Bytes in each block; zero marks the end of input
+
+  // Blocks produced and consumed so far; the ring is full when
+  // head - tail == nblocks.
+  unsigned long head, tail;
+
+  // Set by lsource_close, which also writes to the wake pipe, so that
+  // a producer waiting for input stops too.
+  int stop;
+  int wake[2];
+} ReadAhead;
+
+struct lsource_s {
+  int fd;
+  int own_fd;  // Close fd with the source?
+
+  // Memory mapping, if any, with its total length.
+  char *map;
+  size_t maplen;
+
+  // Input data: characters [pos, len) of buf are not consumed yet,
+  // and buf[len] is NUL. For a mapping, buf is the mapping and len the
+  // size of the file.
+  char *buf;
+  size_t pos, len, max;
+
+  // No more data to read?
+  int eof;
+
+  // Background reader, if started.
+  ReadAhead *ra;
+};
+
+
+// Is c a space in the "C" locale?
+static int is_space(char c)
+{
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+
+// Try to map the open file from offset start. The mapping is followed
+// by at least one zero byte: either the zero-filled tail of the last
+// page, or an extra page of an anonymous reservation placed under it.
+static int map_file(LineSource L, off_t start)
+{
+  struct stat st;
+
+  if (fstat(L->fd, &st) || !S_ISREG(st.st_mode) || st.st_size == 0
+      || start > st.st_size)
+    return 0;
+
+  size_t size = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t maplen = (size / page + 1) * page;
+
+  char *area = mmap(0, maplen, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (area == MAP_FAILED)
+    return 0;
+
+  if (mmap(area, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, L->fd, 0)
+      == MAP_FAILED) {
+    munmap(area, maplen);
+    return 0;
+  }
+
+  L->map = L->buf = area;
+  L->maplen = maplen;
+  L->pos = start;
+  L->len = size;
+  L->eof = 1;
+
+  return 1;
+}
+
+
+static LineSource lsource_fd(int fd, int own_fd, off_t start)
+{
+  LineSource L = emalloc(sizeof(struct lsource_s));
+
+  L->fd = fd;
+  L->own_fd = own_fd;
+  L->map = 0;
+  L->maplen = 0;
+  L->ra = 0;
+
+  if (!map_file(L, start)) {
+    L->max = READ_BLOCK + 1;
+    L->buf = emalloc(L->max);
+    L->buf[0] = 0;
+    L->pos = L->len = 0;
+    L->eof = 0;
+  }
+
+  return L;
+}
+
+
+LineSource lsource_open(const char *name)
+{
+  if (!name || !strcmp(name, "-"))
+    return lsource_fd(0, 0, 0);
+
+  int fd = open(name, O_RDONLY);
+
+  if (fd < 0)
+    return 0;
+
+  return lsource_fd(fd, 1, 0);
+}
+
+
+LineSource lsource_file(FILE *file)
+{
+  int fd = fileno(file);
+  off_t start = ftell(file);
+
+  // The stream may have read ahead of its position.
+  if (start >= 0)
+    lseek(fd, start, SEEK_SET);
+  else
+    start = 0;
+
+  return lsource_fd(fd, 0, start);
+}
+
+
+// Wait until fd has input, or until the source is closed. Returns
+// zero in the latter case.
+static int wait_input(ReadAhead *ra)
+{
+  struct pollfd fds[2] = {
+    { .fd = ra->fd, .events = POLLIN },
+    { .fd = ra->wake[0], .events = POLLIN }
+  };
+
+  while (poll(fds, 2, -1) < 0)
+    if (errno != EINTR)
+      return 1;  // Let read report the problem
+
+  return !fds[1].revents;
+}
+
+
+static void *producer(void *arg)
+{
+  ReadAhead *ra = arg;
+
+  while (1) {
+    pthread_mutex_lock(&ra->lock);
+    while (ra->head - ra->tail == (unsigned long) ra->nblocks && !ra->stop)
+      pthread_cond_wait(&ra->emptied, &ra->lock);
+
+    int slot = ra->head % ra->nblocks;
+    char *block = ra->blocks[slot];
+    int stop = ra->stop;
+
+    pthread_mutex_unlock(&ra->lock);
+
+    if (stop || !wait_input(ra))
+      return 0;
+
+    ssize_t n;
+
+    do
+      n = read(ra->fd, block + KEEP, READ_BLOCK);
+    while (n < 0 && errno == EINTR);
+
+    pthread_mutex_lock(&ra->lock);
+    ra->lens[slot] = n > 0 ? n : 0;
+    ra->head++;
+    pthread_cond_signal(&ra->filled);
+    pthread_mutex_unlock(&ra->lock);
+
+    if (n <= 0)
+      return 0;
+  }
+}
+
+
+// Make the next block of the ring the buffer of L, in front of the
+// unconsumed data, and give the old buffer to the ring. If that data
+// does not fit in front of the block, it is copied into the buffer of
+// L instead. Returns the size of the block.
+static ssize_t take_block(LineSource L)
+{
+  ReadAhead *ra = L->ra;
+
+  pthread_mutex_lock(&ra->lock);
+  while (ra->head == ra->tail)
+    pthread_cond_wait(&ra->filled, &ra->lock);
+
+  int slot = ra->tail % ra->nblocks;
+  ssize_t n = ra->lens[slot];
+
+  pthread_mutex_unlock(&ra->lock);
+
+  char *block = ra->blocks[slot];
+  size_t left = L->len - L->pos;
+
+  if (left <= KEEP) {
+    memcpy(block + KEEP - left, L->buf + L->pos, left);
+    ra->blocks[slot] = L->buf;
+    L->buf = block;
+    L->max = RA_SIZE;
+    L->pos = KEEP - left;
+    L->len = KEEP;
+  }
+  else {
+    // A long line: grow the buffer as fill does without read-ahead.
+    if (L->pos) {
+      memmove(L->buf, L->buf + L->pos, left);
+      L->len = left;
+      L->pos = 0;
+    }
+    if (L->max - L->len < (size_t) n + 1) {
+      L->max = L->len + READ_BLOCK + 1;
+      L->buf = realloc(L->buf, L->max);
+      if (!L->buf)
+        die("Failed to grow input buffer.");
+    }
+    memcpy(L->buf + L->len, block + KEEP, n);
+  }
+
+  pthread_mutex_lock(&ra->lock);
+  ra->tail++;
+  pthread_cond_signal(&ra->emptied);
+  pthread_mutex_unlock(&ra->lock);
+
+  return n;
+}
+
+
+static void free_readahead(ReadAhead *ra)
+{
+  for (int i = 0; i < ra->nblocks; i++)
+    free(ra->blocks[i]);
+  free(ra->blocks);
+  free(ra->lens);
+  pthread_mutex_destroy(&ra->lock);
+  pthread_cond_destroy(&ra->filled);
+  pthread_cond_destroy(&ra->emptied);
+  close(ra->wake[0]);
+  close(ra->wake[1]);
+  free(ra);
+}
+
+
+int lsource_readahead(LineSource L, int nblocks)
+{
+  if (L->map || L->ra || L->eof)
+    return 0;
+
+  if (nblocks < 2)
+    nblocks = 2;
+
+  ReadAhead *ra = emalloc(sizeof(ReadAhead));
+
+  if (pipe(ra->wake)) {
+    free(ra);
+    return 0;
+  }
+
+  ra->fd = L->fd;
+  ra->nblocks = nblocks;
+  ra->blocks = emalloc(nblocks * sizeof(char *));
+  ra->lens = emalloc(nblocks * sizeof(ssize_t));
+  for (int i = 0; i < nblocks; i++)
+    ra->blocks[i] = emalloc(RA_SIZE);
+  ra->head = ra->tail = 0;
+  ra->stop = 0;
+  pthread_mutex_init(&ra->lock, 0);
+  pthread_cond_init(&ra->filled, 0);
+  pthread_cond_init(&ra->emptied, 0);
+
+  if (pthread_create(&ra->thread, 0, producer, ra)) {
+    free_readahead(ra);
+    return 0;
+  }
+
+  // The buffer of the source is swapped with blocks of the ring.
+  if (L->max < RA_SIZE) {
+    L->max = RA_SIZE;
+    L->buf = realloc(L->buf, L->max);
+    if (!L->buf)
+      die("Failed to grow input buffer.");
+  }
+
+  L->ra = ra;
+  return 1;
+}
+
+
+void lsource_close(LineSource L)
+{
+  if (L->ra) {
+    ReadAhead *ra = L->ra;
+
+    // The producer may be waiting for room or for input.
+    pthread_mutex_lock(&ra->lock);
+    ra->stop = 1;
+    pthread_cond_signal(&ra->emptied);
+    pthread_mutex_unlock(&ra->lock);
+    while (write(ra->wake[1], "", 1) < 0 && errno == EINTR)
+      ;
+    pthread_join(ra->thread, 0);
+
+    free_readahead(ra);
+  }
+
+  if (L->map)
+    munmap(L->map, L->maplen);
+  else
+    free(L->buf);
+
+  if (L->own_fd)
+    close(L->fd);
+
+  free(L);
+}
+
+
+int lsource_mapped(LineSource L)
+{
+  return L->map != 0;
+}
+
+
+// Read more input after the unconsumed data, which may move: to the
+// start of the buffer or, reading ahead, into the next block. Returns
+// zero at end of input.
+static int fill(LineSource L)
+{
+  if (L->eof)
+    return 0;
+
+  ssize_t n;
+
+  if (L->ra)
+    n = take_block(L);
+  else {
+    if (L->pos) {
+      memmove(L->buf, L->buf + L->pos, L->len - L->pos);
+      L->len -= L->pos;
+      L->pos = 0;
+    }
+
+    // Keep room for a whole block and the final NUL.
+    if (L->max - L->len < READ_BLOCK + 1) {
+      L->max = L->len + READ_BLOCK + 1;
+      L->buf = realloc(L->buf, L->max);
+      if (!L->buf)
+        die("Failed to grow input buffer.");
+    }
+
+    do
+      n = read(L->fd, L->buf + L->len, READ_BLOCK);
+    while (n < 0 && errno == EINTR);
+  }
+
+  if (n <= 0) {
+    L->eof = 1;
+    n = 0;
+  }
+
+  L->len += n;
+  L->buf[L->len] = 0;
+
+  return n > 0;
+}
+
+
+const char *lsource_line(LineSource L, int *len)
+{
+  size_t scanned = 0;
+
+  while (1) {
+    char *start = L->buf + L->pos;
+    char *nl = memchr(start + scanned, '\n', L->len - L->pos - scanned);
+
+    if (nl) {
+      *len = nl - start + 1;
+      L->pos += *len;
+      return start;
+    }
+
+    scanned = L->len - L->pos;
+    if (!fill(L))
+      break;
+  }
+
+  // Last line, without a newline.
+  if (L->pos == L->len)
+    return 0;
+
+  *len = L->len - L->pos;
+  L->pos = L->len;
+  return L->buf + L->pos - *len;
+}
+
+
+const char *lsource_word(LineSource L, int *len)
+{
+  // Skip spaces.
+  while (1) {
+    while (L->pos < L->len && is_space(L->buf[L->pos]))
+      L->pos++;
+    if (L->pos < L->len || !fill(L))
+      break;
+  }
+
+  if (L->pos == L->len)
+    return 0;
+
+  size_t n = 0;
+  while (1) {
+    while (L->pos + n < L->len && !is_space(L->buf[L->pos + n]))
+      n++;
+    if (L->pos + n < L->len || !fill(L))
+      break;
+  }
+
+  *len = n;
+  L->pos += n;
+  return L->buf + L->pos - n;
+}
+
+
+const char *lsource_text(LineSource L, size_t *len)
+{
+  while (fill(L))
+    ;
+
+  const char *ret = L->buf + L->pos;
+
+  *len = L->len - L->pos;
+  L->pos = L->len;
+  return ret;
+}
@@ -0,0 +1,108 @@
+/*
+  mkophash.c
+
+  Build-time generator of the perfect hash index over operator names
+  used by optable.c. Writes a C header to the standard output.
+
+  Each name (at most 8 characters) is packed into a 64-bit key, one
+  character per byte, so that the length and every character take
+  part in the hash and a key comparison is a single integer compare.
+  The hash of a key is the top OPHASH_BITS bits of key * OPHASH_MULT;
+  multipliers are tried until no two names collide.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mactypes.h"
+
+// Operator names, in table order.
+static const char *names[] = {
+#define OPERATOR(name, opcode, t1, t2, t3) name,
+#include "operators.def"
+#undef OPERATOR
+};
+
+static const int num_ops = sizeof(names) / sizeof(names[0]);
+
+// Number of bits of the hash; the index has 1 << HASH_BITS slots.
+#define HASH_BITS 8
+#define NSLOTS (1 << HASH_BITS)
+
+
+static uocta pack(const char *name)
+{
+  uocta key = 0;
+
+  for (int i = 0; name[i]; i++)
+    key |= (uocta) (unsigned char) name[i] << (8 * i);
+
+  return key;
+}
+
+
+// Next number of a fixed pseudo-random sequence (splitmix64), so that
+// the output is the same on every build.
+static uocta next_random(uocta *state)
+{
+  uocta z = (*state += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+
+  return z ^ (z >> 31);
+}
+
+
+int main()
+{
+  uocta keys[NSLOTS];
+  int index[NSLOTS];
+  uocta state = 0, mult = 0;
+
+  for (int i = 0; i < num_ops; i++)
+    if (strlen(names[i]) > 8 || !*names[i]) {
+      fprintf(stderr, "mkophash: bad operator name \"%s\".\n", names[i]);
+      return 1;
+    }
+
+  for (int tries = 0;; tries++) {
+    if (tries == 1000000) {
+      fprintf(stderr, "mkophash: no perfect hash found.\n");
+      return 1;
+    }
+
+    mult = next_random(&state) | 1;
+    memset(keys, 0, sizeof(keys));
+
+    int i;
+    for (i = 0; i < num_ops; i++) {
+      uocta key = pack(names[i]);
+      int h = (key * mult) >> (64 - HASH_BITS);
+
+      if (keys[h]) break;
+      keys[h] = key;
+      index[h] = i;
+    }
+
+    if (i == num_ops) break;
+  }
+
+  printf("/*\n  ophash.h\n\n  Generated by mkophash. Do not edit.\n*/\n\n");
+  printf("#define OPHASH_BITS %d\n", HASH_BITS);
+  printf("#define OPHASH_MULT 0x%016llxULL\n\n", mult);
+
+  printf("// Packed name of the operator in each slot, or zero.\n");
+  printf("static const uocta ophash_keys[%d] = {\n", NSLOTS);
+  for (int h = 0; h < NSLOTS; h++)
+    printf("  0x%016llxULL,\n", keys[h]);
+  printf("};\n\n");
+
+  printf("// Index in the operator table of the operator in each slot.\n");
+  printf("static const unsigned char ophash_index[%d] = {\n", NSLOTS);
+  for (int h = 0; h < NSLOTS; h++)
+    printf("  %d,\n", keys[h] ? index[h] : 0);
+  printf("};\n");
+
+  return 0;
+}
@@ -0,0 +1,293 @@
+/*
+  objcache.c
+*/
+
+#define _DEFAULT_SOURCE
+
+#include "objcache.h"
+#include "object.h"
+#include "optable.h"
+#include "error.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Entries are named by their key and this suffix.
+#define SUFFIX ".mo"
+
+struct objcache_s {
+  char *dir;
+  size_t max;
+  size_t bytes;  // Taken by the entries
+};
+
+
+// Path of the entry of key.
+static char *entry_path(ObjCache C, const char *key)
+{
+  char *path = emalloc(strlen(C->dir) + CACHE_KEY_LEN + sizeof(SUFFIX) + 2);
+
+  sprintf(path, "%s/%s%s", C->dir, key, SUFFIX);
+  return path;
+}
+
+
+// Is name that of an entry?
+static int is_entry(const char *name)
+{
+  return strlen(name) == CACHE_KEY_LEN + strlen(SUFFIX)
+         && !strcmp(name + CACHE_KEY_LEN, SUFFIX);
+}
+
+
+// An entry, for eviction.
+typedef struct {
+  char *name;
+  size_t size;
+  struct timespec used;
+} Entry;
+
+static int compare_used(const void *a, const void *b)
+{
+  const Entry *x = a, *y = b;
+
+  if (x->used.tv_sec != y->used.tv_sec)
+    return (x->used.tv_sec > y->used.tv_sec)
+           - (x->used.tv_sec < y->used.tv_sec);
+  if (x->used.tv_nsec != y->used.tv_nsec)
+    return (x->used.tv_nsec > y->used.tv_nsec)
+           - (x->used.tv_nsec < y->used.tv_nsec);
+  return strcmp(x->name, y->name);
+}
+
+
+// Sum the sizes of the entries and, if evict is set and they exceed
+// the maximum, remove the least recently used ones. The time of last
+// use of an entry is its modification time, which cache_get updates.
+static int scan(ObjCache C, int evict)
+{
+  DIR *d = opendir(C->dir);
+  struct dirent *de;
+  Entry *entries = 0;
+  int n = 0, max = 0;
+  int fd = d ? dirfd(d) : -1;
+
+  if (!d) {
+    set_error_msg("cannot read cache '%s':", C->dir);
+    return 0;
+  }
+
+  C->bytes = 0;
+  while ((de = readdir(d))) {
+    struct stat st;
+
+    if (!is_entry(de->d_name) || fstatat(fd, de->d_name, &st, 0))
+      continue;
+    if (n == max) {
+      max = max ? 2 * max : 64;
+      entries = realloc(entries, max * sizeof(Entry));
+      if (!entries)
+        die("Failed to grow cache entry list.");
+    }
+    entries[n].name = estrdup(de->d_name);
+    entries[n].size = st.st_size;
+    entries[n++].used = st.st_mtim;
+    C->bytes += st.st_size;
+  }
+
+  if (evict && C->bytes > C->max) {
+    qsort(entries, n, sizeof(Entry), compare_used);
+    for (int i = 0; i < n && C->bytes > C->max / 4 * 3; i++)
+      if (!unlinkat(fd, entries[i].name, 0))
+        C->bytes -= entries[i].size;
+  }
+
+  for (int i = 0; i < n; i++)
+    free(entries[i].name);
+  free(entries);
+  closedir(d);
+
+  return 1;
+}
+
+
+ObjCache cache_open(const char *dir, size_t max_bytes)
+{
+  if (mkdir(dir, 0777) && errno != EEXIST) {
+    set_error_msg("cannot create cache '%s':", dir);
+    return 0;
+  }
+
+  ObjCache C = emalloc(sizeof(struct objcache_s));
+
+  C->dir = estrdup(dir);
+  C->max = max_bytes;
+  if (!scan(C, 0)) {
+    cache_close(C);
+    return 0;
+  }
+
+  return C;
+}
+
+
+void cache_close(ObjCache C)
+{
+  free(C->dir);
+  free(C);
+}
+
+
+size_t cache_bytes(ObjCache C)
+{
+  return C->bytes;
+}
+
+
+// A hash of two 64-bit lanes, fed 8 bytes at a time.
+typedef struct {
+  uocta a, b;
+} Hash;
+
+static uocta rotl(uocta x, int r)
+{
+  return x << r | x >> (64 - r);
+}
+
+static void feed(Hash *h, uocta w)
+{
+  h->a = rotl((h->a ^ w) * 0x9e3779b97f4a7c15ull, 31);
+  h->b = rotl((h->b ^ w) * 0xc2b2ae3d27d4eb4full, 29) + h->a;
+}
+
+static void feed_bytes(Hash *h, const char *s, size_t len)
+{
+  uocta w;
+
+  for (; len >= 8; s += 8, len -= 8) {
+    memcpy(&w, s, 8);
+    feed(h, w);
+  }
+  w = 0;
+  memcpy(&w, s, len);
+  feed(h, w ^ (uocta) len << 56);
+}
+
+static uocta finish(uocta x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdull;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ull;
+  return x ^ x >> 33;
+}
+
+
+void cache_key(const char *src, size_t len, const char *source,
+               const char *options, char *key)
+{
+  Hash h = { 0x243f6a8885a308d3ull, 0x13198a2e03707344ull };
+
+  feed_bytes(&h, src, len);
+  feed(&h, len);
+  feed_bytes(&h, source ? source : "", source ? strlen(source) : 0);
+  feed_bytes(&h, options ? options : "", options ? strlen(options) : 0);
+  feed(&h, optable_version());
+  feed(&h, (uocta) OBJ_VERSION << 32 | CACHE_VERSION);
+
+  sprintf(key, "%016llx%016llx", finish(h.a ^ h.b), finish(h.b));
+}
+
+
+// Copy the entry at path to dest, when it cannot be linked. Returns
+// zero on error, with the error message set.
+static int copy_entry(const char *path, const char *dest)
+{
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st)) {
+    set_error_msg("cannot read cache entry '%s':", path);
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+
+  char *buf = emalloc(st.st_size + 1);
+  size_t done = 0;
+  ssize_t n = 0;
+
+  while (done < (size_t) st.st_size
+         && (n = read(fd, buf + done, st.st_size - done)) > 0)
+    done += n;
+  close(fd);
+
+  int ok = done == (size_t) st.st_size;
+
+  if (!ok)
+    set_error_msg("cannot read cache entry '%s':", path);
+  else
+    ok = obj_save(buf, done, dest);
+  free(buf);
+
+  return ok;
+}
+
+
+int cache_get(ObjCache C, const char *key, const char *dest)
+{
+  char *path = entry_path(C, key);
+  char *tmp = emalloc(strlen(dest) + 32);
+  int result;
+
+  // Link under a name of our own and rename, to replace dest at once
+  sprintf(tmp, "%s.%ld.link", dest, (long) getpid());
+  unlink(tmp);
+
+  if (!link(path, tmp)) {
+    result = 1;
+    if (rename(tmp, dest)) {
+      set_error_msg("cannot write '%s':", dest);
+      unlink(tmp);
+      result = -1;
+    }
+  }
+  else if (access(path, F_OK))
+    result = 0;
+  else
+    result = copy_entry(path, dest) ? 1 : -1;
+
+  // Mark the entry as just used
+  if (result > 0)
+    utimensat(AT_FDCWD, path, 0, 0);
+
+  free(tmp);
+  free(path);
+  return result;
+}
+
+
+int cache_put(ObjCache C, const char *key, const void *image, size_t size)
+{
+  char *path = entry_path(C, key);
+  struct stat st;
+
+  // Another build may have stored it meanwhile
+  int replaced = !stat(path, &st);
+  int ok = obj_save(image, size, path);
+
+  free(path);
+  if (!ok)
+    return 0;
+
+  C->bytes += size - (replaced ? st.st_size : 0);
+  if (C->bytes > C->max)
+    return scan(C, 1);
+
+  return 1;
+}
@@ -0,0 +1,385 @@
+/*
+  object.c
+*/
+
+#define _DEFAULT_SOURCE
+
+#include "object.h"
+#include "error.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define le32(x) __builtin_bswap32(x)
+#else
+#define le32(x) (x)
+#endif
+
+
+uint32_t obj_hash(const char *name)
+{
+  // FNV-1a
+  uint32_t h = 2166136261u;
+
+  for (; *name; name++)
+    h = (h ^ (unsigned char) *name) * 16777619u;
+
+  return h;
+}
+
+
+static uint32_t align(size_t offset)
+{
+  return (offset + OBJ_ALIGN - 1) & ~(size_t) (OBJ_ALIGN - 1);
+}
+
+
+// A string pool being built.
+typedef struct {
+  char *buf;
+  size_t len, max;
+} Pool;
+
+static uint32_t pool_add(Pool *P, const char *s)
+{
+  size_t n = strlen(s) + 1;
+  uint32_t offset = P->len;
+
+  if (P->len + n > P->max) {
+    while (P->len + n > P->max)
+      P->max *= 2;
+    P->buf = realloc(P->buf, P->max);
+    if (!P->buf)
+      die("Failed to grow string pool.");
+  }
+  memcpy(P->buf + P->len, s, n);
+  P->len += n;
+
+  return offset;
+}
+
+
+// Index of the symbol with the given name among n sorted by name.
+static uint32_t symbol_index(const ObjSymbol *syms, uint32_t n,
+                             const char *strings, const char *name)
+{
+  uint32_t a = 0, b = n;
+
+  while (a < b) {
+    uint32_t mid = a + (b - a) / 2;
+    int c = strcmp(strings + syms[mid].name, name);
+
+    if (!c)
+      return mid;
+    if (c < 0)
+      a = mid + 1;
+    else
+      b = mid;
+  }
+
+  return n;
+}
+
+
+void *obj_build(const Assembler *A, const char *source, size_t *size)
+{
+  Pool P = { emalloc(4096), 0, 4096 };
+  StableIter it = stable_iter_begin(A->symbols, 0);
+  const char *key;
+  EntryData *data;
+  uint32_t nsyms = 0, maxsyms = 64;
+  ObjSymbol *syms = emalloc(maxsyms * sizeof(ObjSymbol));
+
+  uint32_t src = pool_add(&P, source ? source : "");
+
+  // Symbols, in the order of the table: sorted by name
+  while (stable_iter_next(it, &key, &data)) {
+    const Symbol *sym = data->p;
+
+    if (nsyms == maxsyms) {
+      maxsyms *= 2;
+      syms = realloc(syms, maxsyms * sizeof(ObjSymbol));
+      if (!syms)
+        die("Failed to grow symbol table.");
+    }
+    syms[nsyms].name = pool_add(&P, key);
+    syms[nsyms].hash = obj_hash(key);
+    syms[nsyms].addr = sym->addr >= 0 ? sym->addr : 0;
+    syms[nsyms++].flags = (sym->addr >= 0 ? OBJ_DEFINED : 0)
+                          | (sym->exported ? OBJ_EXPORTED : 0);
+  }
+  stable_iter_end(it);
+
+  ObjHeader h;
+
+  memset(&h, 0, sizeof(h));
+  h.magic = OBJ_MAGIC;
+  h.version = OBJ_VERSION;
+  h.source = src;
+  h.code = align(sizeof(ObjHeader));
+  h.ncode = A->n;
+  h.symbols = align(h.code + (size_t) h.ncode * sizeof(utetra));
+  h.nsymbols = nsyms;
+  h.relocs = align(h.symbols + (size_t) nsyms * sizeof(ObjSymbol));
+  h.nrelocs = A->nrelocs;
+  h.lines = align(h.relocs + (size_t) h.nrelocs * sizeof(ObjReloc));
+  h.nlines = A->nlines;
+  h.strings = align(h.lines + (size_t) h.nlines * sizeof(ObjLine));
+  h.nstrings = P.len;
+  h.size = align(h.strings + P.len);
+
+  char *image = calloc(h.size, 1);
+  if (!image)
+    die("Failed to allocate object image.");
+
+  utetra *code = (utetra *) (image + h.code);
+  for (uint32_t i = 0; i < h.ncode; i++)
+    code[i] = le32(A->code[i]);
+
+  ObjReloc *relocs = (ObjReloc *) (image + h.relocs);
+  for (uint32_t i = 0; i < h.nrelocs; i++) {
+    relocs[i].site = le32((uint32_t) A->relocs[i].site);
+    relocs[i].symbol = le32(symbol_index(syms, nsyms, P.buf,
+                                         A->relocs[i].name));
+  }
+
+  ObjSymbol *out = (ObjSymbol *) (image + h.symbols);
+  for (uint32_t i = 0; i < nsyms; i++) {
+    out[i].name = le32(syms[i].name);
+    out[i].hash = le32(syms[i].hash);
+    out[i].addr = le32(syms[i].addr);
+    out[i].flags = le32(syms[i].flags);
+  }
+
+  ObjLine *lines = (ObjLine *) (image + h.lines);
+  for (uint32_t i = 0; i < h.nlines; i++) {
+    lines[i].addr = le32((uint32_t) A->lines[i].addr);
+    lines[i].lineno = le32((uint32_t) A->lines[i].lineno);
+  }
+
+  memcpy(image + h.strings, P.buf, P.len);
+
+  *size = h.size;
+
+  uint32_t *words = (uint32_t *) &h;
+  for (size_t i = 0; i < sizeof(h) / sizeof(uint32_t); i++)
+    words[i] = le32(words[i]);
+  memcpy(image, &h, sizeof(h));
+
+  free(syms);
+  free(P.buf);
+
+  return image;
+}
+
+
+int obj_save(const void *image, size_t size, const char *name)
+{
+  static unsigned serial;
+  char *tmp = emalloc(strlen(name) + 32);
+
+  // A name of our own next to the file, so that rename is atomic
+  sprintf(tmp, "%s.%ld.%u", name, (long) getpid(),
+          __sync_fetch_and_add(&serial, 1));
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0666);
+
+  if (fd < 0) {
+    set_error_msg("cannot create '%s':", name);
+    free(tmp);
+    return 0;
+  }
+
+  size_t done = 0;
+
+  while (done < size) {
+    ssize_t n = write(fd, (const char *) image + done, size - done);
+
+    if (n > 0)
+      done += n;
+    else if (n == 0 || errno != EINTR)
+      break;
+  }
+
+  // The data must be on disk before the new name can be
+  int ok = done == size && !fsync(fd);
+
+  ok = !close(fd) && ok;
+  if (!ok || rename(tmp, name)) {
+    set_error_msg("cannot write '%s':", name);
+    unlink(tmp);
+    ok = 0;
+  }
+  free(tmp);
+
+  return ok;
+}
+
+
+int obj_write(const Assembler *A, const char *source, const char *name)
+{
+  size_t size;
+  char *image = obj_build(A, source, &size);
+  int ok = obj_save(image, size, name);
+
+  free(image);
+
+  return ok;
+}
+
+
+// Is the section at offset with n records of the given size within an
+// image of size bytes?
+static int section_ok(uint32_t offset, uint32_t n, size_t recsize,
+                      uint32_t size)
+{
+  return offset % OBJ_ALIGN == 0 && offset <= size
+         && n <= (size - offset) / recsize;
+}
+
+
+void obj_swap(void *image, size_t size)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  uint32_t *w = image;
+  size_t n = size / sizeof(uint32_t);
+
+  if (size >= sizeof(ObjHeader)
+      && le32(((ObjHeader *) image)->strings) / sizeof(uint32_t) < n)
+    n = le32(((ObjHeader *) image)->strings) / sizeof(uint32_t);
+  for (size_t i = 0; i < n; i++)
+    w[i] = le32(w[i]);
+#endif
+}
+
+
+Object *obj_view(const void *image, size_t size)
+{
+  const ObjHeader *h = image;
+
+  if ((uintptr_t) image % OBJ_ALIGN || size < sizeof(ObjHeader)
+      || h->magic != OBJ_MAGIC) {
+    set_error_msg("not an object file");
+    return 0;
+  }
+  if (h->version != OBJ_VERSION) {
+    set_error_msg("object file version %u, expected %u", h->version,
+                  OBJ_VERSION);
+    return 0;
+  }
+
+  if (h->size > size
+      || !section_ok(h->code, h->ncode, sizeof(utetra), h->size)
+      || !section_ok(h->symbols, h->nsymbols, sizeof(ObjSymbol), h->size)
+      || !section_ok(h->relocs, h->nrelocs, sizeof(ObjReloc), h->size)
+      || !section_ok(h->lines, h->nlines, sizeof(ObjLine), h->size)
+      || !section_ok(h->strings, h->nstrings, 1, h->size)
+      || !h->nstrings || h->source >= h->nstrings) {
+    set_error_msg("truncated or corrupt object file");
+    return 0;
+  }
+
+  Object *O = emalloc(sizeof(Object));
+
+  O->header = h;
+  O->code = (const utetra *) ((const char *) image + h->code);
+  O->symbols = (const ObjSymbol *) ((const char *) image + h->symbols);
+  O->relocs = (const ObjReloc *) ((const char *) image + h->relocs);
+  O->lines = (const ObjLine *) ((const char *) image + h->lines);
+  O->strings = (const char *) image + h->strings;
+  O->map = 0;
+  O->maplen = 0;
+
+  // Names must be within the strings, and the strings end in a NUL
+  int ok = O->strings[h->nstrings - 1] == 0;
+
+  for (uint32_t i = 0; ok && i < h->nsymbols; i++)
+    ok = O->symbols[i].name < h->nstrings;
+  for (uint32_t i = 0; ok && i < h->nrelocs; i++)
+    ok = O->relocs[i].symbol < h->nsymbols && O->relocs[i].site < h->ncode;
+
+  if (!ok) {
+    set_error_msg("truncated or corrupt object file");
+    free(O);
+    return 0;
+  }
+
+  return O;
+}
+
+
+Object *obj_open(const char *name)
+{
+  int fd = open(name, O_RDONLY);
+  struct stat st;
+
+  if (fd < 0 || fstat(fd, &st)) {
+    set_error_msg("cannot open '%s':", name);
+    if (fd >= 0)
+      close(fd);
+    return 0;
+  }
+
+  size_t size = st.st_size;
+  int prot = PROT_READ;
+
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  prot |= PROT_WRITE;
+#endif
+
+  void *map = size ? mmap(0, size, prot, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+
+  close(fd);
+  if (map == MAP_FAILED) {
+    set_error_msg(size ? "cannot map '%s':" : "'%s': not an object file",
+                  name);
+    return 0;
+  }
+
+  obj_swap(map, size);
+
+  Object *O = obj_view(map, size);
+
+  if (!O) {
+    char msg[1024];
+
+    snprintf(msg, sizeof(msg), "%s", get_error_msg());
+    set_error_msg("'%s': %s", name, msg);
+    munmap(map, size);
+    return 0;
+  }
+
+  O->map = map;
+  O->maplen = size;
+
+  return O;
+}
+
+
+void obj_close(Object *O)
+{
+  if (O->map)
+    munmap(O->map, O->maplen);
+  free(O);
+}
+
+
+const char *obj_string(const Object *O, uint32_t offset)
+{
+  return O->strings + offset;
+}
+
+
+const ObjSymbol *obj_find(const Object *O, const char *name)
+{
+  uint32_t n = O->header->nsymbols;
+  uint32_t k = symbol_index(O->symbols, n, O->strings, name);
+
+  return k < n ? &O->symbols[k] : 0;
+}
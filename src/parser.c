@@ -5,7 +5,9 @@
 #include "parser.h"
 #include "error.h"
 #include "optable.h"
+#include "scan.h"
 #include <ctype.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
 /* Returns size of command starting at w (until newline or semicolon)       *
@@ -17,10 +19,7 @@
  * Size of command fount at given pointer                                  */
 int getCommand(const char *c)
 {
-    int sz = 0;
-    for (; *c && *c != '*' && *c != '\n' && *c != ';'; c++)
-        sz++;
-    return sz;
+    return scan_command(c);
 }
 
 /* Returns the size of a word starting at w (until space, newline, comma or *
@@ -33,10 +32,7 @@ int getCommand(const char *c)
  * Size of word found at given pointer                                      */
 int getWord(const char *w)
 {
-    int sz = 0;
-    for (; *w && *w != '*' && !isspace(*w) && *w != ',' && *w != ';'; w++)
-        sz++;
-    return sz;
+    return scan_word(w);
 }
 
 /* Returns the pointer to the start of the next word, ignoring spaces,      *
@@ -49,166 +45,461 @@ int getWord(const char *w)
  * Pointer to the start of the next word                                    */
 const char *nextWord(const char *w)
 {
-    const char *ptr = w;
-    for (; *ptr && *ptr != '*' &&
-           (isspace(*ptr) || *ptr == ',' || *ptr == ';');
-         ptr++)
-        ;
+    const char *ptr = w + scan_skip(w);
 
     if (!*ptr)
         ptr = 0;
     return ptr;
 }
 
-/* Returns the pointer to the start of the next word, ignoring spaces,      *
- * newlines, commas, and semicolons                                         *
+/* Returns the word starting at w as a span of the source; no memory is     *
+ * allocated                                                                *
  *                                                                          *
  * Params:                                                                  *
- * w: Pointer to the start of the search                                    *
+ * w: Pointer to the start of the word, or NULL                             *
  *                                                                          *
  * Returns:                                                                 *
- * Pointer to the start of the next word                                    */
-const char *readWord(const char *w, int *wl)
+ * Span of the word (empty if w is NULL)                                    */
+Span readWord(const char *w)
 {
-    if (!w)
-        return 0;
-    int word_len = getWord(w);
-
-    if (wl)
-        *wl = word_len;
-    char *word = emalloc((word_len + 1) * sizeof(char));
-    for (int i = 0; i <= word_len; i++)
-        word[i] = w[i];
-
-    word[word_len] = 0;
+    Span word;
+    word.s = w;
+    word.len = w ? getWord(w) : 0;
     return word;
 }
 
-int operandType(const char *w)
+int operandType(Span w)
 {
-    if (!w)
+    if (!w.len)
         return 0;
-    if (w[0] == '$')
+    if (w.s[0] == '$')
         return REGISTER;
-    if (isdigit(w[0]) || (w[0] == 'h' && isdigit(w[1])))
+    if (isdigit(w.s[0]) || (w.len > 1 && w.s[0] == 'h' && isdigit(w.s[1])))
         return NUMBER_TYPE;
-    if (w[0] == '"')
+    if (w.s[0] == '"')
         return STRING;
     return LABEL;
 }
 
-Operand *makeOperand(const char *word, int word_len)
+/* Returns the value of the number in span w, starting at index i, in the  *
+ * given base; parsing stops at the first character that is not a digit    */
+static octa spanNumber(Span w, int i, int base)
+{
+    uocta num = 0;
+    for (; i < w.len; i++)
+    {
+        int d;
+        char c = w.s[i];
+        if (c >= '0' && c <= '9')
+            d = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f')
+            d = c - 'a' + 10;
+        else if (base == 16 && c >= 'A' && c <= 'F')
+            d = c - 'A' + 10;
+        else
+            break;
+        num = num * base + d;
+    }
+    return (octa)num;
+}
+
+Operand *makeOperand(Span word)
 {
     switch (operandType(word))
     {
     case REGISTER:
-    {
-        unsigned int reg;
-        sscanf(word, "$%u", &reg);
-        return operand_create_register(reg);
-        break;
-    }
+        return operand_create_register(spanNumber(word, 1, 10));
     case NUMBER_TYPE:
-    {
-        octa num;
-        if (word[0] == 'h')
-            sscanf(word, "h%llx", &num);
-        else
-            sscanf(word, "%lld", &num);
-        return operand_create_number(num);
-        break;
-    }
+        if (word.s[0] == 'h')
+            return operand_create_number(spanNumber(word, 1, 16));
+        return operand_create_number(spanNumber(word, 0, 10));
     case LABEL:
-    {
-        return operand_create_label(word);
-        break;
-    }
+        return operand_create_label_n(word.s, word.len);
     case STRING:
-        return operand_create_string(word);
-        break;
+        return operand_create_string_n(word.s, word.len);
     default:
         break;
     }
     return 0;
 }
 
-Instruction *parseCommand(const char *command, int sz)
+/* Returns the span of the word following word, within the command ending  *
+ * at end (empty if there is none)                                          */
+static Span followingWord(Span word, const char *end)
 {
-    printf("%s\n", command);
-    Instruction *instruction = (Instruction *)emalloc(sizeof(struct instruction_s));
+    const char *next = word.s ? nextWord(word.s + word.len) : 0;
+    if (next && next >= end)
+        next = 0;
+    return readWord(next);
+}
 
-    const Operator *op;
+/* Parses the command of sz characters starting at command                  *
+ *                                                                          *
+ * Returns:                                                                 *
+ * The instruction, or NULL if the command has no operator, in which case   *
+ * the error message is set and *where points to the word in error          */
+Instruction *parseCommand(const char *command, int sz, const char **where)
+{
+    const char *end = command + sz;
+    Operand *opds[3] = {0, 0, 0};
+    Span label = {0, 0};
 
-    // First word
-    int word_len;
-    const char *curr = nextWord(command);
-    const char *word = readWord(curr, &word_len);
+    // First word: operator, or label followed by the operator
+    Span word = readWord(nextWord(command));
+    const Operator *op = optable_find_span(word.s, word.len);
 
-    instruction->label = 0;
-    if (!(op = optable_find(word)))
+    if (!op)
     {
-        if (operandType(word) == LABEL)
+        if (operandType(word) != LABEL)
         {
-            instruction->label = (char *)emalloc((word_len + 1) * sizeof(char));
-            strcpy(instruction->label, word);
+            set_error_msg("'%.*s' is neither an operator nor a label",
+                          word.len, word.s);
+            *where = word.s;
+            return 0;
         }
-        else
+        label = word;
+
+        word = followingWord(word, end);
+        op = optable_find_span(word.s, word.len);
+        if (!op)
         {
-            printf("PROBLEMAS 1a palavra nao e operador nem label\n");
+            if (word.len)
+            {
+                set_error_msg("unknown operator '%.*s'", word.len, word.s);
+                *where = word.s;
+            }
+            else
+            {
+                set_error_msg("missing operator after label '%.*s'",
+                              label.len, label.s);
+                *where = label.s;
+            }
+            return 0;
         }
     }
-    free((char *)word);
-    curr += word_len;
 
-    // Second word, if first word wasn't operator
-    curr = nextWord(curr);
-    word = readWord(curr, &word_len);
+    // Remaining words
+    word = followingWord(word, end);
+    for (int i = 0; i < 3 && word.len; i++)
+    {
+        opds[i] = makeOperand(word);
+        word = followingWord(word, end);
+    }
+
+    // Only the label is copied out of the source line
+    Instruction *instruction = instr_create(0, op, opds);
+    if (label.len)
+        instruction->label = estrndup(label.s, label.len);
 
-    if (!op)
+    return instruction;
+}
+
+/* Substitutes aliases in the operands of an instruction and, if it is an  *
+ * IS, defines its label as an alias of its operand. Instructions must be   *
+ * resolved in source order                                                 *
+ *                                                                          *
+ * Params:                                                                  *
+ * instr: Instruction to resolve                                            *
+ * alias_table: Aliases defined so far                                      */
+void resolveAliases(Instruction *instr, SymbolTable alias_table)
+{
+    for (int i = 0; i < 3; i++)
     {
-        op = optable_find(word);
+        Operand *opd = instr->opds[i];
+        if (!opd || opd->type != LABEL)
+            continue;
 
-        free((char *)word);
-        curr += word_len;
-        curr = nextWord(curr);
-        word = readWord(curr, &word_len);
+        EntryData *alias = stable_find(alias_table, opd->value.label);
+        if (alias)
+        {
+            instr->opds[i] = operand_dup(alias->opd);
+            operand_destroy(opd);
+        }
     }
-    if (op)
-        instruction->op = op;
-    else
+
+    if (instr->op && instr->op->opcode == IS && instr->label && instr->opds[0])
     {
-        // PROBLEMAS Nenhuma das palavras anteriores é operador
+        InsertionResult res = stable_insert(alias_table, instr->label);
+        if (!res.new)
+            operand_destroy(res.data->opd);
+        res.data->opd = operand_dup(instr->opds[0]);
     }
+}
 
-    // Remaining words
-    for (int i = 0; i < 3 && curr && curr < command + sz; i++)
+/* Parses the commands of the line starting at line and ending at end (at   *
+ * its newline or at the end of the source), appending them to a list      *
+ *                                                                          *
+ * Params:                                                                  *
+ * line: Pointer to the start of the line                                   *
+ * end: Pointer to the end of the line                                      *
+ * lineno: Line number given to the instructions                            *
+ * tail: Pointer to the link where the next instruction goes; updated       *
+ * where: Where the position of an error is stored                          *
+ *                                                                          *
+ * Returns:                                                                 *
+ * Number of instructions parsed, or -1 if a command could not be parsed,   *
+ * in which case the error message is set and *where points to the error    */
+static int parseLine(const char *line, const char *end, int lineno,
+                     Instruction ***tail, const char **where)
+{
+    int count = 0;
+    const char *next = nextWord(line);
+
+    while (next && next < end)
     {
-        instruction->opds[i] = makeOperand(word, word_len);
+        // Comment: ignore the rest of the line
+        if (*next == '*')
+            break;
+
+        int command_len = getCommand(next);
+        Instruction *instr = parseCommand(next, command_len, where);
+        if (!instr)
+            return -1;
+        instr->lineno = lineno;
+        **tail = instr;
+        *tail = &instr->next;
+        count++;
 
-        free((char *)word);
-        curr += word_len;
-        curr = nextWord(curr);
-        word = readWord(curr, &word_len);
+        next = nextWord(next + command_len);
     }
 
-    return instruction;
+    return count;
+}
+
+// Destroys a list of instructions
+static void destroyList(Instruction *head)
+{
+    while (head)
+    {
+        Instruction *next = head->next;
+        instr_destroy(head);
+        head = next;
+    }
 }
 
 int parse(const char *s, SymbolTable alias_table, Instruction **instr,
           const char **errptr)
 {
-    const char *next = s;
-    int instruction_index = 0;
-    do
+    Instruction *head = 0, **tail = &head;
+    const char *where;
+
+    if (parseLine(s, s + strlen(s), 0, &tail, &where) < 0)
+    {
+        if (errptr)
+            *errptr = where;
+        destroyList(head);
+        return 0;
+    }
+
+    for (int i = 0; head; i++)
+    {
+        instr[i] = head;
+        head = head->next;
+        instr[i]->next = 0;
+        if (alias_table)
+            resolveAliases(instr[i], alias_table);
+    }
+
+    return 1;
+}
+
+/* Parses lines from start up to end, numbering them from 1               *
+ *                                                                          *
+ * Params:                                                                  *
+ * start, end: Source text to parse; end is at a line boundary              *
+ * head: Where the list of instructions is stored                           *
+ * nlines: Where the number of lines parsed is stored                       *
+ * where: Where the position of an error is stored                          *
+ *                                                                          *
+ * Returns:                                                                 *
+ * Last link of the list, or NULL on error, in which case the error message *
+ * is set, *nlines is the number of the line where it was found, *where     *
+ * points to it and the list holds the instructions of the lines before it  */
+static Instruction **parseChunk(const char *start, const char *end,
+                                Instruction **head, int *nlines,
+                                const char **where)
+{
+    Instruction **tail = head;
+    int lineno = 0;
+
+    *head = 0;
+    while (start < end)
+    {
+        const char *eol = memchr(start, '\n', end - start);
+        if (!eol)
+            eol = end;
+
+        if (parseLine(start, eol, ++lineno, &tail, where) < 0)
+        {
+            *tail = 0;
+            *nlines = lineno;
+            return 0;
+        }
+        start = eol + 1;
+    }
+
+    *nlines = lineno;
+    return tail;
+}
+
+int parse_source(const char *src, SymbolTable alias_table, Instruction **head,
+                 const char **errptr)
+{
+    int nlines;
+    const char *where;
+
+    if (!parseChunk(src, src + strlen(src), head, &nlines, &where))
+    {
+        char msg[1024];
+
+        if (errptr)
+            *errptr = where;
+        snprintf(msg, sizeof(msg), "%s", get_error_msg());
+        set_error_msg("line %d: %s", nlines, msg);
+        destroyList(*head);
+        *head = 0;
+        return 0;
+    }
+
+    for (Instruction *instr = *head; instr; instr = instr->next)
+        resolveAliases(instr, alias_table);
+
+    return 1;
+}
+
+// A piece of the source parsed by one of the threads.
+typedef struct {
+    const char *start, *end;
+    Instruction *head, **tail;  // tail is NULL if parsing failed
+    int nlines;
+    char *error;  // Error message of the worker that parsed the chunk
+    const char *where;  // and the position of the error
+} Chunk;
+
+// Work shared by the threads.
+typedef struct {
+    Chunk *chunks;
+    int nchunks;
+    int next;  // Next chunk to parse, taken atomically
+} ChunkQueue;
+
+static void *parseWorker(void *arg)
+{
+    ChunkQueue *queue = (ChunkQueue *)arg;
+    int i;
+
+    while ((i = __sync_fetch_and_add(&queue->next, 1)) < queue->nchunks)
+    {
+        Chunk *c = &queue->chunks[i];
+        c->tail = parseChunk(c->start, c->end, &c->head, &c->nlines,
+                             &c->where);
+
+        // Error messages belong to the thread that sets them
+        if (!c->tail)
+            c->error = estrdup(get_error_msg());
+    }
+
+    return 0;
+}
+
+int parse_source_parallel(const char *src, SymbolTable alias_table,
+                          Instruction **head, const char **errptr,
+                          int nthreads)
+{
+    size_t len = strlen(src);
+
+    if (nthreads < 1)
+        nthreads = 1;
+
+    // Some more chunks than threads, so that uneven chunks even out
+    int nchunks = nthreads == 1 ? 1 : 4 * nthreads;
+    if ((size_t)nchunks > len / 4096 + 1)
+        nchunks = len / 4096 + 1;
+
+    ChunkQueue queue;
+    queue.chunks = emalloc(nchunks * sizeof(Chunk));
+    queue.next = 0;
+
+    // Cut at the first newline after each even split point
+    const char *start = src, *end = src + len;
+    int n = 0;
+    for (int i = 1; i <= nchunks && start < end; i++)
     {
-        next = nextWord(next);
-        if (next)
+        const char *cut = end;
+        if (i < nchunks)
         {
-            int command_len = getCommand(next);
-            instr[instruction_index++] = parseCommand(next, command_len);
-            next += command_len;
+            cut = src + len / nchunks * i;
+            if (cut < start)
+                cut = start;
+            cut = memchr(cut, '\n', end - cut);
+            cut = cut ? cut + 1 : end;
         }
-    } while (next);
+        queue.chunks[n].start = start;
+        queue.chunks[n].error = 0;
+        queue.chunks[n++].end = cut;
+        start = cut;
+    }
+    queue.nchunks = n;
+
+    if (nthreads > n)
+        nthreads = n;
+
+    // Choose the scanner before the workers start scanning
+    scan_kernel();
+
+    pthread_t *threads = emalloc((nthreads ? nthreads : 1) * sizeof(pthread_t));
+    int started = 0;
+    for (; started < nthreads - 1; started++)
+        if (pthread_create(&threads[started], 0, parseWorker, &queue))
+            break;
+    parseWorker(&queue);
+    for (int i = 0; i < started; i++)
+        pthread_join(threads[i], 0);
+    free(threads);
+
+    // Report the first error in source order
+    int base = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Chunk *c = &queue.chunks[i];
+        if (!c->tail)
+        {
+            set_error_msg("line %d: %s", base + c->nlines, c->error);
+            if (errptr)
+                *errptr = c->where;
+            for (int j = 0; j < n; j++)
+            {
+                destroyList(queue.chunks[j].head);
+                free(queue.chunks[j].error);
+            }
+            free(queue.chunks);
+            *head = 0;
+            return 0;
+        }
+        base += c->nlines;
+    }
+
+    // Concatenate in source order, renumbering lines, and resolve
+    // aliases serially so that the result matches parse_source
+    Instruction **tail = head;
+    base = 0;
+    *head = 0;
+    for (int i = 0; i < n; i++)
+    {
+        Chunk *c = &queue.chunks[i];
+        for (Instruction *instr = c->head; instr; instr = instr->next)
+        {
+            instr->lineno += base;
+            resolveAliases(instr, alias_table);
+        }
+        if (c->head)
+        {
+            *tail = c->head;
+            tail = c->tail;
+        }
+        base += c->nlines;
+    }
 
+    free(queue.chunks);
     return 1;
 }
@@ -0,0 +1,262 @@
+/*
+  profile.c
+*/
+
+#include "profile.h"
+#include "opcodes.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+void profile_costs(unsigned costs[256])
+{
+  for (int op = 0; op < 256; op++) {
+    unsigned c = 1;
+
+    if (op <= STOUI)
+      c = 3;
+    else if ((op & ~1) == MUL || (op & ~1) == MULU)
+      c = 4;
+    else if ((op & ~1) == DIV || (op & ~1) == DIVU)
+      c = 20;
+    else if (op >= JMP && op <= GETAB)
+      c = 2;
+    else if (op == SAVE || op == REST)
+      c = 8;
+    else if (op == INT)
+      c = 50;
+    costs[op] = c;
+  }
+}
+
+
+// Add the counts of words [from, to) to e.
+static void add_counts(ProfileEntry *e, const Machine *M, uocta from,
+                       uocta to)
+{
+  if (to > M->ncounts)
+    to = M->ncounts;
+  for (uocta w = from; w < to; w++) {
+    e->count += M->counts[w].count;
+    e->cycles += M->counts[w].cycles;
+  }
+}
+
+
+static int compare_addr(const void *a, const void *b)
+{
+  const ProfileEntry *x = a, *y = b;
+
+  if (x->addr != y->addr)
+    return x->addr < y->addr ? -1 : 1;
+  return strcmp(x->label, y->label);
+}
+
+
+Profile *profile_create(const Machine *M, Assembler *A)
+{
+  Profile *P = emalloc(sizeof(Profile));
+
+  P->count = P->cycles = 0;
+
+  // Lines
+  P->nlines = A->nlines;
+  P->lines = emalloc((A->nlines + 1) * sizeof(ProfileEntry));
+  for (int i = 0; i < A->nlines; i++) {
+    ProfileEntry *e = &P->lines[i];
+
+    e->lineno = A->lines[i].lineno;
+    e->label = 0;
+    e->addr = A->lines[i].addr;
+    e->count = e->cycles = 0;
+    add_counts(e, M, e->addr, i + 1 < A->nlines ? A->lines[i + 1].addr
+                                                : A->n);
+    P->count += e->count;
+    P->cycles += e->cycles;
+  }
+
+  // Labels defined, and the code before the first one
+  int max = 16;
+  P->nlabels = 0;
+  P->labels = emalloc(max * sizeof(ProfileEntry));
+
+  StableIter it = stable_iter_begin(A->symbols, 0);
+  const char *key;
+  EntryData *data;
+
+  while (stable_iter_next(it, &key, &data)) {
+    const Symbol *sym = data->p;
+
+    if (sym->addr < 0)
+      continue;
+    if (P->nlabels == max) {
+      max *= 2;
+      P->labels = realloc(P->labels, max * sizeof(ProfileEntry));
+      if (!P->labels)
+        die("Failed to grow profile labels.");
+    }
+    P->labels[P->nlabels].label = estrdup(key);
+    P->labels[P->nlabels++].addr = sym->addr;
+  }
+  stable_iter_end(it);
+
+  qsort(P->labels, P->nlabels, sizeof(ProfileEntry), compare_addr);
+
+  // Labels at the same address share its code: it goes to the last
+  for (int i = 0; i < P->nlabels; i++) {
+    ProfileEntry *e = &P->labels[i];
+    int end = i + 1 < P->nlabels ? P->labels[i + 1].addr : A->n;
+
+    e->lineno = 0;
+    e->count = e->cycles = 0;
+    add_counts(e, M, e->addr, end);
+  }
+
+  if (!P->nlabels || P->labels[0].addr > 0) {
+    ProfileEntry start = { 0, 0, 0, 0, 0 };
+
+    add_counts(&start, M, 0, P->nlabels ? P->labels[0].addr : A->n);
+    if (start.count) {
+      P->labels = realloc(P->labels, (P->nlabels + 1) * sizeof(ProfileEntry));
+      if (!P->labels)
+        die("Failed to grow profile labels.");
+      memmove(P->labels + 1, P->labels, P->nlabels * sizeof(ProfileEntry));
+      P->labels[0] = start;
+      P->nlabels++;
+    }
+  }
+
+  return P;
+}
+
+
+void profile_destroy(Profile *P)
+{
+  for (int i = 0; i < P->nlabels; i++)
+    free((char *) P->labels[i].label);
+  free(P->labels);
+  free(P->lines);
+  free(P);
+}
+
+
+// Most cycles first, then most runs, then first in the program.
+static int compare_cycles(const void *a, const void *b)
+{
+  const ProfileEntry *x = *(ProfileEntry *const *) a;
+  const ProfileEntry *y = *(ProfileEntry *const *) b;
+
+  if (x->cycles != y->cycles)
+    return x->cycles > y->cycles ? -1 : 1;
+  if (x->count != y->count)
+    return x->count > y->count ? -1 : 1;
+  return x->addr - y->addr;
+}
+
+// Pointers to the n entries that ran, hottest first; returns how many.
+static int hottest(ProfileEntry *entries, int n, ProfileEntry ***sorted)
+{
+  int k = 0;
+
+  *sorted = emalloc((n + 1) * sizeof(ProfileEntry *));
+  for (int i = 0; i < n; i++)
+    if (entries[i].count)
+      (*sorted)[k++] = &entries[i];
+  qsort(*sorted, k, sizeof(ProfileEntry *), compare_cycles);
+  return k;
+}
+
+
+// Start of each line of source, up to the last one; returns how many.
+static int split_lines(const char *source, const char ***starts)
+{
+  int n = 0, max = 64;
+
+  *starts = emalloc(max * sizeof(char *));
+  for (const char *s = source; *s; n++) {
+    if (n == max) {
+      max *= 2;
+      *starts = realloc(*starts, max * sizeof(char *));
+      if (!*starts)
+        die("Failed to grow source lines.");
+    }
+    (*starts)[n] = s;
+    s = strchr(s, '\n');
+    if (!s)
+      s = (*starts)[n] + strlen((*starts)[n]);
+    else
+      s++;
+  }
+  return n;
+}
+
+// Write line lineno, from 1, of the source split in starts.
+static void put_line(FILE *out, const char **starts, int n, int lineno)
+{
+  if (lineno < 1 || lineno > n)
+    return;
+
+  const char *s = starts[lineno - 1];
+
+  fwrite(s, 1, strcspn(s, "\n"), out);
+}
+
+
+static double share(uocta part, uocta all)
+{
+  return all ? 100.0 * part / all : 0;
+}
+
+
+void profile_flat(FILE *out, const Profile *P, const char *source, int top)
+{
+  ProfileEntry **sorted;
+  const char **starts = 0;
+  int nstarts = source ? split_lines(source, &starts) : 0;
+  int k;
+
+  fprintf(out, "%llu instructions, %llu cycles\n\n", P->count, P->cycles);
+
+  fprintf(out, "      cycles       %%        count  label\n");
+  k = hottest(P->labels, P->nlabels, &sorted);
+  for (int i = 0; i < k; i++)
+    fprintf(out, "%12llu  %5.1f%%  %11llu  %s\n", sorted[i]->cycles,
+            share(sorted[i]->cycles, P->cycles), sorted[i]->count,
+            sorted[i]->label ? sorted[i]->label : "(start)");
+  free(sorted);
+
+  fprintf(out, "\n      cycles       %%        count   line\n");
+  k = hottest(P->lines, P->nlines, &sorted);
+  for (int i = 0; i < k && i < top; i++) {
+    fprintf(out, "%12llu  %5.1f%%  %11llu  %5d  ", sorted[i]->cycles,
+            share(sorted[i]->cycles, P->cycles), sorted[i]->count,
+            sorted[i]->lineno);
+    put_line(out, starts, nstarts, sorted[i]->lineno);
+    fputc('\n', out);
+  }
+  free(sorted);
+  free(starts);
+}
+
+
+void profile_annotate(FILE *out, const Profile *P, const char *source)
+{
+  const char **starts;
+  int n = split_lines(source, &starts);
+  int j = 0;
+
+  fprintf(out, "%11s %12s  %6s |\n", "count", "cycles", "%");
+  for (int lineno = 1; lineno <= n; lineno++) {
+    while (j < P->nlines && P->lines[j].lineno < lineno)
+      j++;
+    if (j < P->nlines && P->lines[j].lineno == lineno)
+      fprintf(out, "%11llu %12llu  %5.1f%% | ", P->lines[j].count,
+              P->lines[j].cycles, share(P->lines[j].cycles, P->cycles));
+    else
+      fprintf(out, "%33s| ", "");
+    put_line(out, starts, n, lineno);
+    fputc('\n', out);
+  }
+  free(starts);
+}
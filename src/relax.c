@@ -0,0 +1,276 @@
+/*
+  relax.c
+*/
+
+#include "relax.h"
+#include "encoder.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// State of a relaxation. Instructions are numbered in list order, and
+// their addresses kept as prefix sums of their sizes in a Fenwick
+// tree. Jumps wait in a heap, by the total growth of the program at
+// which they must be checked again.
+typedef struct {
+  int n;
+  const Instruction **instrs;
+  unsigned char *reach;
+  int *size;
+  int *fenwick;  // 1-based
+  long long growth;  // Words added to the program so far
+
+  int njumps;
+  int *src, *dst;  // Jump and target instruction of each jump
+
+  int nheap;
+  struct wait_s {
+    long long key;  // Growth past which the jump may not reach
+    int j;
+  } *heap;
+} Relax;
+
+
+// Address of instruction i: the sum of the sizes before it.
+static int address(const Relax *R, int i)
+{
+  int sum = 0;
+
+  for (; i > 0; i -= i & -i)
+    sum += R->fenwick[i];
+
+  return sum;
+}
+
+
+static void grow(Relax *R, int i, int delta)
+{
+  R->size[i] += delta;
+  R->growth += delta;
+  for (i++; i <= R->n; i += i & -i)
+    R->fenwick[i] += delta;
+}
+
+
+static void push(Relax *R, long long key, int j)
+{
+  int k = R->nheap++;
+
+  for (; k > 0 && R->heap[(k - 1) / 2].key > key; k = (k - 1) / 2)
+    R->heap[k] = R->heap[(k - 1) / 2];
+  R->heap[k].key = key;
+  R->heap[k].j = j;
+}
+
+
+static int pop(Relax *R)
+{
+  int j = R->heap[0].j;
+  struct wait_s last = R->heap[--R->nheap];
+  int k = 0;
+
+  for (;;) {
+    int c = 2 * k + 1;
+
+    if (c >= R->nheap)
+      break;
+    if (c + 1 < R->nheap && R->heap[c + 1].key < R->heap[c].key)
+      c++;
+    if (R->heap[c].key >= last.key)
+      break;
+    R->heap[k] = R->heap[c];
+    k = c;
+  }
+  R->heap[k] = last;
+
+  return j;
+}
+
+
+// Operand with the target of a jump, GETA or CALL, or -1.
+static int target_operand(const Instruction *instr)
+{
+  if (!instr->op)
+    return -1;
+
+  for (int k = 0; k < 3; k++) {
+    OperandType t = instr->op->opd_types[k];
+
+    if (instr->opds[k] && instr->opds[k]->type == LABEL
+        && (t == ADDR2 || t == ADDR3 || instr->op->opcode == CALL))
+      return k;
+  }
+
+  return -1;
+}
+
+
+// Find the jumps to known labels.
+static void index_jumps(Relax *R, SymbolTable labels)
+{
+  R->njumps = 0;
+  for (int i = 0; i < R->n; i++) {
+    int k = target_operand(R->instrs[i]);
+
+    if (k < 0)
+      continue;
+
+    // Undefined labels are left for the encoder to report
+    EntryData *data = stable_find(labels, R->instrs[i]->opds[k]->value.label);
+    if (!data)
+      continue;
+
+    R->src[R->njumps] = i;
+    R->dst[R->njumps++] = data->i;
+  }
+}
+
+
+static void free_relax(Relax *R)
+{
+  free(R->instrs);
+  free(R->size);
+  free(R->fenwick);
+  free(R->src);
+  free(R->dst);
+  free(R->heap);
+}
+
+
+int relax_layout(const Instruction *head, SymbolTable labels,
+                 unsigned char **reach, const Instruction **errinstr)
+{
+  Relax R;
+  const Instruction *instr;
+  int n = 0;
+
+  for (instr = head; instr; instr = instr->next)
+    n++;
+
+  R.n = n;
+  R.instrs = emalloc((n + 1) * sizeof(Instruction *));
+  R.reach = emalloc(n + 1);
+  R.size = emalloc((n + 1) * sizeof(int));
+  R.fenwick = emalloc((n + 1) * sizeof(int));
+  R.src = emalloc((n + 1) * sizeof(int));
+  R.dst = emalloc((n + 1) * sizeof(int));
+  R.heap = emalloc((n + 1) * sizeof(struct wait_s));
+  R.nheap = 0;
+  R.growth = 0;
+
+  // Number the instructions and define their labels, for now as
+  // instruction numbers
+  int i = 0;
+  for (instr = head; instr; instr = instr->next, i++) {
+    R.instrs[i] = instr;
+    R.reach[i] = REACH_SHORT;
+    R.size[i] = encode_size(instr);
+
+    if (instr->label && !(instr->op && instr->op->opcode == IS)) {
+      InsertionResult res = stable_insert(labels, instr->label);
+
+      if (!res.new) {
+        set_error_msg("label '%s' defined twice", instr->label);
+        if (errinstr)
+          *errinstr = instr;
+        free_relax(&R);
+        free(R.reach);
+        return -1;
+      }
+      res.data->i = i;
+    }
+  }
+
+  // Fenwick tree of the sizes, built in linear time
+  R.fenwick[0] = 0;
+  for (i = 1; i <= n; i++)
+    R.fenwick[i] = R.size[i - 1];
+  for (i = 1; i <= n; i++) {
+    int up = i + (i & -i);
+
+    if (up <= n)
+      R.fenwick[up] += R.fenwick[i];
+  }
+
+  index_jumps(&R, labels);
+
+  // A jump that still reaches its target with some slack keeps
+  // reaching it until the program grows by more than that, so every
+  // jump is checked once, and then only when the growth passes its
+  // slack
+  for (int j = 0; j < R.njumps; j++)
+    push(&R, -1, j);
+
+  while (R.nheap && R.heap[0].key < R.growth) {
+    int j = pop(&R);
+    int s = R.src[j], pc = address(&R, s), t = address(&R, R.dst[j]);
+    int need = encode_reach(R.instrs[s], pc, t);
+
+    if (need < 0) {
+      set_error_msg("%s: target too far", R.instrs[s]->op->name);
+      if (errinstr)
+        *errinstr = R.instrs[s];
+      free_relax(&R);
+      free(R.reach);
+      return -1;
+    }
+
+    if (need > R.reach[s]) {
+      R.reach[s] = need;
+      grow(&R, s, encode_size_reach(R.instrs[s], need) - R.size[s]);
+      if (s < R.dst[j])
+        t = address(&R, R.dst[j]);
+    }
+
+    push(&R, R.growth + encode_slack(R.instrs[s], pc, t, need), j);
+  }
+
+  // Labels get their addresses
+  for (i = 0; i < n; i++) {
+    instr = R.instrs[i];
+    if (instr->label && !(instr->op && instr->op->opcode == IS))
+      stable_find(labels, instr->label)->i = address(&R, i);
+  }
+
+  int total = address(&R, n);
+
+  *reach = R.reach;
+  free_relax(&R);
+
+  return total;
+}
+
+
+// Labels with their addresses in a SymbolTable.
+static int find_address(void *ctx, const char *label, int site, int *addr)
+{
+  EntryData *data = stable_find(ctx, label);
+
+  if (!data)
+    return 0;
+
+  *addr = data->i;
+  return 1;
+}
+
+
+int relax_program(const Instruction *head, SymbolTable labels,
+                  const unsigned char *reach, utetra *out,
+                  const Instruction **errinstr)
+{
+  LabelResolver r = { find_address, labels };
+  int pc = 0;
+
+  for (int i = 0; head; head = head->next, i++) {
+    int n = encode_relaxed(head, pc, reach[i], &r, out + pc);
+
+    if (n < 0) {
+      if (errinstr)
+        *errinstr = head;
+      return -1;
+    }
+    pc += n;
+  }
+
+  return pc;
+}
@@ -0,0 +1,242 @@
+/*
+  scan.c
+*/
+
+#include "scan.h"
+#include <pthread.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// Character classes. A scan runs over characters of a class (skip) or
+// up to the first character of a class (command and word).
+#define CLASS_COMMAND 0  // NUL * \n ;
+#define CLASS_WORD    1  // NUL * , ; and spaces
+#define CLASS_SKIP    2  // , ; and spaces
+
+#define IN_COMMAND (1 << CLASS_COMMAND)
+#define IN_WORD    (1 << CLASS_WORD)
+#define IN_SKIP    (1 << CLASS_SKIP)
+
+// Classes of each character.
+static const unsigned char classes[256] = {
+  [0] = IN_COMMAND | IN_WORD,
+  ['*'] = IN_COMMAND | IN_WORD,
+  [';'] = IN_COMMAND | IN_WORD | IN_SKIP,
+  ['\n'] = IN_COMMAND | IN_WORD | IN_SKIP,
+  [','] = IN_WORD | IN_SKIP,
+  [' '] = IN_WORD | IN_SKIP,
+  ['\t'] = IN_WORD | IN_SKIP,
+  ['\v'] = IN_WORD | IN_SKIP,
+  ['\f'] = IN_WORD | IN_SKIP,
+  ['\r'] = IN_WORD | IN_SKIP
+};
+
+
+static size_t scalar_scan(const char *s, int cls)
+{
+  const unsigned char *p = (const unsigned char *) s;
+  int bit = 1 << cls;
+
+  if (cls == CLASS_SKIP)
+    while (classes[*p] & bit) p++;
+  else
+    while (!(classes[*p] & bit)) p++;
+
+  return p - (const unsigned char *) s;
+}
+
+
+#ifdef SCAN_X86
+
+// The vector scans read whole aligned blocks, starting with the one
+// that holds s. An aligned block never crosses a page boundary, so
+// the bytes read around the string are always mapped.
+
+#ifdef __SSE2__
+
+// Mask of the bytes of v that are in class cls.
+static inline unsigned sse2_members(__m128i v, int cls)
+{
+  __m128i m, t;
+
+  if (cls == CLASS_COMMAND) {
+    m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    return _mm_movemask_epi8(m);
+  }
+
+  // Spaces: ' ', or 9 <= c <= 13, tested as c - 9 <= 4 unsigned.
+  t = _mm_sub_epi8(v, _mm_set1_epi8(9));
+  m = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(',')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+
+  if (cls == CLASS_WORD) {
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('*')));
+  }
+
+  return _mm_movemask_epi8(m);
+}
+
+static size_t sse2_scan(const char *s, int cls)
+{
+  unsigned offset = (uintptr_t) s & 15;
+  const char *p = s - offset;
+  unsigned flip = cls == CLASS_SKIP ? 0xffff : 0;
+  unsigned stop;
+
+  stop = ((sse2_members(_mm_load_si128((const __m128i *) p), cls) ^ flip)
+          & 0xffff) >> offset;
+  if (stop)
+    return __builtin_ctz(stop);
+
+  for (p += 16;; p += 16) {
+    stop = sse2_members(_mm_load_si128((const __m128i *) p), cls) ^ flip;
+    if (stop)
+      return p - s + __builtin_ctz(stop);
+  }
+}
+
+#endif
+
+// Mask of the bytes of v that are in class cls.
+__attribute__((target("avx2")))
+static inline unsigned avx2_members(__m256i v, int cls)
+{
+  __m256i m, t;
+
+  if (cls == CLASS_COMMAND) {
+    m = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    return _mm256_movemask_epi8(m);
+  }
+
+  t = _mm256_sub_epi8(v, _mm256_set1_epi8(9));
+  m = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(4)), t);
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(',')));
+  m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+
+  if (cls == CLASS_WORD) {
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('*')));
+  }
+
+  return _mm256_movemask_epi8(m);
+}
+
+__attribute__((target("avx2")))
+static size_t avx2_scan(const char *s, int cls)
+{
+  unsigned offset = (uintptr_t) s & 31;
+  const char *p = s - offset;
+  unsigned flip = cls == CLASS_SKIP ? 0xffffffffu : 0;
+  unsigned stop;
+
+  stop = (avx2_members(_mm256_load_si256((const __m256i *) p), cls) ^ flip)
+    >> offset;
+  if (stop)
+    return __builtin_ctz(stop);
+
+  for (p += 32;; p += 32) {
+    stop = avx2_members(_mm256_load_si256((const __m256i *) p), cls) ^ flip;
+    if (stop)
+      return p - s + __builtin_ctz(stop);
+  }
+}
+
+#endif
+
+
+// Implementation in use; the fastest one is chosen on first call, once
+// for all threads.
+static size_t choose_scan(const char *s, int cls);
+static size_t (*scan)(const char *s, int cls) = choose_scan;
+static ScanKernel kernel = SCAN_SCALAR;
+static pthread_once_t chosen = PTHREAD_ONCE_INIT;
+
+
+static int set_kernel(ScanKernel k)
+{
+  switch (k) {
+  case SCAN_SCALAR:
+    scan = scalar_scan;
+    break;
+#if defined(SCAN_X86) && defined(__SSE2__)
+  case SCAN_SSE2:
+    scan = sse2_scan;
+    break;
+#endif
+#ifdef SCAN_X86
+  case SCAN_AVX2:
+    if (!__builtin_cpu_supports("avx2"))
+      return 0;
+    scan = avx2_scan;
+    break;
+#endif
+  default:
+    return 0;
+  }
+
+  kernel = k;
+  return 1;
+}
+
+
+static void choose_kernel()
+{
+  if (!set_kernel(SCAN_AVX2) && !set_kernel(SCAN_SSE2))
+    set_kernel(SCAN_SCALAR);
+}
+
+
+int scan_select(ScanKernel k)
+{
+  pthread_once(&chosen, choose_kernel);
+
+  return set_kernel(k);
+}
+
+
+ScanKernel scan_kernel()
+{
+  pthread_once(&chosen, choose_kernel);
+
+  return kernel;
+}
+
+
+static size_t choose_scan(const char *s, int cls)
+{
+  scan_kernel();
+
+  return scan(s, cls);
+}
+
+
+size_t scan_command(const char *s)
+{
+  return scan(s, CLASS_COMMAND);
+}
+
+
+size_t scan_word(const char *s)
+{
+  return scan(s, CLASS_WORD);
+}
+
+
+size_t scan_skip(const char *s)
+{
+  return scan(s, CLASS_SKIP);
+}
@@ -0,0 +1,445 @@
+/*
+  sim.c
+*/
+
+#include "sim.h"
+#include "jit.h"
+#include "opcodes.h"
+#include "simcode.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Computed goto is a GNU extension.
+#if defined(__GNUC__) && !defined(SIM_PORTABLE)
+#define SIM_HAVE_THREADED 1
+#else
+#define SIM_HAVE_THREADED 0
+#endif
+
+
+// Big-endian accesses to memory: single loads and stores with a byte
+// swap where the host is little-endian and has the builtins.
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) \
+    && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+static inline unsigned get16(const unsigned char *p)
+{
+  unsigned short v;
+
+  memcpy(&v, p, 2);
+  return __builtin_bswap16(v);
+}
+
+static inline utetra get32(const unsigned char *p)
+{
+  utetra v;
+
+  memcpy(&v, p, 4);
+  return __builtin_bswap32(v);
+}
+
+static inline uocta get64(const unsigned char *p)
+{
+  uocta v;
+
+  memcpy(&v, p, 8);
+  return __builtin_bswap64(v);
+}
+
+static inline void put16(unsigned char *p, uocta v)
+{
+  unsigned short w = __builtin_bswap16(v);
+
+  memcpy(p, &w, 2);
+}
+
+static inline void put32(unsigned char *p, uocta v)
+{
+  utetra w = __builtin_bswap32(v);
+
+  memcpy(p, &w, 4);
+}
+
+static inline void put64(unsigned char *p, uocta v)
+{
+  v = __builtin_bswap64(v);
+  memcpy(p, &v, 8);
+}
+
+#else
+
+static inline unsigned get16(const unsigned char *p)
+{
+  return (unsigned) p[0] << 8 | p[1];
+}
+
+static inline utetra get32(const unsigned char *p)
+{
+  return (utetra) p[0] << 24 | (utetra) p[1] << 16 | (utetra) p[2] << 8 | p[3];
+}
+
+static inline uocta get64(const unsigned char *p)
+{
+  return (uocta) get32(p) << 32 | get32(p + 4);
+}
+
+static inline void put16(unsigned char *p, uocta v)
+{
+  p[0] = v >> 8;
+  p[1] = v;
+}
+
+static inline void put32(unsigned char *p, uocta v)
+{
+  p[0] = v >> 24;
+  p[1] = v >> 16;
+  p[2] = v >> 8;
+  p[3] = v;
+}
+
+static inline void put64(unsigned char *p, uocta v)
+{
+  put32(p, v >> 32);
+  put32(p + 4, v);
+}
+
+#endif
+
+
+// Host address of the byte at a, which is in memory, for reading or
+// writing. Pages are allocated when first written; reads of the others
+// see zeros.
+static unsigned char *page_miss(Machine *M, uocta a, int write)
+{
+  unsigned char *page = vmem_page(M->mem, a, write);
+
+  if (!page)
+    return (unsigned char *) vmem_zeros + (a & (VMEM_PAGE_SIZE - 1));
+  M->tlb_page = a >> VMEM_PAGE_BITS;
+  M->tlb_data = page;
+  return page + (a & (VMEM_PAGE_SIZE - 1));
+}
+
+static inline unsigned char *host(Machine *M, uocta a, int write)
+{
+  if (a >> VMEM_PAGE_BITS == M->tlb_page)
+    return M->tlb_data + (a & (VMEM_PAGE_SIZE - 1));
+  return page_miss(M, a, write);
+}
+
+// High 64 bits of the unsigned and signed products of a and b.
+static uocta mulhi(uocta a, uocta b)
+{
+  uocta al = a & 0xffffffff, ah = a >> 32;
+  uocta bl = b & 0xffffffff, bh = b >> 32;
+  uocta mid = ah * bl + (al * bl >> 32);
+  uocta mid2 = al * bh + (mid & 0xffffffff);
+
+  return ah * bh + (mid >> 32) + (mid2 >> 32);
+}
+
+static uocta mulhi_signed(uocta a, uocta b)
+{
+  uocta h = mulhi(a, b);
+
+  if ((octa) a < 0)
+    h -= b;
+  if ((octa) b < 0)
+    h -= a;
+  return h;
+}
+
+
+// Divisions, leaving the remainder in rR.
+static void divide(Machine *M, uocta a, uocta b, uocta *q)
+{
+  if (!b) {
+    *q = 0;
+    M->rR = a;
+    return;
+  }
+  *q = a / b;
+  M->rR = a % b;
+}
+
+static void divide_signed(Machine *M, uocta a, uocta b, uocta *q)
+{
+  if (!b) {
+    *q = 0;
+    M->rR = a;
+    return;
+  }
+  // The quotient of the most negative number by -1 overflows in C
+  if ((octa) b == -1) {
+    *q = -a;
+    M->rR = 0;
+    return;
+  }
+  *q = (octa) a / (octa) b;
+  M->rR = (octa) a % (octa) b;
+}
+
+
+// Handle INT code at M->pc. Returns 1 to go on, 0 to halt and -1 on
+// faults, with the error message set.
+static int interrupt(Machine *M, unsigned code)
+{
+  uocta a = M->reg[255];
+
+  switch (code) {
+  case 0:
+    return 0;
+
+  case 1:
+    fputc((int) (a & 0xff), M->out);
+    return 1;
+
+  case 2:
+    for (uocta p = a; p < M->memsize; p++) {
+      int c = *host(M, p, 0);
+
+      if (!c)
+        return 1;
+      fputc(c, M->out);
+    }
+    break;
+
+  case 3:
+    fprintf(M->out, "%lld", (octa) a);
+    return 1;
+
+  default:
+    if (M->trap && M->trap(M, code))
+      return 1;
+    set_error_msg("pc %#llx: unhandled interrupt %u", M->pc, code);
+    return -1;
+  }
+
+  set_error_msg("pc %#llx: string at %#llx outside of memory", M->pc, a);
+  return -1;
+}
+
+
+// Operators of decoded instructions that are not instructions, among
+// the unused opcodes.
+#define S_DECODE SIM_UNDECODED  // Not decoded yet.
+#define S_END    0x5e  // Past the last decoded word.
+#define S_BAD    0x5f  // Unknown opcode.
+
+// Target of jumps outside of memory, or too far to be a utetra.
+#define NOWHERE 0xffffffffu
+
+static int is_jump(unsigned op)
+{
+  return op >= JMP && op <= JNPB;
+}
+
+// Decode the word w at pc into d, but for the handler.
+static void decode(Decoded *d, utetra w, uocta pc, uocta memsize)
+{
+  unsigned op = w >> 24;
+
+  d->op = op;
+  d->x = w >> 16;
+  d->y = w >> 8;
+  d->z = w;
+  d->arg = w & 0xff;
+
+  if (is_jump(op)) {
+    uocta t = jump_target(w, pc);
+
+    d->arg = t < memsize && t / 4 < NOWHERE ? t / 4 : NOWHERE;
+  }
+  else if (op >= GO && op <= SETW)
+    d->arg = w & 0xffff;
+  else if (op == INT)
+    d->arg = w & 0xffffff;
+  else if (op > REST && op != NOP)
+    d->op = S_BAD;
+}
+
+
+// Mark the words in [from, to) to be decoded again, counting in
+// M->code_writes the stores that change decoded instructions.
+static void mark(Machine *M, Decoded *d, uocta from, uocta to,
+                 const void *handler)
+{
+  int decoded = 0;
+
+  for (uocta i = from; i < to; i++) {
+    decoded |= d[i].op != S_DECODE;
+    d[i].op = S_DECODE;
+    d[i].handler = handler;
+  }
+  M->code_writes += decoded;
+}
+
+
+// Make the profile cover n words, and the one past them.
+static void grow_counts(Machine *M, uocta n)
+{
+  if (M->ncounts > n)
+    return;
+  M->counts = realloc(M->counts, (n + 1) * sizeof(SimCount));
+  if (!M->counts)
+    die("Failed to grow profile.");
+  memset(M->counts + M->ncounts, 0, (n + 1 - M->ncounts) * sizeof(SimCount));
+  M->ncounts = n + 1;
+}
+
+
+// Extend the decoded words to cover word w at least, which can hold
+// code.
+static void extend(Machine *M, uocta w, const void *decode_handler,
+                   const void *end_handler)
+{
+  uocta n = M->ndecoded ? 2 * M->ndecoded : 1024;
+
+  if (n <= w)
+    n = w + 1;
+  if (n > code_words(M))
+    n = code_words(M);
+
+  M->decoded = realloc(M->decoded, (n + 1) * sizeof(Decoded));
+  if (!M->decoded)
+    die("Failed to grow decoded instructions.");
+  for (uocta i = M->ndecoded; i < n; i++) {
+    M->decoded[i].op = S_DECODE;
+    M->decoded[i].handler = decode_handler;
+  }
+  M->decoded[n].op = S_END;
+  M->decoded[n].handler = end_handler;
+  M->ndecoded = n;
+
+  if (M->profiling)
+    grow_counts(M, n);
+}
+
+
+// The interpreters, with each dispatch, with and without a profile.
+#if SIM_HAVE_THREADED
+#define SIM_LOOP run_threaded
+#define SIM_THREADED 1
+#define SIM_PROFILED 0
+#include "simloop.h"
+#undef SIM_LOOP
+#undef SIM_PROFILED
+
+#define SIM_LOOP run_threaded_profiled
+#define SIM_PROFILED 1
+#include "simloop.h"
+#undef SIM_LOOP
+#undef SIM_THREADED
+#undef SIM_PROFILED
+#endif
+
+#define SIM_LOOP run_switch
+#define SIM_THREADED 0
+#define SIM_PROFILED 0
+#include "simloop.h"
+#undef SIM_LOOP
+#undef SIM_PROFILED
+
+#define SIM_LOOP run_switch_profiled
+#define SIM_PROFILED 1
+#include "simloop.h"
+#undef SIM_LOOP
+#undef SIM_THREADED
+#undef SIM_PROFILED
+
+
+Machine *sim_create(uocta memsize)
+{
+  Machine *M = emalloc(sizeof(Machine));
+
+  // Room at least for an octa, so that accesses need one bound check
+  if (memsize < 8)
+    memsize = 8;
+  if (memsize > SIM_MEMSIZE_MAX)
+    memsize = SIM_MEMSIZE_MAX;
+
+  memset(M, 0, sizeof(Machine));
+  M->mem = vmem_create();
+  M->memsize = memsize;
+  M->tlb_page = VMEM_NO_PAGE;
+  M->out = stdout;
+
+  return M;
+}
+
+
+void sim_destroy(Machine *M)
+{
+  jit_destroy(M->jit);
+  free(M->counts);
+  free(M->decoded);
+  vmem_destroy(M->mem);
+  free(M);
+}
+
+
+int sim_load(Machine *M, const utetra *code, int n)
+{
+  if ((uocta) n > code_words(M)) {
+    set_error_msg("%d words of code do not fit in %llu bytes of memory",
+                  n, code_words(M) * 4);
+    return 0;
+  }
+
+  for (int i = 0; i < n; i++)
+    put32(host(M, 4 * (uocta) i, 1), code[i]);
+  sim_flush(M);
+  M->pc = 0;
+  M->reg[REG_SP] = ((uocta) n * 4 + 7) & ~(uocta) 7;
+
+  return 1;
+}
+
+
+void sim_flush(Machine *M)
+{
+  free(M->decoded);
+  M->decoded = 0;
+  M->ndecoded = 0;
+  M->code_writes++;
+}
+
+
+int sim_run(Machine *M, uocta max_steps)
+{
+  if (M->tier != SIM_INTERPRET && !M->profiling && jit_available())
+    return jit_run(M, max_steps);
+  return sim_interpret(M, max_steps);
+}
+
+
+int sim_interpret(Machine *M, uocta max_steps)
+{
+#if SIM_HAVE_THREADED
+  if (!M->portable)
+    return M->profiling ? run_threaded_profiled(M, max_steps)
+                        : run_threaded(M, max_steps);
+#endif
+  return M->profiling ? run_switch_profiled(M, max_steps)
+                      : run_switch(M, max_steps);
+}
+
+
+void sim_profile(Machine *M, const unsigned *costs)
+{
+  for (int op = 0; op < 256; op++)
+    M->costs[op] = costs ? costs[op] : 1;
+
+  // Words not decoded yet are charged when decoded
+  M->costs[S_DECODE] = M->costs[S_END] = 0;
+
+  M->profiling = 1;
+  grow_counts(M, M->ndecoded);
+}
+
+
+int sim_threaded()
+{
+  return SIM_HAVE_THREADED;
+}
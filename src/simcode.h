@@ -0,0 +1,30 @@
+/*
+  simcode.h
+
+  Helpers on the code of a machine shared by the interpreter (sim.c)
+  and the JIT (jit.c).
+*/
+
+#ifndef __SIMCODE_H__
+#define __SIMCODE_H__
+
+#include "sim.h"
+#include "opcodes.h"
+
+// Words that can hold code.
+static inline uocta code_words(const Machine *M)
+{
+  return (M->memsize < SIM_CODE_SIZE ? M->memsize : SIM_CODE_SIZE) / 4;
+}
+
+// Target address of the jump w at pc.
+static inline uocta jump_target(utetra w, uocta pc)
+{
+  unsigned op = w >> 24;
+  uocta disp = w & (op == JMP || op == JMPB ? 0xffffff : 0xffff);
+
+  disp *= 4;
+  return (op - JMP) & 1 ? pc - disp : pc + disp;
+}
+
+#endif
@@ -0,0 +1,375 @@
+/*
+  simloop.h
+
+  The interpreter loop, included by sim.c once for each kind of
+  dispatch and profiling: SIM_LOOP is the name of the function to
+  define, SIM_THREADED is nonzero for computed goto, zero for a switch,
+  and SIM_PROFILED is nonzero to count every step in M->counts. The
+  handlers are written once, with macros that expand to labels and
+  jumps through the handler of each decoded instruction in the first
+  case and to cases of the switch in the second.
+
+  The loop runs over the decoded instructions (see sim.h): ip points
+  to the one being executed, whose address is PC(). Reaching one not
+  decoded yet decodes it and goes on; reaching the end of them, or
+  jumping past it, extends them.
+*/
+
+static int SIM_LOOP(Machine *M, uocta max_steps)
+{
+  uocta *reg = M->reg;
+  uocta memsize = M->memsize;
+  uocta codesize = code_words(M) * 4;
+  unsigned char *p;
+  Decoded *code, *ip;
+  uocta ncode;
+  uocta left = max_steps ? max_steps : ~(uocta) 0;
+  uocta start = left;
+  uocta pc, a, b;
+  int result;
+#if SIM_PROFILED
+  SimCount *counts = M->counts;
+  const unsigned *costs = M->costs;
+#endif
+
+#define PC() ((uocta) (ip - code) * 4)
+
+// Count a step of the instruction at ip.
+#if SIM_PROFILED
+#define COUNT()                                         \
+  (counts[ip - code].count++,                           \
+   counts[ip - code].cycles += costs[ip->op])
+#else
+#define COUNT() ((void) 0)
+#endif
+
+#if SIM_THREADED
+  static void *const table[256] = {
+    [0 ... 255] = &&bad_op,
+#define ENTRY(name) [name] = &&l_##name,
+    ENTRY(LDB) ENTRY(LDBI) ENTRY(LDW) ENTRY(LDWI)
+    ENTRY(LDT) ENTRY(LDTI) ENTRY(LDO) ENTRY(LDOI)
+    ENTRY(LDBU) ENTRY(LDBUI) ENTRY(LDWU) ENTRY(LDWUI)
+    ENTRY(LDTU) ENTRY(LDTUI) ENTRY(LDOU) ENTRY(LDOUI)
+    ENTRY(STB) ENTRY(STBI) ENTRY(STW) ENTRY(STWI)
+    ENTRY(STT) ENTRY(STTI) ENTRY(STO) ENTRY(STOI)
+    ENTRY(STBU) ENTRY(STBUI) ENTRY(STWU) ENTRY(STWUI)
+    ENTRY(STTU) ENTRY(STTUI) ENTRY(STOU) ENTRY(STOUI)
+    ENTRY(ADD) ENTRY(ADDI) ENTRY(SUB) ENTRY(SUBI)
+    ENTRY(MUL) ENTRY(MULI) ENTRY(DIV) ENTRY(DIVI)
+    ENTRY(CMP) ENTRY(CMPI) ENTRY(SL) ENTRY(SLI)
+    ENTRY(SR) ENTRY(SRI) ENTRY(NEG) ENTRY(NEGI)
+    ENTRY(ADDU) ENTRY(ADDUI) ENTRY(SUBU) ENTRY(SUBUI)
+    ENTRY(MULU) ENTRY(MULUI) ENTRY(DIVU) ENTRY(DIVUI)
+    ENTRY(CMPU) ENTRY(CMPUI) ENTRY(SLU) ENTRY(SLUI)
+    ENTRY(SRU) ENTRY(SRUI) ENTRY(NEGU) ENTRY(NEGUI)
+    ENTRY(AND) ENTRY(ANDI) ENTRY(OR) ENTRY(ORI)
+    ENTRY(XOR) ENTRY(XORI) ENTRY(NXOR) ENTRY(NXORI)
+    ENTRY(JMP) ENTRY(JMPB) ENTRY(JZ) ENTRY(JZB)
+    ENTRY(JNZ) ENTRY(JNZB) ENTRY(JP) ENTRY(JPB)
+    ENTRY(JN) ENTRY(JNB) ENTRY(JNN) ENTRY(JNNB)
+    ENTRY(JNP) ENTRY(JNPB) ENTRY(GO) ENTRY(GOB)
+    ENTRY(GETA) ENTRY(GETAB) ENTRY(SETW) ENTRY(SAVE)
+    ENTRY(REST) ENTRY(INT) ENTRY(NOP)
+    ENTRY(S_DECODE) ENTRY(S_END)
+#undef ENTRY
+  };
+
+#define CASE(label, opc) label:
+#define DECODE_HANDLER (&&l_S_DECODE)
+#define END_HANDLER (&&l_S_END)
+#define DISPATCH()                              \
+  do {                                          \
+    if (!left)                                  \
+      goto limit;                               \
+    left--;                                     \
+    COUNT();                                    \
+    goto *ip->handler;                          \
+  } while (0)
+#define EXECUTE() goto *ip->handler
+#else
+#define CASE(label, opc) case opc:
+#define DECODE_HANDLER 0
+#define END_HANDLER 0
+#define DISPATCH() goto dispatch
+#define EXECUTE() goto execute
+#endif
+
+// Go on with the next instruction, or with the target of the jump.
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define JUMP()                                  \
+  do {                                          \
+    if (ip->arg >= ncode)                       \
+      goto far_jump;                            \
+    ip = code + ip->arg;                        \
+    DISPATCH();                                 \
+  } while (0)
+
+  // Handlers are labels of the loop that decoded the words
+  if (M->decoded && M->decoded_loop != (SIM_THREADED | SIM_PROFILED << 1))
+    sim_flush(M);
+  M->decoded_loop = SIM_THREADED | SIM_PROFILED << 1;
+  code = M->decoded;
+  ncode = M->ndecoded;
+  a = M->pc;
+
+  // Jump to address a, extending the decoded instructions if needed
+jump:
+  if ((a & 3) || a > codesize - 4) {
+    pc = a;
+    goto bad_pc;
+  }
+  if (a / 4 >= ncode) {
+    extend(M, a / 4, DECODE_HANDLER, END_HANDLER);
+    code = M->decoded;
+    ncode = M->ndecoded;
+#if SIM_PROFILED
+    counts = M->counts;
+#endif
+  }
+  ip = code + a / 4;
+
+#if SIM_THREADED
+  DISPATCH();
+#else
+dispatch:
+  if (!left)
+    goto limit;
+  left--;
+  COUNT();
+execute:
+  switch (ip->op) {
+#endif
+
+#define OP(name) CASE(l_##name, name)
+
+  // Not decoded yet: decode, and execute without counting a step again
+  OP(S_DECODE)
+    decode(ip, get32(host(M, PC(), 0)), PC(), codesize);
+#if SIM_THREADED
+    ip->handler = table[ip->op];
+#endif
+#if SIM_PROFILED
+    counts[ip - code].cycles += costs[ip->op];
+#endif
+    EXECUTE();
+
+  // Past the end of the decoded instructions
+  OP(S_END)
+    a = PC();
+    left++;
+#if SIM_PROFILED
+    counts[ip - code].count--;
+#endif
+    goto jump;
+
+// An operator and its immediate version, with b the last operand.
+// Macros passing the name on must paste it into labels themselves,
+// since it is expanded to the opcode otherwise.
+#define PAIR(name, ...) PAIR_(l_##name, name, l_##name##I, name##I, __VA_ARGS__)
+#define PAIR_(label, opc, labeli, opci, ...)              \
+  CASE(label, opc) b = reg[ip->z]; __VA_ARGS__ NEXT();    \
+  CASE(labeli, opci) b = ip->arg; __VA_ARGS__ NEXT();
+
+// Loads and stores of n bytes at $Y + b, which are at p in the host.
+// Stores to decoded words mark them to be decoded again.
+#define ADDRESS(n, write)                       \
+  a = (reg[ip->y] + b) & ~(uocta) (n - 1);      \
+  if (a > memsize - n)                          \
+    goto bad_addr;                              \
+  p = host(M, a, write);
+#define INVALIDATE(n)                                   \
+  if (a / 4 < ncode)                                    \
+    mark(M, code, a / 4, (a + n - 1) / 4 + 1 < ncode    \
+         ? (a + n - 1) / 4 + 1 : ncode, DECODE_HANDLER);
+
+#define LOAD(name, n, value)                                            \
+  PAIR_(l_##name, name, l_##name##I, name##I,                           \
+        ADDRESS(n, 0) reg[ip->x] = (value);)
+#define STORE(name, n, put)                                             \
+  PAIR_(l_##name, name, l_##name##I, name##I,                           \
+        ADDRESS(n, 1) put; INVALIDATE(n))
+
+  LOAD(LDB, 1, (octa) (signed char) *p)
+  LOAD(LDW, 2, (octa) (short) get16(p))
+  LOAD(LDT, 4, (octa) (int) get32(p))
+  LOAD(LDO, 8, get64(p))
+  LOAD(LDBU, 1, *p)
+  LOAD(LDWU, 2, get16(p))
+  LOAD(LDTU, 4, get32(p))
+  LOAD(LDOU, 8, get64(p))
+
+  STORE(STB, 1, *p = reg[ip->x])
+  STORE(STW, 2, put16(p, reg[ip->x]))
+  STORE(STT, 4, put32(p, reg[ip->x]))
+  STORE(STO, 8, put64(p, reg[ip->x]))
+  STORE(STBU, 1, *p = reg[ip->x])
+  STORE(STWU, 2, put16(p, reg[ip->x]))
+  STORE(STTU, 4, put32(p, reg[ip->x]))
+  STORE(STOU, 8, put64(p, reg[ip->x]))
+
+#define X reg[ip->x]
+#define Y reg[ip->y]
+
+  PAIR(ADD, X = Y + b;)
+  PAIR(SUB, X = Y - b;)
+  PAIR(MUL, M->rH = mulhi_signed(Y, b); X = Y * b;)
+  PAIR(DIV, divide_signed(M, Y, b, &X);)
+  PAIR(CMP, X = ((octa) Y > (octa) b) - ((octa) Y < (octa) b);)
+  PAIR(SL, X = b < 64 ? Y << b : 0;)
+  PAIR(SR, X = (octa) Y >> (b < 64 ? b : 63);)
+  PAIR(NEG, X = ip->y - b;)
+
+  PAIR(ADDU, X = Y + b;)
+  PAIR(SUBU, X = Y - b;)
+  PAIR(MULU, M->rH = mulhi(Y, b); X = Y * b;)
+  PAIR(DIVU, divide(M, Y, b, &X);)
+  PAIR(CMPU, X = (Y > b) - (Y < b);)
+  PAIR(SLU, X = b < 64 ? Y << b : 0;)
+  PAIR(SRU, X = b < 64 ? Y >> b : 0;)
+  PAIR(NEGU, X = ip->y - b;)
+
+  PAIR(AND, X = Y & b;)
+  PAIR(OR, X = Y | b;)
+  PAIR(XOR, X = Y ^ b;)
+  PAIR(NXOR, X = ~(Y ^ b);)
+
+// A jump and its backward version, which differ only when decoded.
+#define BRANCH(name, cond)                                      \
+  CASE(l_##name, name) if (cond) JUMP(); NEXT();                \
+  CASE(l_##name##B, name##B) if (cond) JUMP(); NEXT();
+
+  BRANCH(JMP, 1)
+  BRANCH(JZ, X == 0)
+  BRANCH(JNZ, X != 0)
+  BRANCH(JP, (octa) X > 0)
+  BRANCH(JN, (octa) X < 0)
+  BRANCH(JNN, (octa) X >= 0)
+  BRANCH(JNP, (octa) X <= 0)
+
+  OP(GO)
+    a = X + 4 * (uocta) ip->arg;
+    X = PC() + 4;
+    goto jump;
+  OP(GOB)
+    a = X - 4 * (uocta) ip->arg;
+    X = PC() + 4;
+    goto jump;
+
+  OP(GETA) X = PC() + 4 * (uocta) ip->arg; NEXT();
+  OP(GETAB) X = PC() - 4 * (uocta) ip->arg; NEXT();
+  OP(SETW) X = ip->arg; NEXT();
+
+  OP(SAVE)
+    a = X & ~(uocta) 7;
+    if (ip->y <= ip->z) {
+      uocta n = (ip->z - ip->y + 1) * 8;
+
+      if (a > memsize || n > memsize - a)
+        goto bad_addr;
+      for (unsigned r = ip->y; r <= ip->z; r++)
+        put64(host(M, a + 8 * (r - ip->y), 1), reg[r]);
+      if (a / 4 < ncode)
+        mark(M, code, a / 4, (a + n) / 4 < ncode ? (a + n) / 4 : ncode,
+             DECODE_HANDLER);
+      a += n;
+    }
+    X = a;
+    NEXT();
+
+  OP(REST)
+    a = X & ~(uocta) 7;
+    if (ip->y <= ip->z) {
+      uocta n = (ip->z - ip->y + 1) * 8;
+
+      if (a < n || a > memsize)
+        goto bad_addr;
+      a -= n;
+      for (unsigned r = ip->y; r <= ip->z; r++)
+        reg[r] = get64(host(M, a + 8 * (r - ip->y), 0));
+    }
+    X = a;
+    NEXT();
+
+  OP(INT)
+    pc = M->pc = PC();
+    result = interrupt(M, ip->arg);
+    // The trap may have flushed the decoded words
+    code = M->decoded;
+    ncode = M->ndecoded;
+#if SIM_PROFILED
+    counts = M->counts;
+#endif
+    switch (result) {
+    case 0:
+      pc += 4;
+      result = SIM_HALTED;
+      goto out;
+    case -1:
+      result = SIM_FAULT;
+      goto out;
+    }
+    a = M->pc + 4;
+    goto jump;
+
+  OP(NOP) NEXT();
+
+#if !SIM_THREADED
+  default:
+    goto bad_op;
+  }
+#endif
+
+  // A jump whose target was not decoded, or is outside of memory
+far_jump:
+  pc = PC();
+  a = ip->arg == NOWHERE ? jump_target(get32(host(M, pc, 0)), pc)
+                         : 4 * ip->arg;
+  goto jump;
+
+limit:
+  pc = PC();
+  result = SIM_LIMIT;
+  goto out;
+
+bad_pc:
+  set_error_msg("pc %#llx: outside of the code area", pc);
+  result = SIM_FAULT;
+  goto out;
+
+bad_op:
+  pc = PC();
+  set_error_msg("pc %#llx: unknown opcode %#x", pc, *host(M, pc, 0));
+  result = SIM_FAULT;
+  goto out;
+
+bad_addr:
+  pc = PC();
+  set_error_msg("pc %#llx: address %#llx outside of memory", pc, a);
+  result = SIM_FAULT;
+
+out:
+  M->pc = pc;
+  M->steps += start - left;
+  return result;
+
+#undef PC
+#undef COUNT
+#undef CASE
+#undef DECODE_HANDLER
+#undef END_HANDLER
+#undef DISPATCH
+#undef EXECUTE
+#undef NEXT
+#undef JUMP
+#undef OP
+#undef PAIR
+#undef PAIR_
+#undef ADDRESS
+#undef INVALIDATE
+#undef LOAD
+#undef STORE
+#undef X
+#undef Y
+#undef BRANCH
+}
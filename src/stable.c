@@ -1,8 +1,13 @@
 #include "stable.h"
+#include "arena.h"
+#include "htable.h"
+#include "ftable.h"
+#include "cstable.h"
 #include "error.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifndef NULL
 #define NULL 0
@@ -10,96 +15,124 @@
 
 typedef unsigned char bool;
 
-// Symbol table definition - Implemented as ternary search tree
-struct stable_s {
+// Number of nodes carved out of each arena block.
+#define NODES_PER_BLOCK 512
+
+// Node of the ternary search tree. Characters are compared as
+// unsigned so that visiting order agrees with strcmp.
+typedef struct stable_node_s {
     bool last_node;
-    char value;
+    unsigned char value;
     EntryData data;
-    SymbolTable lower, middle, higher;
+    struct stable_node_s *lower, *middle, *higher;
+} Node;
+
+// Symbol table definition - Implemented as ternary search tree whose
+// nodes are allocated from an arena owned by the table, unless hash,
+// conc or frozen is set, in which case every operation is forwarded
+// to the hash table, the concurrent table or the frozen snapshot
+struct stable_s {
+    HashTable hash;
+    ConcurrentTable conc;
+    FrozenTable frozen;
+
+    Node *root;
+    Arena nodes;
+
+    // Statistics
+    size_t nnodes, nentries;
 };
 
-// Return a new symbol table (Can be used for creating new symbol table nodes)
+// Return a new symbol table
 SymbolTable stable_create()
+{
+    return stable_create_kind(STABLE_TST);
+}
+
+// Return a new symbol table of the given kind
+SymbolTable stable_create_kind(StableKind kind)
 {
     SymbolTable table = (SymbolTable) emalloc(sizeof(struct stable_s));
-    table->last_node = 0;
-    table->value = 0;
-    table->lower = NULL;
-    table->middle = NULL;
-    table->higher = NULL;
+    table->hash = kind == STABLE_HASH ? htable_create() : NULL;
+    table->conc = kind == STABLE_CONCURRENT ? cstable_create() : NULL;
+    table->frozen = NULL;
+    table->root = NULL;
+    table->nodes = arena_create(NODES_PER_BLOCK * sizeof(Node));
+    table->nnodes = table->nentries = 0;
     return table;
 }
 
-// Destroy a given symbol table.
+// Destroy a given symbol table. Nodes are released a block at a time.
 void stable_destroy(SymbolTable table)
 {
-    stable_destroy(table->lower);
-    stable_destroy(table->middle);
-    stable_destroy(table->higher);
+    if(table->hash) htable_destroy(table->hash);
+    if(table->conc) cstable_destroy(table->conc);
+    if(table->frozen) ftable_destroy(table->frozen);
+    arena_destroy(table->nodes);
     free(table);
 }
 
+// Take a new node for character c from the table's arena
+static Node *node_create(SymbolTable table, unsigned char c)
+{
+    Node *node = (Node*) arena_calloc(table->nodes, sizeof(Node));
+    node->value = c;
+    table->nnodes++;
+    return node;
+}
+
 // Insert a new entry on the symbol table given its key.
 InsertionResult stable_insert(SymbolTable table, const char *key)
 {
-    char *keychar = (char*) key;
+    if(table->frozen)
+    {
+        InsertionResult result;
+        result.new = 0;
+        result.data = ftable_find(table->frozen, key);
+        if(!result.data)
+            die("Cannot insert \"%s\" into a frozen symbol table.", key);
+        return result;
+    }
+    if(table->conc) return cstable_insert(table->conc, key);
+    if(table->hash) return htable_insert(table->hash, key);
 
-    SymbolTable currnode = table;
+    const unsigned char *keychar = (const unsigned char*) key;
+    Node **link = &table->root;
+    Node *currnode;
 
-    while(*keychar)
+    while(1)
     {
-        // If node not initialized
-        if(!currnode->value) currnode->value = *keychar;
+        // Create node case non-existent
+        if(!*link) *link = node_create(table, *keychar);
+        currnode = *link;
 
         // If current character is smaller than current node's
         if(*keychar < currnode->value)
-        {
-            // Create lower child case non-existent
-            if(!currnode->lower) currnode->lower = stable_create();
-            if(!currnode->lower)
-                die("Failed to allocate new node.");
+            link = &currnode->lower;
 
-            // Navigate to lower child
-            currnode = currnode->lower;
-            continue;
-        }
+        // If current character is greater than current node's
+        else if(*keychar > currnode->value)
+            link = &currnode->higher;
 
-        // If current character is equal to current node's
-        if(*keychar == currnode->value)
+        // Equal and not the last character: go to the middle child
+        else if(*keychar && *(keychar + 1))
         {
-            if(*(keychar + 1))
-            {
-                // Create middle child case non-existent
-                if(!currnode->middle) currnode->middle = stable_create();
-                if(!currnode->middle)
-                    die("Failed to allocate new node.");
-                // Navigate to middle child and go to next character
-                currnode = currnode->middle;
-            }
+            link = &currnode->middle;
             keychar++;
-            continue;
         }
 
-        // If current character is greater than current node's
-        if(*keychar > currnode->value)
-        {
-            // Create higher child case non-existent
-            if(!currnode->higher) currnode->higher = stable_create();
-            if(!currnode->higher)
-                die("Failed to allocate new node.");
-
-            // Navigate to higher child
-            currnode = currnode->higher;
-            continue;
-        }
+        // Equal and last character: this is the key's node
+        else break;
     }
 
-    // If last node not initialized
-    if(!currnode->value) currnode->value = *(keychar - 1);
     InsertionResult result;
 
     if(currnode->last_node) result.new = 0;
-    else result.new = 1;
+    else
+    {
+        result.new = 1;
+        table->nentries++;
+    }
 
     currnode->last_node = 1;
 
@@ -108,114 +141,314 @@ InsertionResult stable_insert(SymbolTable table, const char *key)
     return result;
 }
 
-// Find data associated with a given key.
-EntryData *stable_find(SymbolTable table, const char *key)
+// Return the node holding the last character of key, or NULL
+static Node *find_node(Node *currnode, const char *key)
 {
-    char *keychar = (char*) key;
+    const unsigned char *keychar = (const unsigned char*) key;
 
-    SymbolTable currnode = table;
-
-    while(*keychar)
+    while(currnode)
     {
-        // If node not initialized
-        if(!currnode->value) return NULL;
-
         // If current character is smaller than current node's
         if(*keychar < currnode->value)
-        {
-            // Key does not exist if node non-existent
-            if(!currnode->lower) return NULL;
-            // Navigate to lower child
             currnode = currnode->lower;
-        }
 
-        // If current character is equal to current node's
-        if(*keychar == currnode->value)
-        {
-            // Key does not exist if node non-existent
-            if(!currnode->middle) return NULL;
+        // If current character is greater than current node's
+        else if(*keychar > currnode->value)
+            currnode = currnode->higher;
 
-            // Navigate to middle child and go to next character
+        // Equal and not the last character: go to the middle child
+        else if(*keychar && *(keychar + 1))
+        {
             currnode = currnode->middle;
             keychar++;
         }
 
-        // If current character is greater than current node's
-        if(*keychar > currnode->value)
-        {
-            // Key does not exist if node non-existent
-            if(!currnode->higher) return NULL;
+        // Equal and last character
+        else return currnode;
+    }
 
-            // Navigate to higher child
-            currnode = currnode->higher;
-        }
+    return NULL;
+}
+
+// Find data associated with a given key.
+EntryData *stable_find(SymbolTable table, const char *key)
+{
+    if(table->frozen) return ftable_find(table->frozen, key);
+    if(table->conc) return cstable_find(table->conc, key);
+    if(table->hash) return htable_find(table->hash, key);
+
+    Node *node = find_node(table->root, key);
+
+    if(!node || !node->last_node) return NULL;
+    else return &node->data;
+}
+
+// Iteration over the tree keeps an explicit stack of frames. Each
+// frame goes through stages: visit lower child, emit own entry, visit
+// middle child, then get replaced by the higher child.
+typedef struct {
+    Node *node;
+    int depth;
+    unsigned char stage;
+    bool no_higher;  // Prefix root: siblings don't match the prefix
+} Frame;
+
+struct stable_iter_s {
+    SymbolTable table;
+
+    // Tree cursor
+    Frame *stack;
+    int sp, maxsp;
+
+    // Current key
+    char *key;
+    int maxlen;
+
+    // Sorted cursor (other kinds): position, end and prefix, and the
+    // snapshot of a concurrent table
+    size_t pos, n;
+    CstableEntry *snap;
+    char *prefix;
+    size_t prefixlen;
+};
+
+// Make room for a key of length len on the cursor
+static void iter_reserve(StableIter it, int len)
+{
+    if(len < it->maxlen) return;
+
+    while(it->maxlen <= len) it->maxlen *= 2;
+    it->key = (char*) realloc(it->key, it->maxlen);
+    if(!it->key)
+        die("Failed to reallocate string.");
+}
+
+// Push a frame on the cursor stack
+static void iter_push(StableIter it, Node *node, int depth, int stage,
+        bool no_higher)
+{
+    if(it->sp == it->maxsp)
+    {
+        it->maxsp *= 2;
+        it->stack = (Frame*) realloc(it->stack, it->maxsp * sizeof(Frame));
+        if(!it->stack)
+            die("Failed to reallocate iterator stack.");
     }
 
-    // If last node not initialized
-    if(!currnode->value) return NULL;
+    iter_reserve(it, depth + 1);
 
-    if(!currnode->last_node) return NULL;
-    else return &currnode->data;
+    Frame *f = &it->stack[it->sp++];
+    f->node = node;
+    f->depth = depth;
+    f->stage = stage;
+    f->no_higher = no_higher;
 }
 
-// Side recursive function for iterating table entries
-int stable_visit_rec(SymbolTable table, char *currstr, int *maxlen, int depth,
-        int (*visit)(const char *key, EntryData *data))
+// Key and data of entry i of a sorted cursor
+static const char *sorted_key(StableIter it, size_t i)
 {
-    if(!table) return 1;
+    if(it->snap) return it->snap[i].key;
+    if(it->table->frozen) return ftable_key(it->table->frozen, i);
+    return htable_sorted_key(it->table->hash, i);
+}
 
-    if(depth >= *maxlen - 1)
+static EntryData *sorted_data(StableIter it, size_t i)
+{
+    if(it->snap) return it->snap[i].data;
+    if(it->table->frozen) return ftable_data(it->table->frozen, i);
+    return htable_sorted_data(it->table->hash, i);
+}
+
+// Begin iterating over entries starting with prefix
+StableIter stable_iter_begin(SymbolTable table, const char *prefix)
+{
+    StableIter it = (StableIter) emalloc(sizeof(struct stable_iter_s));
+
+    if(!prefix) prefix = "";
+
+    it->table = table;
+    it->sp = 0;
+    it->maxsp = 32;
+    it->stack = (Frame*) emalloc(it->maxsp * sizeof(Frame));
+    it->maxlen = 64;
+    it->key = (char*) emalloc(it->maxlen);
+    it->key[0] = 0;
+    it->prefix = NULL;
+    it->prefixlen = strlen(prefix);
+    it->snap = NULL;
+
+    if(table->frozen || table->hash || table->conc)
+    {
+        if(table->frozen) it->n = ftable_size(table->frozen);
+        else if(table->hash) it->n = htable_sort(table->hash);
+        else it->n = cstable_snapshot(table->conc, &it->snap);
+        it->prefix = estrdup(prefix);
+
+        // Binary search for the first key not smaller than prefix
+        size_t lo = 0, hi = it->n;
+        while(lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if(strcmp(sorted_key(it, mid), prefix) < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        it->pos = lo;
+    }
+    else if(!*prefix)
     {
-        *maxlen += 20;
-        currstr = (char*) realloc(currstr, *maxlen + 1);
-        if(!currstr)
-            die("Failed to reallocate string.");
+        if(table->root) iter_push(it, table->root, 0, 0, 0);
     }
+    else
+    {
+        // Start at the prefix's last node, skipping its lower child and
+        // its siblings, which hold other prefixes
+        Node *node = find_node(table->root, prefix);
+        if(node)
+        {
+            iter_reserve(it, it->prefixlen + 1);
+            memcpy(it->key, prefix, it->prefixlen);
+            iter_push(it, node, it->prefixlen - 1, 1, 1);
+        }
+    }
+
+    return it;
+}
 
-    currstr[depth] = table->value;
-    currstr[depth + 1] = 0;
+// Advance to the next entry
+int stable_iter_next(StableIter it, const char **key, EntryData **data)
+{
+    if(it->prefix)
+    {
+        if(it->pos >= it->n) return 0;
 
-    if(!stable_visit_rec(table->lower, currstr,
-               maxlen, depth, visit)) return 0;
+        const char *k = sorted_key(it, it->pos);
+        if(strncmp(k, it->prefix, it->prefixlen)) return 0;
+
+        if(key) *key = k;
+        if(data) *data = sorted_data(it, it->pos);
+        it->pos++;
+        return 1;
+    }
 
-    currstr[depth] = table->value;
-    currstr[depth + 1] = 0;
-    
-    if(table->last_node)
+    while(it->sp > 0)
     {
-        if(!visit(currstr, &table->data)) return 0;
+        Frame *f = &it->stack[it->sp - 1];
+        Node *node = f->node;
+        int depth = f->depth;
+
+        switch(f->stage++)
+        {
+        case 0:
+            if(node->lower) iter_push(it, node->lower, depth, 0, 0);
+            break;
+
+        case 1:
+            it->key[depth] = node->value;
+            it->key[depth + 1] = 0;
+            if(node->last_node)
+            {
+                if(key) *key = it->key;
+                if(data) *data = &node->data;
+                return 1;
+            }
+            break;
+
+        case 2:
+            if(node->middle) iter_push(it, node->middle, depth + 1, 0, 0);
+            break;
+
+        default:
+            it->sp--;
+            if(node->higher && !f->no_higher)
+                iter_push(it, node->higher, depth, 0, 0);
+            break;
+        }
     }
-    
-    currstr[depth] = table->value;
-    currstr[depth + 1] = 0;
 
-    if(!stable_visit_rec(table->middle, currstr,
-                maxlen, depth + 1, visit)) return 0;
-    
-    currstr[depth] = table->value;
-    currstr[depth + 1] = 0;
+    return 0;
+}
 
-    if(!stable_visit_rec(table->higher, currstr,
-                maxlen, depth, visit)) return 0;
-    return 1;
+// Release the cursor
+void stable_iter_end(StableIter it)
+{
+    free(it->stack);
+    free(it->key);
+    free(it->prefix);
+    free(it->snap);
+    free(it);
 }
 
 // Visit each entry on the table
 int stable_visit(SymbolTable table,
         int (*visit)(const char *key, EntryData *data))
 {
-    int maxlen = 20;
-    char *string = (char*) malloc(maxlen*sizeof(char));
+    StableIter it = stable_iter_begin(table, NULL);
+    const char *key;
+    EntryData *data;
+    int ret = 1;
 
-    if(!string)
+    while(ret && stable_iter_next(it, &key, &data))
+        ret = visit(key, data);
+
+    stable_iter_end(it);
+
+    return ret;
+}
+
+// Turn the table into its frozen form
+void stable_freeze(SymbolTable table)
+{
+    if(table->frozen) return;
+
+    // Keys come out sorted, as ftable_create wants them
+    StableIter it = stable_iter_begin(table, NULL);
+    size_t n = table->nentries;
+    if(table->hash) n = htable_size(table->hash);
+    if(table->conc) n = it->n;
+
+    const char **keys = (const char**) emalloc((n ? n : 1) * sizeof(char*));
+    EntryData *data = (EntryData*) emalloc((n ? n : 1) * sizeof(EntryData));
+    Arena strings = arena_create(0);
+    const char *key;
+    EntryData *d;
+    size_t i = 0;
+
+    while(stable_iter_next(it, &key, &d))
     {
-        printf("stable: stable_visit: Failed to allocate string.\n");
-        exit(-1);
+        keys[i] = arena_strdup(strings, key);
+        data[i++] = *d;
     }
+    stable_iter_end(it);
+
+    table->frozen = ftable_create(i, keys, data);
+
+    arena_destroy(strings);
+    free(keys);
+    free(data);
+
+    // Release the mutable form
+    if(table->hash) htable_destroy(table->hash);
+    if(table->conc) cstable_destroy(table->conc);
+    table->hash = NULL;
+    table->conc = NULL;
+    arena_destroy(table->nodes);
+    table->nodes = arena_create(NODES_PER_BLOCK * sizeof(Node));
+    table->root = NULL;
+    table->nnodes = 0;
+}
 
-    int ret = stable_visit_rec(table, string, &maxlen, 0, visit);
-
-    free(string);
+// Return statistics on the table
+void stable_stats(SymbolTable table, StableStats *stats)
+{
+    if(table->frozen) ftable_stats(table->frozen, stats);
+    else if(table->hash) htable_stats(table->hash, stats);
+    else if(table->conc) cstable_stats(table->conc, stats);
+    else
+    {
+        stats->entries = table->nentries;
+        stats->nodes = table->nnodes;
+        stats->bytes = 0;
+    }
 
-    return ret;
+    stats->bytes += sizeof(struct stable_s) + arena_bytes(table->nodes);
 }
@@ -0,0 +1,158 @@
+/*
+  vmem.c
+*/
+
+#include "vmem.h"
+#include "error.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Each level of the table takes half the bits of the page number.
+#define LEVEL_BITS ((VMEM_BITS - VMEM_PAGE_BITS) / 2)
+#define LEVEL_SIZE ((size_t) 1 << LEVEL_BITS)
+
+struct vmem_s {
+  // Second-level tables by the high bits of the page number.
+  unsigned char **dir[LEVEL_SIZE];
+
+  uocta npages;
+};
+
+const unsigned char vmem_zeros[VMEM_PAGE_SIZE];
+
+
+VMem vmem_create()
+{
+  // Large enough for calloc to get it zero from the system
+  VMem V = calloc(1, sizeof(struct vmem_s));
+
+  if (!V)
+    die("Failed to allocate memory table.");
+  return V;
+}
+
+
+void vmem_destroy(VMem V)
+{
+  for (size_t i = 0; i < LEVEL_SIZE; i++)
+    if (V->dir[i]) {
+      for (size_t j = 0; j < LEVEL_SIZE; j++)
+        free(V->dir[i][j]);
+      free(V->dir[i]);
+    }
+  free(V);
+}
+
+
+unsigned char *vmem_page(VMem V, uocta a, int alloc)
+{
+  uocta page = a >> VMEM_PAGE_BITS;
+  unsigned char ***table = &V->dir[page >> LEVEL_BITS];
+
+  if (!*table) {
+    if (!alloc)
+      return 0;
+    *table = calloc(LEVEL_SIZE, sizeof(unsigned char *));
+    if (!*table)
+      die("Failed to allocate page table.");
+  }
+
+  unsigned char **p = &(*table)[page & (LEVEL_SIZE - 1)];
+
+  if (!*p) {
+    if (!alloc)
+      return 0;
+    *p = calloc(VMEM_PAGE_SIZE, 1);
+    if (!*p)
+      die("Failed to allocate page at %#llx.", a & ~(VMEM_PAGE_SIZE - 1));
+    V->npages++;
+  }
+
+  return *p;
+}
+
+
+// Bytes from a to the end of its page, at most n.
+static size_t span(uocta a, size_t n)
+{
+  uocta room = VMEM_PAGE_SIZE - (a & (VMEM_PAGE_SIZE - 1));
+
+  return room < n ? room : n;
+}
+
+void vmem_read(VMem V, uocta a, void *buf, size_t n)
+{
+  unsigned char *to = buf;
+
+  while (n) {
+    size_t k = span(a, n);
+    const unsigned char *page = vmem_page(V, a, 0);
+
+    memcpy(to, (page ? page : vmem_zeros) + (a & (VMEM_PAGE_SIZE - 1)), k);
+    to += k;
+    a += k;
+    n -= k;
+  }
+}
+
+void vmem_write(VMem V, uocta a, const void *buf, size_t n)
+{
+  const unsigned char *from = buf;
+
+  while (n) {
+    size_t k = span(a, n);
+
+    memcpy(vmem_page(V, a, 1) + (a & (VMEM_PAGE_SIZE - 1)), from, k);
+    from += k;
+    a += k;
+    n -= k;
+  }
+}
+
+
+// Page j of table i, or the zero page.
+static const unsigned char *page_or_zeros(VMem V, size_t i, size_t j)
+{
+  return V->dir[i] && V->dir[i][j] ? V->dir[i][j] : vmem_zeros;
+}
+
+int vmem_equal(VMem A, VMem B)
+{
+  for (size_t i = 0; i < LEVEL_SIZE; i++) {
+    if (!A->dir[i] && !B->dir[i])
+      continue;
+    for (size_t j = 0; j < LEVEL_SIZE; j++) {
+      const unsigned char *a = page_or_zeros(A, i, j);
+      const unsigned char *b = page_or_zeros(B, i, j);
+
+      if (a != b && memcmp(a, b, VMEM_PAGE_SIZE))
+        return 0;
+    }
+  }
+  return 1;
+}
+
+
+void vmem_copy(VMem to, VMem from)
+{
+  for (size_t i = 0; i < LEVEL_SIZE; i++) {
+    if (!to->dir[i] && !from->dir[i])
+      continue;
+    for (size_t j = 0; j < LEVEL_SIZE; j++) {
+      const unsigned char *src = page_or_zeros(from, i, j);
+      uocta a = ((uocta) i << LEVEL_BITS | j) << VMEM_PAGE_BITS;
+
+      // Pages of zeros are only copied over pages that exist
+      if (src != vmem_zeros)
+        memcpy(vmem_page(to, a, 1), src, VMEM_PAGE_SIZE);
+      else if (to->dir[i] && to->dir[i][j])
+        memset(to->dir[i][j], 0, VMEM_PAGE_SIZE);
+    }
+  }
+}
+
+
+uocta vmem_pages(VMem V)
+{
+  return V->npages;
+}
@@ -0,0 +1,206 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "archive.h"
+#include "linker.h"
+#include "object.h"
+#include "assembler.h"
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Builds a library of many small objects, checks its index, and links
+// a program using a few of its functions: only the members needed,
+// directly or through other members, must be pulled in. Compares the
+// time with linking every member as an object file.
+
+char dir[] = "/tmp/archive_testXXXXXX";
+
+void make_object(const char *src, const char *name)
+{
+    Assembler *A = assemble_source(src);
+
+    if (!obj_write(A, name, name))
+        die(0);
+    asm_destroy(A);
+}
+
+char *path(const char *file)
+{
+    char *p = emalloc(strlen(dir) + strlen(file) + 2);
+    sprintf(p, "%s/%s", dir, file);
+    return p;
+}
+
+// Member j of the library calls another member if j is a multiple of 4
+int callee(int j, int nlib)
+{
+    return j % 4 ? -1 : (j * 7 + 1) % nlib;
+}
+
+// Check every relocation against the first object exporting its symbol
+void check(Link *L)
+{
+    for (int i = 0; i < L->nobjects; i++)
+    {
+        const Object *O = L->objects[i];
+        for (uint32_t r = 0; r < O->header->nrelocs; r++)
+        {
+            const ObjReloc *rel = &O->relocs[r];
+            const char *name = obj_string(O, O->symbols[rel->symbol].name);
+            int target = -1;
+            for (int j = 0; j < L->nobjects && target < 0; j++)
+            {
+                const ObjSymbol *s = obj_find(L->objects[j], name);
+                if (s && (s->flags & OBJ_DEFINED) && (s->flags & OBJ_EXPORTED))
+                    target = L->base[j] + s->addr;
+            }
+            int site = L->base[i] + rel->site;
+            utetra w = O->code[rel->site];
+            if (target < 0 || !encode_patch(&w, target - site)
+                || L->code[site] != w)
+                die("%s: call to %s is wrong.", L->names[i], name);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int nlib = argc > 1 ? atoi(argv[1]) : 2000;
+    char src[1024];
+
+    set_prog_name("archive_test");
+    if (!mkdtemp(dir))
+        die("cannot create temporary directory:");
+
+    // The library; members 1 and 2 both export dup
+    char **members = emalloc(nlib * sizeof(char *));
+    for (int j = 0; j < nlib; j++)
+    {
+        size_t len = 0;
+        len += sprintf(src + len, "lib%d_a ADD $1, $2, $3\n", j);
+        len += sprintf(src + len, "  EXTERN lib%d_a\n", j);
+        if (callee(j, nlib) >= 0)
+            len += sprintf(src + len, "  CALL lib%d_a\n", callee(j, nlib));
+        len += sprintf(src + len, "lib%d_b STR \"member%d\"\n", j, j);
+        len += sprintf(src + len, "  EXTERN lib%d_b\n", j);
+        if (j == 1 || j == 2)
+            len += sprintf(src + len, "dup ADD $1, $1, %d\n  EXTERN dup\n", j);
+        sprintf(src + len, "  JMP lib%d_a\n", j);
+
+        char file[32];
+        sprintf(file, "m%d.mo", j);
+        members[j] = path(file);
+        make_object(src, members[j]);
+    }
+
+    char *lib = path("lib.ma");
+    double t0 = now();
+    if (!arc_write(lib, members, nlib))
+        die(0);
+    double t1 = now();
+
+    // The index
+    Archive *A = arc_open(lib);
+    if (!A)
+        die(0);
+    if (A->header->nindex != (uint32_t)(2 * nlib + 1))
+        die("%u symbols in the index, expected %d.", A->header->nindex,
+            2 * nlib + 1);
+    for (uint32_t k = 1; k < A->header->nindex; k++)
+        if (strcmp(arc_string(A, A->index[k - 1].name),
+                   arc_string(A, A->index[k].name)) >= 0)
+            die("index out of order.");
+    for (int j = 0; j < nlib; j++)
+    {
+        char name[32];
+        sprintf(name, "lib%d_b", j);
+        if (arc_lookup(A, name) != j)
+            die("%s is in member %d.", name, arc_lookup(A, name));
+    }
+    if (arc_lookup(A, "dup") != 1 || arc_lookup(A, "nothing") != -1)
+        die("wrong lookup of dup or nothing.");
+    Object *O = arc_member(A, 3);
+    if (!O || !obj_find(O, "lib3_a"))
+        die("member 3 is wrong.");
+    obj_close(O);
+
+    // Writing the archive again leaves the open one as it was
+    if (!arc_write(lib, members, 2))
+        die(0);
+    if (arc_lookup(A, "lib40_b") != 40)
+        die("open archive changed when written again.");
+    arc_close(A);
+    if (!arc_write(lib, members, nlib))
+        die(0);
+
+    // A program using a few functions
+    char *prog = path("main.mo");
+    int uses[] = { 5, 10, 12, 40 };
+    size_t len = sprintf(src, "main CALL dup\n");
+    for (int u = 0; u < 4; u++)
+        len += sprintf(src + len, "  CALL lib%d_%c\n", uses[u], "ab"[u % 2]);
+    make_object(src, prog);
+
+    // Members needed: those used, member 1 for dup, and their callees
+    unsigned char *needed = calloc(nlib, 1);
+    int nneeded = 0;
+    needed[1] = 1;
+    for (int u = 0; u < 4; u++)
+        needed[uses[u]] = 1;
+    for (int changed = 1; changed;)
+    {
+        changed = 0;
+        for (int j = 0; j < nlib; j++)
+            if (needed[j] && callee(j, nlib) >= 0 && !needed[callee(j, nlib)])
+                needed[callee(j, nlib)] = changed = 1;
+    }
+    for (int j = 0; j < nlib; j++)
+        nneeded += needed[j];
+
+    double t2 = now();
+    Link *L = link_archives(&prog, 1, &lib, 1, 4);
+    double t3 = now();
+    for (int i = 0; i < L->nerrors; i++)
+        fprintf(stderr, "%s\n", L->errors[i]);
+    if (L->nerrors)
+        die("%d errors.", L->nerrors);
+    if (L->nobjects != 1 + nneeded)
+        die("%d members pulled in, expected %d.", L->nobjects - 1, nneeded);
+    for (int i = 1; i < L->nobjects; i++)
+    {
+        int j;
+        if (sscanf(strrchr(L->names[i], '(') + 1, "m%d.mo", &j) != 1
+            || !needed[j])
+            die("member %s pulled in.", L->names[i]);
+    }
+    check(L);
+    link_destroy(L);
+
+    // Every member as an object file
+    char **all = emalloc((nlib + 1) * sizeof(char *));
+    all[0] = prog;
+    memcpy(all + 1, members, nlib * sizeof(char *));
+    double t4 = now();
+    L = link_files(all, nlib + 1, 4);
+    double t5 = now();
+    link_destroy(L);
+
+    printf("%d members: archived in %.3fs; %d pulled in %.4fs, "
+           "all linked in %.4fs\n", nlib, t1 - t0, nneeded, t3 - t2,
+           t5 - t4);
+
+    for (int j = 0; j < nlib; j++)
+        unlink(members[j]);
+    unlink(lib);
+    unlink(prog);
+    rmdir(dir);
+
+    return 0;
+}
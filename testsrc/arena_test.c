@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "arena.h"
+#include "stable.h"
+#include "error.h"
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Checks the arena: alignment, no overlap between objects, private
+// blocks for oversized requests, and that tables built on arenas give
+// all their memory back when destroyed.
+
+#define BLOCK 1024
+
+void check_aligned(void *p, size_t size)
+{
+    if ((uintptr_t) p % 16)
+        die("%zu bytes at %p, not aligned to 16.", size, p);
+}
+
+// Allocates objects of many sizes, fills each with its own byte and
+// checks that no fill overwrote another object.
+void test_alignment()
+{
+    Arena A = arena_create(BLOCK);
+    unsigned char *objs[200];
+    size_t sizes[200];
+
+    for (int i = 0; i < 200; i++)
+    {
+        sizes[i] = 1 + i * 7 % 61;
+        objs[i] = arena_alloc(A, sizes[i]);
+        check_aligned(objs[i], sizes[i]);
+        memset(objs[i], i, sizes[i]);
+    }
+    for (int i = 0; i < 200; i++)
+        for (size_t j = 0; j < sizes[i]; j++)
+            if (objs[i][j] != (unsigned char) i)
+                die("object %d overwritten.", i);
+
+    unsigned char *z = arena_calloc(A, 33);
+    check_aligned(z, 33);
+    for (int i = 0; i < 33; i++)
+        if (z[i])
+            die("arena_calloc memory not zero.");
+
+    char *s = arena_strdup(A, "arena");
+    check_aligned(s, 6);
+    if (strcmp(s, "arena"))
+        die("arena_strdup gave \"%s\".", s);
+
+    arena_destroy(A);
+}
+
+// A request larger than a block gets a block of its own, and the free
+// region of the current block is still used afterwards.
+void test_oversized()
+{
+    Arena A = arena_create(BLOCK);
+
+    char *a = arena_alloc(A, 16);
+    if (arena_blocks(A) != 1)
+        die("%zu blocks after the first request.", arena_blocks(A));
+    size_t bytes = arena_bytes(A);
+
+    char *big = arena_alloc(A, 5 * BLOCK);
+    check_aligned(big, 5 * BLOCK);
+    memset(big, 0xff, 5 * BLOCK);
+    if (arena_blocks(A) != 2)
+        die("%zu blocks after an oversized request.", arena_blocks(A));
+    if (arena_bytes(A) < bytes + 5 * BLOCK)
+        die("%zu bytes after an oversized request.", arena_bytes(A));
+
+    char *b = arena_alloc(A, 16);
+    if (arena_blocks(A) != 2 || b != a + 16)
+        die("oversized request left the current block.");
+
+    // Fill the current block; only then is a new one added
+    for (size_t used = 32; used < BLOCK; used += 16)
+        arena_alloc(A, 16);
+    if (arena_blocks(A) != 2)
+        die("%zu blocks for a full block.", arena_blocks(A));
+    arena_alloc(A, 16);
+    if (arena_blocks(A) != 3)
+        die("%zu blocks after a full block.", arena_blocks(A));
+
+    arena_destroy(A);
+}
+
+// Bytes in use by malloc, in the heap and in blocks of their own
+size_t in_use()
+{
+    struct mallinfo2 m = mallinfo2();
+
+    return m.uordblks + m.hblkhd;
+}
+
+// Tables of every kind hold their nodes in arenas: their memory grows
+// with the entries, and stable_destroy gives it back.
+void test_tables()
+{
+    StableKind kinds[] = { STABLE_TST, STABLE_HASH, STABLE_CONCURRENT };
+    char key[32];
+
+    for (int k = 0; k < 3; k++)
+    {
+        size_t before = in_use();
+        SymbolTable table = stable_create_kind(kinds[k]);
+        StableStats small, large;
+
+        stable_insert(table, "a");
+        stable_stats(table, &small);
+        for (int i = 0; i < 20000; i++)
+        {
+            sprintf(key, "key%d", i);
+            stable_insert(table, key);
+        }
+        stable_stats(table, &large);
+        if (large.entries != 20001 || large.bytes <= small.bytes)
+            die("table %d: %zu entries in %zu bytes.", k, large.entries,
+                large.bytes);
+        if (in_use() - before < large.bytes / 2)
+            die("table %d: %zu bytes reported, %zu in use.", k,
+                large.bytes, in_use() - before);
+
+        // Freed chunks cached by malloc still count as in use
+        stable_destroy(table);
+        if (in_use() > before + large.bytes / 100)
+            die("table %d: %zu bytes left after destroy.", k,
+                in_use() - before);
+    }
+}
+
+int main()
+{
+    set_prog_name("arena_test");
+
+    test_alignment();
+    test_oversized();
+    test_tables();
+
+    return 0;
+}
@@ -0,0 +1,134 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "assembler.h"
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "opcodes.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Assembles a generated program in one pass and checks that the code
+// is the same as the two-pass encoder's; then checks that jumps to
+// undefined labels become relocations.
+
+// Generate a program with jumps both ways; every externs-th line calls
+// an undefined label, if externs is nonzero
+char *generate(int nlines, int externs)
+{
+    size_t len = 0;
+    char *src = emalloc((size_t)nlines * 48 + 1);
+
+    for (int i = 0; i < nlines; i++)
+    {
+        if (externs && i % externs == externs - 1)
+        {
+            len += sprintf(src + len, "  CALL ext%d\n", i % 7);
+            continue;
+        }
+        switch (i % 6)
+        {
+        case 0:
+            len += sprintf(src + len, "l%d ADD $1, $2, $3\n", i);
+            break;
+        case 1:
+            len += sprintf(src + len, "  JZ $4, l%d\n",
+                           i + 11 < nlines ? i + 11 : i - 1);
+            break;
+        case 2:
+            len += sprintf(src + len, "  JNZ $4, l%d\n", i - 2);
+            break;
+        case 3:
+            len += sprintf(src + len, "  JMP l%d\n",
+                           i + 3 < nlines ? i + 3 : 0);
+            break;
+        case 4:
+            len += sprintf(src + len, "  CALL l%d\n",
+                           i + 20 < nlines ? i + 20 : 0);
+            break;
+        default:
+            len += sprintf(src + len, "  STR \"x%d\"\n", i);
+            break;
+        }
+    }
+
+    return src;
+}
+
+int main(int argc, char *argv[])
+{
+    int nlines = argc > 1 ? atoi(argv[1]) : 200000;
+    const Instruction *bad;
+    Instruction *head;
+
+    set_prog_name("assemble_test");
+
+    char *src = generate(nlines, 0);
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    parse_source(src, aliases, &head, 0);
+
+    // Best of a few rounds of each, alternating, so that both find
+    // the allocator warmed up
+    double two = 1e9, one = 1e9;
+    utetra *code = 0;
+    Assembler *A = 0;
+    int n = 0;
+    for (int round = 0; round < 3; round++)
+    {
+        // Two passes
+        double t0 = now();
+        SymbolTable labels = stable_create_kind(STABLE_HASH);
+        n = encode_layout(head, labels, &bad);
+        if (n < 0)
+            die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+        free(code);
+        code = emalloc(n * sizeof(utetra));
+        if (encode_program(head, labels, code, &bad) != n)
+            die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+        double t1 = now();
+        stable_destroy(labels);
+
+        // One pass
+        if (A)
+            asm_destroy(A);
+        double t2 = now();
+        A = asm_create();
+        if (!asm_list(A, head, &bad))
+            die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+        if (asm_finish(A) != 0)
+            die("unexpected relocations.");
+        double t3 = now();
+
+        if (t1 - t0 < two) two = t1 - t0;
+        if (t3 - t2 < one) one = t3 - t2;
+    }
+
+    if (A->n != n || memcmp(A->code, code, n * sizeof(utetra)))
+        die("one-pass code differs from two-pass code.");
+
+    printf("%d lines: two passes %.3fs, one pass %.3fs\n", nlines, two, one);
+    asm_destroy(A);
+
+    // Calls to undefined labels
+    src = generate(1000, 10);
+    parse_source(src, aliases, &head, 0);
+    A = asm_create();
+    if (!asm_list(A, head, &bad))
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+    if (asm_finish(A) != 100)
+        die("%d relocations, expected 100.", A->nrelocs);
+    for (int i = 0; i < A->nrelocs; i++)
+    {
+        Reloc *r = &A->relocs[i];
+        if (strncmp(r->name, "ext", 3) || A->code[r->site] != JMP << 24)
+            die("bad relocation at %d.", r->site);
+        if (i && r->site <= A->relocs[i - 1].site)
+            die("relocations out of order.");
+    }
+    asm_destroy(A);
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "buffer.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Checks buffers: growth, constant-time reset, and read_line on a file
+// and on a pipe, with and without read-ahead, on blank lines, lines
+// much longer than a read block and a last line without a newline.
+
+// Builds the text read back by the tests
+char *make_text(size_t *len)
+{
+    Buffer *B = buffer_create();
+
+    buffer_append(B, "first line\n\n  \n", 15);
+    for (int i = 0; i < 300000; i++)
+        buffer_push_back(B, 'a' + i % 26);
+    buffer_push_back(B, '\n');
+    for (int i = 0; i < 5000; i++)
+    {
+        char line[64];
+        int n = sprintf(line, "%*sline %d\n", i % 40, "", i);
+        buffer_append(B, line, n);
+    }
+    buffer_append(B, "no newline", 10);
+
+    char *text = malloc(B->i + 1);
+    memcpy(text, B->data, B->i);
+    text[B->i] = 0;
+    *len = B->i;
+    buffer_destroy(B);
+    return text;
+}
+
+// Reads input with read_line, checking each line against text
+void check_lines(FILE *input, const char *text, int readahead)
+{
+    Buffer *B = buffer_create();
+    const char *expected = text;
+    int n, nlines = 0;
+
+    buffer_readahead(B, readahead);
+    while ((n = read_line(input, B)) > 0)
+    {
+        const char *eol = strchr(expected, '\n');
+        int len = eol ? eol - expected + 1 : strlen(expected);
+
+        if (n != len || n != B->i || memcmp(B->data, expected, len))
+            die("line %d: read %d characters, expected %d.", nlines + 1,
+                n, len);
+        if (B->data[n])
+            die("line %d not terminated.", nlines + 1);
+        expected += len;
+        nlines++;
+    }
+    if (*expected)
+        die("read stopped after %d lines.", nlines);
+    if (read_line(input, B) || B->i || B->data[0])
+        die("read past the end.");
+
+    buffer_destroy(B);
+}
+
+// Returns a stream reading text through a pipe, written by a child
+FILE *pipe_of(const char *text, size_t len)
+{
+    int fds[2];
+
+    if (pipe(fds))
+        die("cannot create pipe:");
+    if (!fork())
+    {
+        close(fds[0]);
+        for (size_t done = 0; done < len; )
+        {
+            ssize_t w = write(fds[1], text + done, len - done);
+            if (w <= 0)
+                _exit(1);
+            done += w;
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+
+    return fdopen(fds[0], "r");
+}
+
+int main()
+{
+    set_prog_name("buffer_test");
+
+    // Growth and reset
+    Buffer *B = buffer_create();
+    for (int i = 0; i < 1000; i++)
+        buffer_push_back(B, i % 128);
+    buffer_append(B, "tail", 4);
+    if (B->i != 1004 || B->n < 1004 || memcmp(B->data + 1000, "tail", 4))
+        die("buffer holds %d characters, expected 1004.", B->i);
+    for (int i = 0; i < 1000; i++)
+        if (B->data[i] != i % 128)
+            die("character %d lost when growing.", i);
+
+    int n = B->n;
+    char *data = B->data;
+    buffer_reset(B);
+    if (B->i || B->n != n || B->data != data)
+        die("reset did not keep the memory.");
+    buffer_append(B, "ab", 2);
+    if (B->i != 2 || memcmp(B->data, "ab", 2))
+        die("append after reset.");
+    buffer_destroy(B);
+
+    // Lines from a file, mapped, and from a pipe, read directly and
+    // ahead
+    size_t len;
+    char *text = make_text(&len);
+    FILE *file = tmpfile();
+    if (!file || fwrite(text, 1, len, file) != len || fflush(file))
+        die("cannot write temporary file:");
+
+    rewind(file);
+    check_lines(file, text, 0);
+    rewind(file);
+    check_lines(file, text, 3);
+    fclose(file);
+
+    for (int readahead = 0; readahead <= 3; readahead += 3)
+    {
+        FILE *input = pipe_of(text, len);
+        check_lines(input, text, readahead);
+        fclose(input);
+        wait(0);
+    }
+
+    // An empty input
+    file = tmpfile();
+    B = buffer_create();
+    if (read_line(file, B) || B->data[0])
+        die("read a line from an empty file.");
+    buffer_destroy(B);
+    fclose(file);
+
+    free(text);
+    return 0;
+}
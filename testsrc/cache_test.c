@@ -0,0 +1,216 @@
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "objcache.h"
+#include "object.h"
+#include "assembler.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Assembles a set of generated sources through the cache twice, and
+// checks that the second time every object comes from the cache, the
+// same as before; then checks that keys change with the options and
+// the source name, that rewriting an output leaves the cache alone,
+// and that the least recently used entries are evicted.
+
+char dir[] = "/tmp/cache_testXXXXXX";
+
+char *path(const char *fmt, int i)
+{
+    char *p = emalloc(strlen(dir) + 64);
+    int n = sprintf(p, "%s/", dir);
+    sprintf(p + n, fmt, i);
+    return p;
+}
+
+char *generate(int seed, int nlines)
+{
+    char *src = emalloc((size_t)nlines * 40 + 1);
+    size_t len = 0;
+
+    for (int i = 0; i < nlines; i++)
+        switch (i % 3)
+        {
+        case 0:
+            len += sprintf(src + len, "l%d ADD $1, $2, %d\n", i, seed % 200);
+            break;
+        case 1:
+            len += sprintf(src + len, "  JZ $3, l%d\n", i - 1);
+            break;
+        default:
+            len += sprintf(src + len, "  STR \"s%d\"\n", seed);
+            break;
+        }
+
+    return src;
+}
+
+// Assemble src through the cache; returns 1 on a hit
+int build(ObjCache C, const char *src, const char *source,
+          const char *options, const char *dest)
+{
+    char key[CACHE_KEY_LEN + 1];
+    cache_key(src, strlen(src), source, options, key);
+
+    int hit = cache_get(C, key, dest);
+    if (hit < 0)
+        die(0);
+    if (hit)
+        return 1;
+
+    Assembler *A = assemble_source(src);
+    size_t size;
+    void *image = obj_build(A, source, &size);
+    if (!obj_save(image, size, dest) || !cache_put(C, key, image, size))
+        die(0);
+
+    free(image);
+    asm_destroy(A);
+    return 0;
+}
+
+char *slurp(const char *name, size_t *size)
+{
+    FILE *f = fopen(name, "rb");
+    if (!f)
+        die("cannot open '%s':", name);
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    rewind(f);
+    char *buf = emalloc(*size + 1);
+    if (fread(buf, 1, *size, f) != *size)
+        die("cannot read '%s':", name);
+    fclose(f);
+    return buf;
+}
+
+void same_file(const char *a, const char *b)
+{
+    size_t na, nb;
+    char *x = slurp(a, &na), *y = slurp(b, &nb);
+    if (na != nb || memcmp(x, y, na))
+        die("'%s' and '%s' differ.", a, b);
+    free(x);
+    free(y);
+}
+
+int main(int argc, char *argv[])
+{
+    int nfiles = argc > 1 ? atoi(argv[1]) : 40;
+    int nlines = 5000;
+
+    set_prog_name("cache_test");
+    if (!mkdtemp(dir))
+        die("cannot create temporary directory:");
+
+    char *cachedir = path("cache", 0);
+    ObjCache C = cache_open(cachedir, 1 << 30);
+    if (!C)
+        die(0);
+
+    char **srcs = emalloc(nfiles * sizeof(char *));
+    char **outs = emalloc(nfiles * sizeof(char *));
+    char **firsts = emalloc(nfiles * sizeof(char *));
+    for (int i = 0; i < nfiles; i++)
+    {
+        srcs[i] = generate(i, nlines);
+        outs[i] = path("out%d.mo", i);
+        firsts[i] = path("first%d.mo", i);
+    }
+
+    // Cold and warm builds
+    double t0 = now();
+    for (int i = 0; i < nfiles; i++)
+        if (build(C, srcs[i], "gen.as", "", outs[i]))
+            die("unexpected hit on a cold cache.");
+    double t1 = now();
+    for (int i = 0; i < nfiles; i++)
+        if (rename(outs[i], firsts[i]))
+            die("cannot rename '%s':", outs[i]);
+    double t2 = now();
+    for (int i = 0; i < nfiles; i++)
+        if (!build(C, srcs[i], "gen.as", "", outs[i]))
+            die("miss on a warm cache.");
+    double t3 = now();
+    for (int i = 0; i < nfiles; i++)
+        same_file(firsts[i], outs[i]);
+
+    // Other options, another source name, a changed source
+    if (build(C, srcs[0], "gen.as", "-x", outs[0])
+        || build(C, srcs[0], "other.as", "", outs[0]))
+        die("hit with other options or source name.");
+    char *last = srcs[1] + strlen(srcs[1]) - 2, was = *last;
+    *last = was == '7' ? '8' : '7';
+    if (build(C, srcs[1], "gen.as", "", outs[1]))
+        die("hit with a changed source.");
+
+    // Rewriting an output that is a link to an entry
+    *last = was;
+    if (!build(C, srcs[2], "gen.as", "", outs[2]))
+        die("miss on a warm cache.");
+    if (!obj_save("garbage", 7, outs[2]))
+        die(0);
+    if (!build(C, srcs[2], "gen.as", "", outs[2]))
+        die("miss on a warm cache.");
+    same_file(firsts[2], outs[2]);
+
+    printf("%d sources of %d lines: cold %.3fs, warm %.4fs\n", nfiles,
+           nlines, t1 - t0, t3 - t2);
+    cache_close(C);
+
+    // Eviction: five entries of 1000 bytes in room for four
+    char *smalldir = path("small", 0);
+    C = cache_open(smalldir, 4000);
+    if (!C)
+        die(0);
+    char image[1000], keys[5][CACHE_KEY_LEN + 1];
+    memset(image, 'x', sizeof(image));
+    for (int k = 0; k < 5; k++)
+    {
+        char src[16];
+        sprintf(src, "%d", k);
+        cache_key(src, strlen(src), "", "", keys[k]);
+    }
+    for (int k = 0; k < 4; k++)
+    {
+        if (!cache_put(C, keys[k], image, sizeof(image)))
+            die(0);
+        // Entries last used at times 1000 + k, to be independent of
+        // the resolution of file times
+        char *entry = emalloc(strlen(smalldir) + CACHE_KEY_LEN + 8);
+        sprintf(entry, "%s/%s.mo", smalldir, keys[k]);
+        struct timespec times[2] = { { 1000 + k, 0 }, { 1000 + k, 0 } };
+        if (utimensat(AT_FDCWD, entry, times, 0))
+            die("cannot set the time of '%s':", entry);
+        free(entry);
+    }
+    char *dest = path("small.mo", 0);
+    if (cache_get(C, keys[0], dest) != 1)
+        die("miss on a warm cache.");
+    if (!cache_put(C, keys[4], image, sizeof(image)))
+        die(0);
+    if (cache_bytes(C) > 3000)
+        die("%zu bytes left after eviction.", cache_bytes(C));
+    int expected[5] = { 1, 0, 0, 1, 1 };
+    for (int k = 0; k < 5; k++)
+        if (cache_get(C, keys[k], dest) != expected[k])
+            die("entry %d %s.", k, expected[k] ? "evicted" : "kept");
+    cache_close(C);
+
+    char cmd[64];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+    if (system(cmd))
+        die("cannot remove '%s'.", dir);
+
+    return 0;
+}
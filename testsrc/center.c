@@ -43,8 +43,12 @@ int main(int argc, char *argv[])
         {   //find the first non-space char
             for (i = 0; isspace(line->data[i]) > 0 && i < charNum ; i++);
             firstc = i;
-            //find the last non-space char
-            for (i += 1; i < charNum - 1; i++)
+            //find the last non-space char (the buffer holds only
+            //the current line, so never look past charNum); on a
+            //blank line it stays before firstc and only the
+            //centering spaces are printed
+            lastc = firstc - 1;
+            for (; i < charNum; i++)
             {
                 if (!isspace(line->data[i]))
                     lastc = i;
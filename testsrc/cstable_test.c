@@ -0,0 +1,87 @@
+#include "stable.h"
+#include "error.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every thread inserts the same keys, in a different order, and counts
+// how many insertions it was told were new.
+#define NTHREADS 8
+#define NKEYS 100000
+
+SymbolTable table;
+int created[NTHREADS];
+
+void *worker(void *arg)
+{
+    int id = *(int*) arg;
+    char key[32];
+
+    for(int i = 0; i < NKEYS; i++)
+    {
+        int k = (i * 7919 + id * 104729) % NKEYS;
+        sprintf(key, "label_%d", k);
+        InsertionResult r = stable_insert(table, key);
+        if(r.new)
+        {
+            r.data->i = k;
+            created[id]++;
+        }
+        if(!stable_find(table, key))
+            die("thread %d: key %s not found after insertion.", id, key);
+    }
+    return NULL;
+}
+
+// Check that keys are visited in increasing order
+int check_order(const char *key, EntryData *data)
+{
+    static char prev[32] = "";
+    if(*prev && strcmp(prev, key) >= 0)
+        die("keys out of order: %s, %s.", prev, key);
+    snprintf(prev, sizeof(prev), "%s", key);
+    return 1;
+}
+
+int main()
+{
+    set_prog_name("cstable_test");
+
+    pthread_t threads[NTHREADS];
+    int ids[NTHREADS];
+    table = stable_create_kind(STABLE_CONCURRENT);
+
+    for(int i = 0; i < NTHREADS; i++)
+    {
+        ids[i] = i;
+        pthread_create(&threads[i], NULL, worker, &ids[i]);
+    }
+    for(int i = 0; i < NTHREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    int total = 0;
+    for(int i = 0; i < NTHREADS; i++)
+        total += created[i];
+    if(total != NKEYS)
+        die("%d insertions reported new, expected %d.", total, NKEYS);
+
+    char key[32];
+    for(int k = 0; k < NKEYS; k++)
+    {
+        sprintf(key, "label_%d", k);
+        EntryData *data = stable_find(table, key);
+        if(!data || data->i != k)
+            die("wrong data for key %s.", key);
+    }
+
+    stable_visit(table, check_order);
+
+    StableStats stats;
+    stable_stats(table, &stats);
+    printf("%zu entries, %zu slots, %zu bytes\n",
+           stats.entries, stats.nodes, stats.bytes);
+
+    stable_destroy(table);
+    return 0;
+}
@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Checks the encoding of a small program, then measures the encoder's
+// throughput on a generated one.
+
+static const char *program =
+    "start ADD $1, $2, $3\n"
+    "      ADD $1, $2, 5\n"
+    "      JZ $1, end\n"
+    "loop  SUB $1, $1, 1\n"
+    "      JNZ $1, loop\n"
+    "      CALL start\n"
+    "      STR \"hi\"\n"
+    "end   INT 1\n"
+    "      RET 2; PUSH $9; SETW $3, h1234; SAVE $1, $2, $3\n";
+
+static const utetra expected[] = {
+    0x20010203, 0x21010205, 0x4a010008, 0x23010101, 0x4d010001,
+    0x58fc0004, 0x1ffcfd00, 0x31fdfd08, 0x49000008,
+    0x68690000, 0xfe000001,
+    0x33fdfd18, 0x0ffcfd10, 0x56fc0000, 0x1f09fd00, 0x31fdfd08,
+    0x5a031234, 0x5b010203
+};
+
+// Parse and encode src; returns the code and stores its size in *n
+utetra *encode_source(const char *src, Instruction **head,
+                      SymbolTable labels, int *n)
+{
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    const Instruction *bad;
+
+    parse_source(src, aliases, head, 0);
+    stable_destroy(aliases);
+
+    *n = encode_layout(*head, labels, &bad);
+    if (*n < 0)
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+
+    utetra *code = emalloc((*n ? *n : 1) * sizeof(utetra));
+    if (encode_program(*head, labels, code, &bad) != *n)
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+
+    return code;
+}
+
+int main(int argc, char *argv[])
+{
+    int nlines = argc > 1 ? atoi(argv[1]) : 200000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    Instruction *head;
+    int n;
+
+    set_prog_name("encode_test");
+
+    SymbolTable labels = stable_create_kind(STABLE_HASH);
+    utetra *code = encode_source(program, &head, labels, &n);
+    int nexpected = sizeof(expected) / sizeof(expected[0]);
+    if (n != nexpected)
+        die("encoded %d words, expected %d.", n, nexpected);
+    for (int i = 0; i < n; i++)
+        if (code[i] != expected[i])
+            die("word %d: %08x, expected %08x.", i, code[i], expected[i]);
+    free(code);
+    stable_destroy(labels);
+
+    // A program with jumps both ways
+    size_t max = (size_t)nlines * 48 + 1, len = 0;
+    char *src = emalloc(max);
+    for (int i = 0; i < nlines; i++)
+    {
+        switch (i % 8)
+        {
+        case 0:
+            len += sprintf(src + len, "l%d ADD $1, $2, $3\n", i);
+            break;
+        case 1:
+            len += sprintf(src + len, "  SUB $4, $4, 1\n");
+            break;
+        case 2:
+            len += sprintf(src + len, "  JNZ $4, l%d\n", i - 2);
+            break;
+        case 3:
+            len += sprintf(src + len, "  JMP l%d\n", i + 5 < nlines ? i + 5 : 0);
+            break;
+        case 4:
+            len += sprintf(src + len, "  LDOU $5, $6, 8\n");
+            break;
+        case 5:
+            len += sprintf(src + len, "  SETW $7, %d\n", i % 65536);
+            break;
+        case 6:
+            len += sprintf(src + len, "  CALL l%d\n", i - 6);
+            break;
+        default:
+            len += sprintf(src + len, "  MUL $%d, $7, $8\n", i % 250);
+            break;
+        }
+    }
+
+    labels = stable_create_kind(STABLE_HASH);
+    code = encode_source(src, &head, labels, &n);
+
+    double t0 = now();
+    for (int r = 0; r < rounds; r++)
+        encode_program(head, labels, code, 0);
+    double t1 = now();
+
+    printf("%d instructions, %d words: %.1f M instructions/s\n", nlines, n,
+           (double)nlines * rounds / (t1 - t0) / 1e6);
+    return 0;
+}
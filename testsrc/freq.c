@@ -1,5 +1,7 @@
 #include "stable.h"
 #include "error.h"
+#include "buffer.h"
+#include "lsource.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,63 +19,64 @@ int print_word(const char *key, EntryData *data)
 	return 1;
 }
 
-// Returns length of longest word from current position on file
-// Example:
-//     FILE * fp = fopen("bar.txt", "r");
-//     int len = longestWord(fp);
-int longestWord(FILE * file)
-{
-    fpos_t pos;
-    if(fgetpos(file, &pos)) return -1;
-    char c;
-    int sz, max;
-    sz = max = 0;
-    while((c = fgetc(file)) != EOF)
-    {
-        if(!isspace(c)) sz++;
-        else
-        {
-            if(sz > max) max = sz;
-            sz = 0;
-        }
-    }
-    if(sz > max) max = sz;
-
-    if(fsetpos(file, &pos)) return -1;
-    return max;
-}
-
 // Main function
 int main(int argc, char *argv[])
 {
     set_prog_name("freq");
     set_error_msg("Failed to allocate memory.");
+    // Option -s prints symbol table statistics to stderr
+    const char *prog = argv[0];
+    int show_stats = argc > 1 && !strcmp(argv[1], "-s");
+    if(show_stats)
+    {
+        argv++;
+        argc--;
+    }
+
     if(argc < 2)
     {
-        printf("Usage: %s <filename>\n", argv[0]);
+        printf("Usage: %s [-s] <filename>\n", prog);
         exit(0);
     }
 
-	FILE* fp;
-	char *word;
+	LineSource input;
+	Buffer *word = buffer_create();
 	SymbolTable table = stable_create();
 
-	fp = fopen(argv[1], "r");
-
-	if(!fp) die("Could not open file %s.", argv[1]);
+	input = lsource_open(argv[1]);
 
-    maxlen = longestWord(fp);
-    if (maxlen < 0) die("Couldn't determine longest word in file.");
+	if(!input) die("Could not open file %s.", argv[1]);
 
-    // Allocate enough for the longest word in the file
-    word = (char*) emalloc((maxlen + 1)*sizeof(char));
+    // Overlap reading with counting when the input is a pipe
+    lsource_readahead(input, 3);
 
-	for (;fscanf(fp, "%s", word) != EOF;)
-        stable_insert(table, word).data->i++;
+    // Words are views into the input; copy each one into a
+    // NUL-terminated buffer for insertion, and track the longest
+    const char *w;
+    int len;
+	while((w = lsource_word(input, &len)))
+    {
+        buffer_reset(word);
+        buffer_append(word, w, len);
+        buffer_push_back(word, 0);
+        stable_insert(table, word->data).data->i++;
+        if(len > maxlen) maxlen = len;
+    }
 
 	stable_visit(table, print_word);
 
-	if(fclose(fp)) die("Could not close file %s. Exiting anyway.", argv[1]);
+    if(show_stats)
+    {
+        StableStats stats;
+        stable_stats(table, &stats);
+        fprintf(stderr, "%zu entries, %zu nodes, %zu bytes\n",
+                stats.entries, stats.nodes, stats.bytes);
+    }
+
+    stable_destroy(table);
+
+    buffer_destroy(word);
+	lsource_close(input);
 
     return 0;
 }
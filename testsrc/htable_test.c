@@ -0,0 +1,149 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stable.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Fills a hash table and a tree with the same keys, enough for the
+// hash table to grow many times, and checks that insertions, lookups,
+// data pointers kept across growth, visits, prefix cursors and frozen
+// lookups give the same results on both.
+
+#define NKEYS 50000
+
+// Key of number k, in an order unlike that of the numbers
+void key_of(int k, char *key)
+{
+    sprintf(key, "k%d_%x", k % 97, k);
+}
+
+void fill(SymbolTable table, EntryData **data)
+{
+    char key[32];
+
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        InsertionResult r = stable_insert(table, key);
+        if (!r.new || r.data->i)
+            die("key %s not new, or its data not zero.", key);
+        r.data->i = i;
+        data[i] = r.data;
+    }
+    for (int i = 0; i < NKEYS; i += 7)
+    {
+        key_of(i, key);
+        InsertionResult r = stable_insert(table, key);
+        if (r.new || r.data != data[i])
+            die("key %s inserted twice.", key);
+    }
+}
+
+// Keys visited, in order
+char **visited;
+int nvisited;
+
+int collect(const char *key, EntryData *data)
+{
+    visited[nvisited++] = strdup(key);
+    return 1;
+}
+
+void check_cursor(SymbolTable hash, SymbolTable tree, const char *prefix)
+{
+    StableIter a = stable_iter_begin(hash, prefix);
+    StableIter b = stable_iter_begin(tree, prefix);
+    const char *ka, *kb;
+    EntryData *da, *db;
+    int n = 0;
+
+    for (;;)
+    {
+        int more = stable_iter_next(a, &ka, &da);
+        if (more != stable_iter_next(b, &kb, &db))
+            die("cursors on \"%s\" end apart.", prefix);
+        if (!more)
+            break;
+        if (strcmp(ka, kb) || da->i != db->i)
+            die("cursors on \"%s\" differ at %s.", prefix, ka);
+        n++;
+    }
+    stable_iter_end(a);
+    stable_iter_end(b);
+    if (!n)
+        die("no keys start with \"%s\".", prefix);
+}
+
+int main()
+{
+    set_prog_name("htable_test");
+
+    SymbolTable hash = stable_create_kind(STABLE_HASH);
+    SymbolTable tree = stable_create();
+    EntryData **hdata = malloc(NKEYS * sizeof(EntryData *));
+    EntryData **tdata = malloc(NKEYS * sizeof(EntryData *));
+    char key[32];
+
+    fill(hash, hdata);
+    fill(tree, tdata);
+
+    // Lookups, through the pointers given when inserting
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        if (stable_find(hash, key) != hdata[i] || hdata[i]->i != i)
+            die("key %s moved or lost.", key);
+    }
+    if (stable_find(hash, "k1") || stable_find(hash, ""))
+        die("found a key never inserted.");
+
+    StableStats stats;
+    stable_stats(hash, &stats);
+    if (stats.entries != NKEYS)
+        die("%zu entries, expected %d.", stats.entries, NKEYS);
+
+    // Visits: the same keys in the same, increasing order
+    visited = malloc(2 * NKEYS * sizeof(char *));
+    stable_visit(hash, collect);
+    if (nvisited != NKEYS)
+        die("%d keys visited, expected %d.", nvisited, NKEYS);
+    stable_visit(tree, collect);
+    for (int i = 0; i < NKEYS; i++)
+    {
+        if (strcmp(visited[i], visited[NKEYS + i]))
+            die("key %d visited is %s, expected %s.", i, visited[i],
+                visited[NKEYS + i]);
+        if (i && strcmp(visited[i - 1], visited[i]) >= 0)
+            die("keys out of order: %s, %s.", visited[i - 1], visited[i]);
+    }
+
+    // Cursors, after more insertions since the last visit
+    stable_insert(hash, "k96_zz").data->i = -1;
+    stable_insert(tree, "k96_zz").data->i = -1;
+    check_cursor(hash, tree, "k5");
+    check_cursor(hash, tree, "k96_");
+    check_cursor(hash, tree, 0);
+
+    // Frozen lookups
+    stable_freeze(hash);
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        EntryData *d = stable_find(hash, key);
+        if (!d || d->i != i)
+            die("frozen table lost %s.", key);
+    }
+    check_cursor(hash, tree, "k42");
+
+    for (int i = 0; i < 2 * NKEYS; i++)
+        free(visited[i]);
+    free(visited);
+    free(hdata);
+    free(tdata);
+    stable_destroy(hash);
+    stable_destroy(tree);
+
+    return 0;
+}
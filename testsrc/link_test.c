@@ -0,0 +1,200 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "linker.h"
+#include "object.h"
+#include "assembler.h"
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Links a synthetic set of objects calling each other, with one
+// thread and with several, and checks that every call reaches its
+// target; then checks that duplicate and undefined symbols are
+// reported in the same order whatever the number of threads.
+
+char dir[] = "/tmp/link_testXXXXXX";
+
+// Assemble src into an object file with the given name
+void make_object(const char *src, const char *name)
+{
+    Assembler *A = assemble_source(src);
+
+    if (!obj_write(A, name, name))
+        die(0);
+    asm_destroy(A);
+}
+
+// Object i of n: 4 exported functions, each calling and jumping to
+// functions of other objects
+void generate(int i, int n, char *src)
+{
+    size_t len = 0;
+
+    for (int f = 0; f < 4; f++)
+    {
+        len += sprintf(src + len, "f%d_%d ADD $1, $2, $3\n", i, f);
+        len += sprintf(src + len, "  EXTERN f%d_%d\n", i, f);
+        for (int k = 1; k <= 5; k++)
+        {
+            len += sprintf(src + len, "  CALL f%d_%d\n",
+                           (i + k * 37 + f) % n, (f + k) % 4);
+            len += sprintf(src + len, "  ADD $%d, $%d, %d\n", k, k, f);
+            len += sprintf(src + len, "  STR \"s%d\"\n", k);
+        }
+        len += sprintf(src + len, "  JMP f%d_%d\n", (i + n - 1) % n, f);
+    }
+}
+
+char **write_objects(int n)
+{
+    char **names = emalloc(n * sizeof(char *));
+    char *src = emalloc(4096);
+
+    for (int i = 0; i < n; i++)
+    {
+        names[i] = emalloc(strlen(dir) + 16);
+        sprintf(names[i], "%s/m%d.mo", dir, i);
+        generate(i, n, src);
+        make_object(src, names[i]);
+    }
+
+    free(src);
+    return names;
+}
+
+// Check the relocations of every object against its symbols
+void check(Link *L)
+{
+    for (int i = 0; i < L->nobjects; i++)
+    {
+        const Object *O = L->objects[i];
+        for (uint32_t r = 0; r < O->header->nrelocs; r++)
+        {
+            const ObjReloc *rel = &O->relocs[r];
+            const char *name = obj_string(O, O->symbols[rel->symbol].name);
+            int j, f;
+            sscanf(name, "f%d_%d", &j, &f);
+            int target = L->base[j] + obj_find(L->objects[j], name)->addr;
+            int site = L->base[i] + rel->site;
+            utetra w = O->code[rel->site];
+            if (!encode_patch(&w, target - site) || L->code[site] != w)
+                die("object %d: call to %s at %u is wrong.", i, name,
+                    rel->site);
+        }
+    }
+}
+
+Link *timed_link(char **names, int n, int nthreads, double *best)
+{
+    Link *L = 0;
+
+    *best = 1e9;
+    for (int round = 0; round < 3; round++)
+    {
+        if (L)
+            link_destroy(L);
+        double t0 = now();
+        L = link_files(names, n, nthreads);
+        double t = now() - t0;
+        if (t < *best)
+            *best = t;
+    }
+    for (int i = 0; i < L->nerrors; i++)
+        fprintf(stderr, "%s\n", L->errors[i]);
+    if (L->nerrors)
+        die("%d errors.", L->nerrors);
+
+    return L;
+}
+
+// Link names with one and with nthreads threads; the errors must be
+// the same
+void check_errors(char **names, int n, int nthreads, const char **expected)
+{
+    Link *one = link_files(names, n, 1);
+    Link *many = link_files(names, n, nthreads);
+
+    for (int i = 0; expected[i] || i < one->nerrors; i++)
+    {
+        if (i >= one->nerrors || !expected[i]
+            || !strstr(one->errors[i], expected[i]))
+            die("error %d is '%s', expected '%s'.", i,
+                i < one->nerrors ? one->errors[i] : "none",
+                expected[i] ? expected[i] : "none");
+        if (i >= many->nerrors || strcmp(one->errors[i], many->errors[i]))
+            die("errors differ with %d threads.", nthreads);
+    }
+    if (many->nerrors != one->nerrors)
+        die("errors differ with %d threads.", nthreads);
+
+    link_destroy(one);
+    link_destroy(many);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 1000;
+    int nthreads = argc > 2 ? atoi(argv[2]) : 4;
+
+    set_prog_name("link_test");
+    if (!mkdtemp(dir))
+        die("cannot create temporary directory:");
+
+    char **names = write_objects(n);
+
+    double t1, tn;
+    Link *one = timed_link(names, n, 1, &t1);
+    Link *many = timed_link(names, n, nthreads, &tn);
+
+    check(one);
+    if (one->n != many->n
+        || memcmp(one->code, many->code, one->n * sizeof(utetra)))
+        die("code differs with %d threads.", nthreads);
+
+    printf("%d objects, %d words: 1 thread %.3fs, %d threads %.3fs\n", n,
+           one->n, t1, nthreads, tn);
+    link_destroy(one);
+    link_destroy(many);
+
+    // Duplicate and undefined symbols
+    char *bad[4];
+    for (int i = 0; i < 4; i++)
+    {
+        bad[i] = emalloc(strlen(dir) + 16);
+        sprintf(bad[i], "%s/bad%d.mo", dir, i);
+    }
+    make_object("x ADD $1, $2, $3\n  EXTERN x\n  CALL y\n", bad[0]);
+    make_object("  CALL z\nx ADD $1, $2, $3\n  EXTERN x\n", bad[1]);
+    make_object("y ADD $1, $2, $3\n  EXTERN y\n  JMP w\n  JMP x\n", bad[2]);
+    make_object("x ADD $1, $2, $3\n  EXTERN x\n  CALL w\n", bad[3]);
+
+    const char *expected[] = {
+        "bad1.mo: symbol 'x' already defined in",
+        "bad1.mo: undefined symbol 'z'",
+        "bad2.mo: undefined symbol 'w'",
+        "bad3.mo: undefined symbol 'w'",
+        "bad3.mo: symbol 'x' already defined in",
+        0
+    };
+    check_errors(bad, 4, nthreads, expected);
+
+    // A missing object
+    unlink(bad[3]);
+    const char *missing[] = { "bad3.mo", 0 };
+    check_errors(bad, 4, nthreads, missing);
+
+    for (int i = 0; i < n; i++)
+        unlink(names[i]);
+    for (int i = 0; i < 3; i++)
+        unlink(bad[i]);
+    rmdir(dir);
+
+    return 0;
+}
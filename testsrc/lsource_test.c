@@ -0,0 +1,288 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lsource.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Reads the same text from a mapped file and through a pipe, with and
+// without read-ahead, by lines, by words and whole, and checks all
+// against the text: lines and words that straddle read blocks, a last
+// line without a newline, an empty file, and a stream that stdio has
+// already read from. Also closes sources that read ahead before the
+// end of their input, with the reader waiting for room or for input.
+
+// Size of the blocks read from pipes, as in lsource.c
+#define READ_BLOCK 65536
+
+char name[] = "/tmp/lsource_testXXXXXX";
+
+int is_space(char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Builds a text of about four blocks. Line and word boundaries fall on
+// both sides of every block boundary, and one word and one line span
+// a whole block.
+char *make_text(size_t *len)
+{
+    size_t max = 6 * READ_BLOCK, n = 0;
+    char *text = malloc(max);
+
+    for (int i = 0; n < READ_BLOCK - 3; i++)
+        n += sprintf(text + n, "%s%d%s", i % 5 ? "" : "  ", i,
+                     i % 3 ? " " : "\t\n");
+    while (n < READ_BLOCK)
+        text[n++] = 'w';
+    text[n++] = '\n';
+    for (int i = 0; i < READ_BLOCK + 100; i++)
+        text[n++] = 'a' + i % 26;
+    text[n++] = ' ';
+    for (int i = 0; n < 3 * READ_BLOCK + 7; i++)
+        n += sprintf(text + n, "line %d\n", i);
+    memcpy(text + n, "last words", 10);
+    n += 10;
+    text[n] = 0;
+
+    *len = n;
+    return text;
+}
+
+// Writes text to the temporary file
+void write_file(const char *text, size_t len)
+{
+    FILE *file = fopen(name, "w");
+
+    if (!file || fwrite(text, 1, len, file) != len || fclose(file))
+        die("cannot write '%s':", name);
+}
+
+// Child writing to the last pipe opened
+pid_t writer;
+
+// Returns a stream reading text through a pipe, written by a child in
+// pieces of at most chunk bytes. If hold is set, the child keeps the
+// pipe open after the text until it is killed.
+FILE *pipe_of(const char *text, size_t len, size_t chunk, int hold)
+{
+    int fds[2];
+
+    if (pipe(fds))
+        die("cannot create pipe:");
+    if (!(writer = fork()))
+    {
+        close(fds[0]);
+        for (size_t done = 0; done < len; )
+        {
+            size_t size = len - done < chunk ? len - done : chunk;
+            ssize_t w = write(fds[1], text + done, size);
+            if (w <= 0)
+                _exit(1);
+            done += w;
+        }
+        while (hold)
+            pause();
+        _exit(0);
+    }
+    close(fds[1]);
+
+    return fdopen(fds[0], "r");
+}
+
+void check_lines(LineSource L, const char *text, const char *what)
+{
+    const char *line;
+    int len, nlines = 0;
+
+    while ((line = lsource_line(L, &len)))
+    {
+        const char *eol = strchr(text, '\n');
+        int expected = eol ? eol - text + 1 : strlen(text);
+
+        if (len != expected || memcmp(line, text, len))
+            die("%s: line %d differs.", what, nlines + 1);
+        text += len;
+        nlines++;
+    }
+    if (*text)
+        die("%s: lines stop after %d.", what, nlines);
+    if (lsource_line(L, &len))
+        die("%s: line after the end.", what);
+}
+
+void check_words(LineSource L, const char *text, const char *what)
+{
+    const char *word;
+    int len, nwords = 0;
+
+    while ((word = lsource_word(L, &len)))
+    {
+        while (is_space(*text))
+            text++;
+        int expected = 0;
+        while (text[expected] && !is_space(text[expected]))
+            expected++;
+
+        if (len != expected || memcmp(word, text, len))
+            die("%s: word %d differs.", what, nwords + 1);
+        text += len;
+        nwords++;
+    }
+    while (is_space(*text))
+        text++;
+    if (*text)
+        die("%s: words stop after %d.", what, nwords);
+}
+
+void check_text(LineSource L, const char *text, const char *what)
+{
+    size_t len;
+    const char *all = lsource_text(L, &len);
+
+    if (len != strlen(text) || memcmp(all, text, len) || all[len])
+        die("%s: text differs.", what);
+}
+
+// Reads text from the file and from pipes, in each of the three ways
+void check_all(const char *text, size_t len)
+{
+    void (*checks[])(LineSource, const char *, const char *) = {
+        check_lines, check_words, check_text
+    };
+
+    write_file(text, len);
+    for (int k = 0; k < 3; k++)
+    {
+        LineSource L = lsource_open(name);
+        if (!L)
+            die("cannot open '%s':", name);
+        if (lsource_mapped(L) != (len > 0))
+            die("'%s' mapped: %d.", name, lsource_mapped(L));
+        checks[k](L, text, "mapped");
+        lsource_close(L);
+
+        FILE *input = pipe_of(text, len, len, 0);
+        L = lsource_file(input);
+        if (lsource_mapped(L))
+            die("a pipe is mapped.");
+        checks[k](L, text, "pipe");
+        lsource_close(L);
+        fclose(input);
+        wait(0);
+
+        // Reading ahead, with blocks filled whole or in pieces
+        for (size_t chunk = len; chunk >= 1000; chunk /= 64)
+        {
+            input = pipe_of(text, len, chunk, 0);
+            L = lsource_file(input);
+            if (!lsource_readahead(L, 3) && len)
+                die("cannot read ahead.");
+            checks[k](L, text, "read ahead");
+            lsource_close(L);
+            fclose(input);
+            wait(0);
+        }
+    }
+}
+
+// Reads nlines lines of text from a pipe read ahead and from one that
+// is not, comparing them, and then closes both. If hold is set, the
+// writers keep their pipes open, so the reader ends up waiting for
+// input; otherwise the ring fills up and it waits for room.
+void check_close(const char *text, size_t len, int nlines, int hold)
+{
+    FILE *in1 = pipe_of(text, len, len, hold);
+    pid_t w1 = writer;
+    FILE *in2 = pipe_of(text, len, len, hold);
+    pid_t w2 = writer;
+    LineSource L1 = lsource_file(in1), L2 = lsource_file(in2);
+    const char *l1, *l2;
+    int n1, n2;
+
+    lsource_readahead(L2, 2);
+    for (int i = 0; i < nlines; i++)
+    {
+        l1 = lsource_line(L1, &n1);
+        l2 = lsource_line(L2, &n2);
+        if (!l1 || !l2 || n1 != n2 || memcmp(l1, l2, n1))
+            die("line %d read ahead differs.", i + 1);
+    }
+
+    // Let the reader fill the ring, or drain the pipe
+    struct timespec t = { 0, 100000000 };
+    nanosleep(&t, 0);
+    lsource_close(L1);
+    lsource_close(L2);
+    fclose(in1);
+    fclose(in2);
+    kill(w1, SIGKILL);
+    kill(w2, SIGKILL);
+    waitpid(w1, 0, 0);
+    waitpid(w2, 0, 0);
+}
+
+int main()
+{
+    set_prog_name("lsource_test");
+
+    int fd = mkstemp(name);
+    if (fd < 0)
+        die("cannot create '%s':", name);
+    close(fd);
+
+    size_t len;
+    char *text = make_text(&len);
+
+    // Whole text, with a last line without a newline, and with one
+    check_all(text, len);
+    text[len] = '\n';
+    text[len + 1] = 0;
+    check_all(text, len + 1);
+
+    // Empty input
+    check_all("", 0);
+
+    // Early close, on a long text, and waiting for input after the text
+    size_t max = 40 * READ_BLOCK, size = 0;
+    char *many = malloc(max + 64);
+    for (int i = 0; size < max; i++)
+        size += sprintf(many + size, "line %d of many\n", i);
+    check_close(many, size, 1000, 0);
+    check_close(many, 100000, 1000, 1);
+    free(many);
+
+    // Mixed calls: a line, then words, then the rest
+    write_file(text, len + 1);
+    LineSource L = lsource_open(name);
+    int n;
+    const char *s = lsource_line(L, &n);
+    const char *eol = strchr(text, '\n');
+    if (!s || n != eol - text + 1 || memcmp(s, text, n))
+        die("first line differs.");
+    s = lsource_word(L, &n);
+    if (!s || n != 1 || *s != '1')
+        die("word after the first line differs.");
+    check_lines(L, eol + 2, "mixed");
+    lsource_close(L);
+
+    // A stream stdio has read from: the source starts where the
+    // stream stands, not where stdio's own read-ahead got to
+    FILE *file = fopen(name, "r");
+    char first[64];
+    if (!fgets(first, sizeof(first), file) || fgetc(file) != '1')
+        die("cannot read '%s':", name);
+    L = lsource_file(file);
+    check_text(L, eol + 2, "after stdio");
+    lsource_close(L);
+    fclose(file);
+
+    unlink(name);
+    free(text);
+    return 0;
+}
@@ -0,0 +1,146 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "object.h"
+#include "assembler.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Writes the object file of a generated program, maps it back and
+// checks every section against the assembler; then checks that
+// damaged images are refused and times opening the file.
+
+// A program with exported labels, data and calls to undefined labels
+char *generate(int nlines)
+{
+    size_t len = 0;
+    char *src = emalloc((size_t)nlines * 48 + 1);
+
+    for (int i = 0; i < nlines; i++)
+    {
+        switch (i % 5)
+        {
+        case 0:
+            len += sprintf(src + len, "l%d ADD $1, $2, $3\n", i);
+            break;
+        case 1:
+            len += sprintf(src + len, "  EXTERN l%d\n", i - 1);
+            break;
+        case 2:
+            len += sprintf(src + len, "  CALL ext%d\n", i % 13);
+            break;
+        case 3:
+            len += sprintf(src + len, "  JMP l%d\n", i - 3);
+            break;
+        default:
+            len += sprintf(src + len, "  STR \"s%d\"\n", i);
+            break;
+        }
+    }
+
+    return src;
+}
+
+int main(int argc, char *argv[])
+{
+    int nlines = argc > 1 ? atoi(argv[1]) : 100000;
+
+    set_prog_name("object_test");
+
+    Assembler *A = assemble_source(generate(nlines));
+
+    char name[] = "/tmp/object_testXXXXXX";
+    int fd = mkstemp(name);
+    if (fd < 0)
+        die("cannot create temporary file:");
+    close(fd);
+
+    if (!obj_write(A, "gen.mac", name))
+        die(0);
+
+    double t0 = now();
+    Object *O = obj_open(name);
+    double t1 = now();
+    if (!O)
+        die(0);
+    const ObjHeader *h = O->header;
+
+    if (strcmp(obj_string(O, h->source), "gen.mac"))
+        die("source name is '%s'.", obj_string(O, h->source));
+
+    if (h->ncode != (uint32_t)A->n
+        || memcmp(O->code, A->code, A->n * sizeof(utetra)))
+        die("code differs.");
+
+    if (h->nrelocs != (uint32_t)A->nrelocs)
+        die("%u relocations, expected %d.", h->nrelocs, A->nrelocs);
+    for (int i = 0; i < A->nrelocs; i++)
+    {
+        const ObjReloc *r = &O->relocs[i];
+        const char *s = obj_string(O, O->symbols[r->symbol].name);
+        if (r->site != (uint32_t)A->relocs[i].site
+            || strcmp(s, A->relocs[i].name))
+            die("relocation %d differs.", i);
+    }
+
+    if (h->nlines != (uint32_t)A->nlines)
+        die("%u lines, expected %d.", h->nlines, A->nlines);
+    for (int i = 0; i < A->nlines; i++)
+        if (O->lines[i].addr != (uint32_t)A->lines[i].addr
+            || O->lines[i].lineno != (uint32_t)A->lines[i].lineno)
+            die("line record %d differs.", i);
+
+    // Every symbol, in order, with its address and flags
+    int exported = 0;
+    for (uint32_t i = 0; i < h->nsymbols; i++)
+    {
+        const ObjSymbol *s = &O->symbols[i];
+        const char *key = obj_string(O, s->name);
+        Symbol *sym = asm_symbol(A, key);
+
+        if (!sym || obj_find(O, key) != s || s->hash != obj_hash(key))
+            die("symbol '%s' not found.", key);
+        if (i && strcmp(obj_string(O, O->symbols[i - 1].name), key) >= 0)
+            die("symbols out of order.");
+        if ((s->flags & OBJ_DEFINED) != (sym->addr >= 0 ? OBJ_DEFINED : 0)
+            || (sym->addr >= 0 && s->addr != (uint32_t)sym->addr)
+            || !(s->flags & OBJ_EXPORTED) != !sym->exported)
+            die("symbol '%s' differs.", key);
+        exported += (s->flags & OBJ_EXPORTED) != 0;
+    }
+    if (obj_find(O, "nowhere"))
+        die("found a symbol not in the program.");
+
+    // Truncated and damaged images
+    size_t size = h->size;
+    void *copy = 0;
+    if (posix_memalign(&copy, OBJ_ALIGN, size))
+        die("out of memory.");
+    memcpy(copy, O->header, size);
+    Object *V = obj_view(copy, size);
+    if (!V)
+        die("copy refused: %s", estrdup(get_error_msg()));
+    obj_close(V);
+    if (obj_view(copy, size - OBJ_ALIGN))
+        die("truncated image accepted.");
+    ((ObjReloc *)((char *)copy + h->relocs))->symbol = h->nsymbols;
+    if (obj_view(copy, size))
+        die("damaged image accepted.");
+    free(copy);
+
+    printf("%d lines: %u words, %u symbols (%d exported), %u relocations, "
+           "%u bytes; opened in %.0fus\n", nlines, h->ncode, h->nsymbols,
+           exported, h->nrelocs, h->size, (t1 - t0) * 1e6);
+
+    obj_close(O);
+    unlink(name);
+    asm_destroy(A);
+
+    return 0;
+}
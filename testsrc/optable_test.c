@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "optable.h"
+#include "error.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+// Looks up every operator through the three lookup functions, and
+// checks that misses miss: wrong case, prefixes, extensions, names
+// too long, and names one bit away from an operator, whose keys hash
+// near those of operators.
+
+// Operator names, in table order.
+static const char *names[] = {
+#define OPERATOR(name, opcode, t1, t2, t3) name,
+#include "operators.def"
+#undef OPERATOR
+};
+
+static const int num_ops = sizeof(names) / sizeof(names[0]);
+
+// Is s the name of an operator?
+int is_name(const char *s)
+{
+    for (int k = 0; k < num_ops; k++)
+        if (!strcmp(names[k], s))
+            return 1;
+    return 0;
+}
+
+// Is s the name of an operator, ignoring case?
+int is_name_nocase(const char *s)
+{
+    char upper[32];
+    int i;
+
+    for (i = 0; s[i] && i < 31; i++)
+        upper[i] = toupper((unsigned char) s[i]);
+    upper[i] = 0;
+
+    return !s[i] && is_name(upper);
+}
+
+// Checks the three lookups of s, which may or may not be a name
+void check(const char *s)
+{
+    const Operator *op = optable_find(s);
+    char span[40];
+
+    if (is_name(s) ? !op || strcmp(op->name, s) : op != 0)
+        die("optable_find(\"%s\") gave %s.", s, op ? op->name : "NULL");
+
+    // The span lookup sees only the first strlen(s) characters
+    snprintf(span, sizeof(span), "%s%s", s, "ADD XYZ");
+    if (optable_find_span(span, strlen(s)) != op)
+        die("optable_find_span(\"%s\") differs.", s);
+
+    const Operator *nc = optable_find_nocase(s);
+    if (is_name_nocase(s) ? !nc || strcasecmp(nc->name, s) : nc != 0)
+        die("optable_find_nocase(\"%s\") gave %s.", s,
+            nc ? nc->name : "NULL");
+}
+
+int main()
+{
+    set_prog_name("optable_test");
+
+    char s[32];
+
+    for (int k = 0; k < num_ops; k++)
+    {
+        const char *name = names[k];
+        int len = strlen(name);
+
+        check(name);
+
+        // Lowercase, and every letter but the first lowercase
+        for (int i = 0; i <= len; i++)
+            s[i] = tolower((unsigned char) name[i]);
+        check(s);
+        s[0] = name[0];
+        check(s);
+
+        // Proper prefixes, and the name followed by more letters
+        for (int i = 0; i < len; i++)
+        {
+            memcpy(s, name, i);
+            s[i] = 0;
+            check(s);
+        }
+        snprintf(s, sizeof(s), "%sX", name);
+        check(s);
+        snprintf(s, sizeof(s), "%s%s", name, name);
+        check(s);
+
+        // One bit flipped, anywhere in the name
+        for (int i = 0; i < len; i++)
+            for (int b = 0; b < 8; b++)
+            {
+                strcpy(s, name);
+                s[i] ^= 1 << b;
+                if (s[i])
+                    check(s);
+            }
+    }
+
+    // Plain misses
+    check("");
+    check("NOPE");
+    check("ADDADDADD");
+    check(" ADD");
+    check("ADD ");
+
+    return 0;
+}
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "parser.h"
+#include "stable.h"
+#include "buffer.h"
+#include "error.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Parses a generated source serially and in parallel, and checks that
+// both give the same instructions, and the same error when a line of
+// the source is bad.
+
+// Append a textual dump of the list to B
+void dump(Instruction *instr, Buffer *B)
+{
+    char line[512];
+    for (; instr; instr = instr->next)
+    {
+        int n = snprintf(line, sizeof(line), "%d %s %s", instr->lineno,
+                         instr->label ? instr->label : "-",
+                         instr->op ? instr->op->name : "?");
+        for (int i = 0; i < 3 && instr->opds[i]; i++)
+        {
+            Operand *opd = instr->opds[i];
+            if (opd->type == LABEL || opd->type == STRING)
+                n += snprintf(line + n, sizeof(line) - n, " %x:%s",
+                              opd->type, opd->value.label);
+            else if (opd->type == REGISTER)
+                n += snprintf(line + n, sizeof(line) - n, " $%u",
+                              opd->value.reg);
+            else
+                n += snprintf(line + n, sizeof(line) - n, " %lld",
+                              opd->value.num);
+        }
+        line[n++] = '\n';
+        line[n] = 0;
+        for (int i = 0; i < n; i++)
+            buffer_push_back(B, line[i]);
+    }
+}
+
+// Puts bad in place of line lineno of src, parses the result serially
+// and in parallel, and checks that both fail with the same message and
+// point to the same place: the word at offset col of the bad line, as
+// parse does with the bad line alone.
+void check_error(const char *src, int lineno, const char *bad, int col,
+                 int nthreads)
+{
+    const char *at = src;
+    for (int i = 1; i < lineno; i++)
+        at = strchr(at, '\n') + 1;
+    const char *rest = strchr(at, '\n');
+
+    char *text = emalloc(strlen(src) + strlen(bad) + 1);
+    sprintf(text, "%.*s%s%s", (int)(at - src), src, bad, rest);
+
+    Instruction *serial = 0, *parallel = 0;
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    char expected[64], msg[1024];
+    const char *where = 0;
+    Instruction *instr[16];
+
+    if (parse(bad, aliases, instr, &where) || where != bad + col)
+        die("bad line \"%s\" parsed, or error not at %d.", bad, col);
+
+    snprintf(expected, sizeof(expected), "line %d: ", lineno);
+    where = 0;
+    if (parse_source(text, aliases, &serial, &where) || serial)
+        die("bad line %d parsed.", lineno);
+    if (where != text + (at - src) + col)
+        die("error on line %d not at column %d.", lineno, col);
+    snprintf(msg, sizeof(msg), "%s", get_error_msg());
+    if (strncmp(msg, expected, strlen(expected)))
+        die("error on line %d reported as \"%s\".", lineno, msg);
+
+    set_error_msg("");
+    where = 0;
+    if (parse_source_parallel(text, aliases, &parallel, &where, nthreads)
+        || parallel)
+        die("bad line %d parsed in parallel.", lineno);
+    if (where != text + (at - src) + col)
+        die("error on line %d not at column %d in parallel.", lineno, col);
+    if (strcmp(msg, get_error_msg()))
+        die("error on line %d reported as \"%s\" in parallel, "
+            "expected \"%s\".", lineno, get_error_msg(), msg);
+
+    stable_destroy(aliases);
+    free(text);
+}
+
+int main(int argc, char *argv[])
+{
+    int nlines = argc > 1 ? atoi(argv[1]) : 200000;
+    int nthreads = argc > 2 ? atoi(argv[2]) : 4;
+
+    set_prog_name("parse_parallel_test");
+
+    // Generate the source; aliases are redefined along the way, so
+    // their resolution depends on order across chunk boundaries
+    size_t max = (size_t)nlines * 64 + 1, len = 0;
+    char *src = emalloc(max);
+    for (int i = 0; i < nlines; i++)
+    {
+        switch (i % 7)
+        {
+        case 0:
+            len += sprintf(src + len, "cnt IS $%d\n", i % 200);
+            break;
+        case 1:
+            len += sprintf(src + len, "l%d ADD cnt, cnt, %d * soma\n", i, i);
+            break;
+        case 2:
+            len += sprintf(src + len, "* comentario %d\n", i);
+            break;
+        case 3:
+            len += sprintf(src + len, "  JNZ cnt, l%d; SUB $1, $2, h%x\n",
+                           i - 2, i);
+            break;
+        case 4:
+            len += sprintf(src + len, "\n");
+            break;
+        default:
+            len += sprintf(src + len, "  MUL $%d,cnt,$7\n", i % 250);
+            break;
+        }
+    }
+
+    Instruction *serial, *parallel;
+    SymbolTable aliases1 = stable_create_kind(STABLE_HASH);
+    SymbolTable aliases2 = stable_create_kind(STABLE_HASH);
+
+    double t0 = now();
+    parse_source(src, aliases1, &serial, 0);
+    double t1 = now();
+    parse_source_parallel(src, aliases2, &parallel, 0, nthreads);
+    double t2 = now();
+
+    Buffer *d1 = buffer_create(), *d2 = buffer_create();
+    dump(serial, d1);
+    dump(parallel, d2);
+    if (d1->i != d2->i || memcmp(d1->data, d2->data, d1->i))
+        die("parallel parse differs from serial parse.");
+
+    // Errors, at the start, in the middle and at the end
+    check_error(src, 1, "ADD $1, $2, 3; $3 SUB $1, $2, 3", 15, nthreads);
+    check_error(src, nlines / 2, "sem operador", 4, nthreads);
+    check_error(src, nlines / 3 + 1, "  rotulo", 2, nthreads);
+    check_error(src, nlines, "ADD $1,$1,1; 12 ADD", 13, nthreads);
+
+    printf("%d lines: serial %.3fs, %d threads %.3fs\n",
+           nlines, t1 - t0, nthreads, t2 - t1);
+    return 0;
+}
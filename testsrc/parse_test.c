@@ -1,12 +1,143 @@
 #include "parser.h"
 #include "stable.h"
+#include "irstream.h"
+#include "error.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+
+// Every kind of operand, a string, and labels used after their
+// definitions
+static const char *program =
+    "start ADD $1, $2, $3\n"
+    "  SUB $4, $4, 200\n"
+    "  SETW $5, h1234\n"
+    "  JNZ $1, start\n"
+    "  JMP -2\n"
+    "msg STR \"hello\"\n"
+    "  EXTERN msg\n"
+    "  CALL start; RET 1\n";
+
+void same_instr(const Instruction *a, const Instruction *b)
+{
+    if ((a->label == 0) != (b->label == 0)
+        || (a->label && strcmp(a->label, b->label)) || a->op != b->op
+        || a->lineno != b->lineno || a->pos != b->pos)
+        die("line %d: instruction differs after the round trip.", a->lineno);
+
+    for (int i = 0; i < 3; i++)
+    {
+        const Operand *x = a->opds[i], *y = b->opds[i];
+
+        if (!x || !y)
+        {
+            if (x || y)
+                die("line %d: operand %d lost in the round trip.", a->lineno, i);
+            continue;
+        }
+        if (x->type != y->type)
+            die("line %d: operand %d changed type.", a->lineno, i);
+        switch (x->type)
+        {
+        case REGISTER:
+            if (x->value.reg != y->value.reg)
+                die("line %d: operand %d changed register.", a->lineno, i);
+            break;
+        case LABEL:
+        case STRING:
+            if (strcmp(x->value.str, y->value.str))
+                die("line %d: operand %d changed text.", a->lineno, i);
+            break;
+        default:
+            if (x->value.num != y->value.num)
+                die("line %d: operand %d changed value.", a->lineno, i);
+        }
+    }
+}
+
+void same_stream(const InstrStream *S, const InstrStream *T)
+{
+    if (S->n != T->n || S->poolsize != T->poolsize
+        || memcmp(S->pool, T->pool, S->poolsize))
+        die("streams differ in size or pool.");
+    for (int i = 0; i < S->n; i++)
+    {
+        if (S->op[i] != T->op[i] || S->label[i] != T->label[i]
+            || S->lineno[i] != T->lineno[i] || S->pos[i] != T->pos[i])
+            die("instruction %d of the streams differs.", i);
+        for (int k = 0; k < 3; k++)
+            if (S->opds[i].type[k] != T->opds[i].type[k]
+                || (S->opds[i].type[k] && S->opds[i].val[k] != T->opds[i].val[k]))
+                die("operand %d of instruction %d of the streams differs.", k, i);
+    }
+}
+
+// Check that a list survives its conversion to a stream and back, and
+// that the stream of the result is the same
+void test_round_trip()
+{
+    SymbolTable aliases = stable_create();
+    Instruction *head;
+
+    if (!parse_source(program, aliases, &head, 0))
+        die("parse error.");
+
+    InstrStream *S = irs_from_list(head);
+    Instruction *copy = irs_to_list(S);
+    InstrStream *T = irs_from_list(copy);
+    int n = 0;
+
+    for (Instruction *a = head, *b = copy; a || b; a = a->next, b = b->next)
+    {
+        if (!a || !b)
+            die("round trip changed the number of instructions.");
+        same_instr(a, b);
+        n++;
+    }
+    if (S->n != n)
+        die("stream has %d instructions, the list %d.", S->n, n);
+    same_stream(S, T);
+
+    // Labels and their uses share the pool
+    if (S->label[0] != S->opds[3].val[1] + 1
+        || strcmp(irs_label(S, 0), "start")
+        || S->label[5] != S->opds[6].val[0] + 1)
+        die("labels are not shared in the pool.");
+    if (strcmp(irs_string(S, S->opds[5].val[0]), "\"hello\""))
+        die("string %s in the pool.", irs_string(S, S->opds[5].val[0]));
+
+    irs_destroy(T);
+    irs_destroy(S);
+    while (head)
+    {
+        Instruction *next = head->next;
+        instr_destroy(head);
+        head = next;
+    }
+    while (copy)
+    {
+        Instruction *next = copy->next;
+        instr_destroy(copy);
+        copy = next;
+    }
+    stable_destroy(aliases);
+}
+
 int main()
 {
+    set_prog_name("parse_test");
+    test_round_trip();
+
     SymbolTable alias_table = stable_create();
     Instruction **instr = malloc(2 * sizeof(Instruction *));
     parse("teste DIV  a,$0;  MUL a,    5, $2", alias_table, instr, 0);
+
+    // Round-trip through the compact representation
+    instr[0]->next = instr[1];
+    InstrStream *stream = irs_from_list(instr[0]);
+    instr[0] = irs_to_list(stream);
+    instr[1] = instr[0]->next;
+    irs_destroy(stream);
     for (int l = 0; l < 2; l++)
     {
         printf("label    = \"%s\"\n", instr[l]->label);
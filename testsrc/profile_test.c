@@ -0,0 +1,197 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "profile.h"
+#include "sim.h"
+#include "assembler.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Profiles a program with a loop calling a function, with both
+// dispatchers and with the JIT tier, and checks the counts and cycles
+// of its lines and labels; checks that counts survive code rewriting
+// itself; prints the flat and annotated profiles; and times a loop
+// with and without a profile.
+
+const char program[] =
+    "main SETW $1, 100\n"
+    "loop CALL square\n"
+    "  ADD $3, $3, $2\n"
+    "  SUB $1, $1, 1\n"
+    "  JNZ $1, loop\n"
+    "  DIV $4, $3, 7\n"
+    "  INT 0\n"
+    "square MUL $2, $1, $1\n"
+    "  RET 0\n";
+
+// patch is run twice, ADD $3, $3, 10 the second time
+const char patched[] =
+    "  SETW $1, 2\n"
+    "  SETW $6, 8451\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 3\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 10\n"
+    "loop GETA $5, patch\n"
+    "patch ADD $3, $3, 1\n"
+    "  STT $6, $5, 0\n"
+    "  SUB $1, $1, 1\n"
+    "  JNZ $1, loop\n"
+    "  INT 0\n";
+
+// Assemble src, load it in a new machine and profile it to the end
+Machine *run(const char *src, Assembler **A, int mode,
+             const unsigned *costs)
+{
+    *A = assemble_source(src);
+
+    Machine *M = sim_create(1 << 16);
+    M->portable = mode == 1;
+    M->tier = mode == 2 ? SIM_JIT : SIM_INTERPRET;
+    if (!sim_load(M, (*A)->code, (*A)->n))
+        die(0);
+    sim_profile(M, costs);
+    if (sim_run(M, 0) != SIM_HALTED)
+        die("%s", estrdup(get_error_msg()));
+    return M;
+}
+
+const ProfileEntry *line(const Profile *P, int lineno)
+{
+    for (int i = 0; i < P->nlines; i++)
+        if (P->lines[i].lineno == lineno)
+            return &P->lines[i];
+    die("no line %d in the profile.", lineno);
+    return 0;
+}
+
+const ProfileEntry *label(const Profile *P, const char *name)
+{
+    for (int i = 0; i < P->nlabels; i++)
+        if (P->labels[i].label && !strcmp(P->labels[i].label, name))
+            return &P->labels[i];
+    die("no label %s in the profile.", name);
+    return 0;
+}
+
+void expect(const ProfileEntry *e, uocta count, uocta cycles)
+{
+    if (e->count != count || e->cycles != cycles)
+        die("%s %d: %llu runs and %llu cycles, expected %llu and %llu.",
+            e->label ? e->label : "line", e->lineno, e->count, e->cycles,
+            count, cycles);
+}
+
+void test_program(int mode, int print)
+{
+    unsigned costs[256];
+    Assembler *A;
+
+    profile_costs(costs);
+    Machine *M = run(program, &A, mode, costs);
+    Profile *P = profile_create(M, A);
+
+    if (P->count != M->steps || M->native_steps)
+        die("%llu instructions profiled, %llu run.", P->count, M->steps);
+
+    // CALL is 4 instructions, of 8 cycles in all, and RET 3, of 6
+    expect(line(P, 1), 1, 1);
+    expect(line(P, 2), 400, 800);
+    expect(line(P, 3), 100, 100);
+    expect(line(P, 5), 100, 200);
+    expect(line(P, 6), 1, 20);
+    expect(line(P, 7), 1, 50);
+    expect(line(P, 8), 100, 400);
+    expect(line(P, 9), 300, 600);
+    expect(label(P, "main"), 1, 1);
+    expect(label(P, "loop"), 702, 1270);
+    expect(label(P, "square"), 400, 1000);
+    if (P->cycles != 2271)
+        die("%llu cycles in all, expected 2271.", P->cycles);
+
+    if (print)
+    {
+        profile_flat(stdout, P, program, 5);
+        printf("\n");
+        profile_annotate(stdout, P, program);
+        printf("\n");
+    }
+
+    profile_destroy(P);
+    sim_destroy(M);
+    asm_destroy(A);
+}
+
+void test_patched()
+{
+    Assembler *A;
+    Machine *M = run(patched, &A, 0, 0);
+    Profile *P = profile_create(M, A);
+
+    expect(line(P, 8), 2, 2);
+    expect(label(P, "patch"), 9, 9);
+    if (P->count != M->steps)
+        die("%llu instructions profiled, %llu run.", P->count, M->steps);
+
+    profile_destroy(P);
+    sim_destroy(M);
+    asm_destroy(A);
+}
+
+// Time a loop of 3 instructions run n times, rounded down to a multiple
+// of 10000, without and with a profile
+void benchmark(int n)
+{
+    char src[256];
+    double mips[2];
+    unsigned costs[256];
+
+    sprintf(src,
+            "  SETW $1, %d\n"
+            "  MUL $1, $1, 100\n"
+            "  MUL $1, $1, 100\n"
+            "loop ADD $2, $2, $1\n"
+            "  SUB $1, $1, 1\n"
+            "  JNZ $1, loop\n"
+            "  INT 0\n", n / 10000);
+    profile_costs(costs);
+
+    for (int profiled = 0; profiled < 2; profiled++)
+    {
+        Assembler *A = assemble_source(src);
+        Machine *M = sim_create(1 << 16);
+        sim_load(M, A->code, A->n);
+        if (profiled)
+            sim_profile(M, costs);
+        double t0 = now();
+        if (sim_run(M, 0) != SIM_HALTED)
+            die(0);
+        double t1 = now();
+        mips[profiled] = M->steps / (t1 - t0) * 1e-6;
+
+        sim_destroy(M);
+        asm_destroy(A);
+    }
+
+    printf("%d iterations: %.0f MIPS, profiled %.0f MIPS\n",
+           n / 10000 * 10000, mips[0], mips[1]);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000000;
+
+    set_prog_name("profile_test");
+
+    for (int mode = 0; mode < 3; mode++)
+        test_program(mode, mode == 0);
+    test_patched();
+    benchmark(n);
+
+    return 0;
+}
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "relax.h"
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Relaxes a generated program with many conditional jumps near the
+// limit of their reach, among blocks of data, and checks the versions
+// chosen against a plain fixpoint iteration over the whole program.
+
+// Reach of every instruction by repeated passes until nothing changes
+unsigned char *fixpoint(Instruction **instrs, int n, int *passes)
+{
+    unsigned char *reach = calloc(n, 1);
+    int *addr = emalloc((n + 1) * sizeof(int));
+    SymbolTable index = stable_create_kind(STABLE_HASH);
+
+    for (int i = 0; i < n; i++)
+        if (instrs[i]->label)
+            stable_insert(index, instrs[i]->label).data->i = i;
+
+    int changed = 1;
+    for (*passes = 0; changed; ++*passes)
+    {
+        changed = 0;
+        addr[0] = 0;
+        for (int i = 0; i < n; i++)
+            addr[i + 1] = addr[i] + encode_size_reach(instrs[i], reach[i]);
+        for (int i = 0; i < n; i++)
+        {
+            Operand *opd = instrs[i]->opds[1];
+            if (!opd || opd->type != LABEL)
+                continue;
+            int t = stable_find(index, opd->value.label)->i;
+            int need = encode_reach(instrs[i], addr[i], addr[t]);
+            if (need > reach[i])
+            {
+                reach[i] = need;
+                changed = 1;
+            }
+        }
+    }
+
+    stable_destroy(index);
+    free(addr);
+    return reach;
+}
+
+int main(int argc, char *argv[])
+{
+    int nblocks = argc > 1 ? atoi(argv[1]) : 20000;
+    const Instruction *bad;
+    Instruction *head;
+
+    set_prog_name("relax_test");
+    srand(216);
+
+    // Blocks of data of up to 64 words, each followed by a jump some
+    // 60000 to 70000 words away, either way
+    char *src = emalloc((size_t)nblocks * 320 + 1);
+    size_t len = 0;
+    for (int i = 0; i < nblocks; i++)
+    {
+        int words = rand() % 64 + 1;
+        len += sprintf(src + len, "l%d STR \"", i);
+        memset(src + len, 'x', 4 * words - 1);
+        len += 4 * words - 1;
+        len += sprintf(src + len, "\"\n");
+
+        int d = (60000 + rand() % 10000) / 33;
+        int t = rand() % 2 ? i + d : i - d;
+        if (t < 0 || t >= nblocks)
+            t = i;
+        len += sprintf(src + len, "  JZ $%d, l%d\n", i % 200, t);
+    }
+
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    parse_source(src, aliases, &head, 0);
+
+    int n = 0;
+    for (Instruction *instr = head; instr; instr = instr->next)
+        n++;
+    Instruction **instrs = emalloc(n * sizeof(Instruction *));
+    n = 0;
+    for (Instruction *instr = head; instr; instr = instr->next)
+        instrs[n++] = instr;
+
+    double t0 = now();
+    SymbolTable labels = stable_create_kind(STABLE_HASH);
+    unsigned char *reach;
+    int size = relax_layout(head, labels, &reach, &bad);
+    if (size < 0)
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+    double t1 = now();
+
+    int passes;
+    unsigned char *expected = fixpoint(instrs, n, &passes);
+    double t2 = now();
+
+    int near = 0;
+    for (int i = 0; i < n; i++)
+    {
+        if (reach[i] != expected[i])
+            die("line %d: reach %d, expected %d.", instrs[i]->lineno,
+                reach[i], expected[i]);
+        near += reach[i] == REACH_NEAR;
+    }
+
+    utetra *code = emalloc(size * sizeof(utetra));
+    if (relax_program(head, labels, reach, code, &bad) != size)
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+
+    printf("%d instructions, %d near jumps: worklist %.3fs, "
+           "%d passes %.3fs\n", n, near, t1 - t0, passes, t2 - t1);
+    return 0;
+}
@@ -0,0 +1,77 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "scan.h"
+#include "error.h"
+#include "testutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compares every scan implementation against the scalar one on random
+// text, from every starting position, and times them on long lines.
+
+#define TEXT_LEN 4096
+
+static const char alphabet[] = "abcXYZ09$h\" \t\n\v\f\r,;*\x80\xff";
+
+int main()
+{
+    const char *names[] = { "scalar", "sse2", "avx2" };
+    size_t (*scans[])(const char *) = { scan_command, scan_word, scan_skip };
+    char *text = emalloc(TEXT_LEN + 1);
+    size_t *expected = emalloc(3 * TEXT_LEN * sizeof(size_t));
+
+    set_prog_name("scan_test");
+    srand(216);
+
+    for (int round = 0; round < 50; round++)
+    {
+        // Runs of one class of characters, so that scans cross blocks
+        for (int i = 0; i < TEXT_LEN;)
+        {
+            int run = rand() % 80 + 1;
+            int set = rand() % 3;
+            for (; run-- && i < TEXT_LEN; i++)
+            {
+                if (set == 0) text[i] = 'a' + rand() % 26;
+                else if (set == 1) text[i] = " \t,;"[rand() % 4];
+                else text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+            }
+        }
+        text[TEXT_LEN] = 0;
+
+        scan_select(SCAN_SCALAR);
+        for (int f = 0; f < 3; f++)
+            for (int i = 0; i < TEXT_LEN; i++)
+                expected[f * TEXT_LEN + i] = scans[f](text + i);
+
+        for (int k = SCAN_SSE2; k <= SCAN_AVX2; k++)
+        {
+            if (!scan_select(k)) continue;
+            for (int f = 0; f < 3; f++)
+                for (int i = 0; i < TEXT_LEN; i++)
+                    if (scans[f](text + i) != expected[f * TEXT_LEN + i])
+                        die("%s: scan %d differs at position %d.",
+                            names[k], f, i);
+        }
+    }
+
+    // Throughput on a word that spans the whole text
+    memset(text, 'a', TEXT_LEN);
+    for (int k = SCAN_SCALAR; k <= SCAN_AVX2; k++)
+    {
+        if (!scan_select(k))
+        {
+            printf("%-6s unsupported\n", names[k]);
+            continue;
+        }
+        size_t total = 0;
+        double t0 = now();
+        for (int r = 0; r < 20000; r++)
+            total += scan_word(text + (r & 7));
+        double t1 = now();
+        printf("%-6s %8.1f MB/s\n", names[k], total / (t1 - t0) / 1e6);
+    }
+
+    return 0;
+}
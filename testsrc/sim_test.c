@@ -0,0 +1,730 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "sim.h"
+#include "jit.h"
+#include "assembler.h"
+#include "relax.h"
+#include "encoder.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include "opcodes.h"
+#include "testutil.h"
+#include "testasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs small programs covering every kind of instruction, with both
+// dispatchers and with the JIT, also checking it against the
+// interpreter, and checks their registers and output, also after a
+// program rewrites its own code, and in a sparse memory of the largest
+// size; runs them again with the long versions of jumps, GETA and
+// CALL; checks faults and the step limit; and times a tight loop and a
+// loop over a large array with each dispatcher and the JIT.
+
+// Ways to run a program
+enum { THREADED, SWITCH, JIT_CHECK, JIT, MODES };
+
+Machine *create(uocta memsize, int mode)
+{
+    Machine *M = sim_create(memsize);
+    M->portable = mode == SWITCH;
+    M->tier = mode == JIT ? SIM_JIT
+              : mode == JIT_CHECK ? SIM_JIT_CHECK : SIM_INTERPRET;
+    return M;
+}
+
+// Run code to the end in the given mode; the output is put in out,
+// which has room for 256 characters
+Machine *run(const utetra *code, int n, uocta memsize, int mode, char *out)
+{
+    Machine *M = create(memsize, mode);
+    M->out = tmpfile();
+    if (!M->out)
+        die("cannot create temporary file:");
+    if (!sim_load(M, code, n))
+        die(0);
+    if (sim_run(M, 0) != SIM_HALTED)
+        die("%s", estrdup(get_error_msg()));
+
+    rewind(M->out);
+    size_t len = fread(out, 1, 255, M->out);
+    out[len] = 0;
+    fclose(M->out);
+    return M;
+}
+
+// Run code in every mode, check that they agree and return the
+// threaded machine
+Machine *run_all(const utetra *code, int n, uocta memsize, char *out)
+{
+    char other[256];
+    Machine *M = run(code, n, memsize, THREADED, out);
+
+    for (int mode = SWITCH; mode < MODES; mode++)
+    {
+        Machine *P = run(code, n, memsize, mode, other);
+
+        if (memcmp(M->reg, P->reg, sizeof(M->reg)) || M->rH != P->rH
+            || M->rR != P->rR || M->steps != P->steps || strcmp(out, other)
+            || !vmem_equal(M->mem, P->mem))
+            die("mode %d disagrees with the threaded dispatcher.", mode);
+        sim_destroy(P);
+    }
+    return M;
+}
+
+Machine *run_source(const char *src, char *out)
+{
+    int n;
+    utetra *code = assemble(src, &n);
+    Machine *M = run_all(code, n, 1 << 16, out);
+    free(code);
+    return M;
+}
+
+void expect(Machine *M, int r, uocta value)
+{
+    if (M->reg[r] != value)
+        die("$%d is %#llx, expected %#llx.", r, M->reg[r], value);
+}
+
+void expect_output(const char *out, const char *expected)
+{
+    if (strcmp(out, expected))
+        die("output \"%s\", expected \"%s\".", out, expected);
+}
+
+const char arith[] =
+    "  SETW $1, 1000\n"
+    "  ADD $2, $1, 24\n"
+    "  SUB $3, $1, $2\n"
+    "  MUL $4, $3, $3\n"
+    "  DIV $5, $1, 7\n"
+    "  DIV $6, $3, 5\n"
+    "  NEG $7, 0, $1\n"
+    "  CMP $8, $3, $1\n"
+    "  CMPU $9, $3, $1\n"
+    "  SR $10, $3, 2\n"
+    "  SRU $11, $3, 60\n"
+    "  SL $12, $1, 3\n"
+    "  NXOR $13, $1, $1\n"
+    "  AND $14, $1, 240\n"
+    "  XOR $15, $1, 255\n"
+    "  MULU $16, $3, $3\n"
+    "  DIVU $18, $1, 0\n"
+    "  SUBU $19, $0, 1\n"
+    "  INT 0\n";
+
+const char memory[] =
+    "  SETW $1, 16384\n"
+    "  SETW $2, 32897\n"
+    "  STW $2, $1, 0\n"
+    "  LDW $3, $1, 0\n"
+    "  LDWU $4, $1, 1\n"
+    "  LDB $5, $1, 1\n"
+    "  LDBU $6, $1, 1\n"
+    "  STO $3, $1, 8\n"
+    "  LDO $7, $1, 13\n"
+    "  STT $2, $1, 16\n"
+    "  LDT $8, $1, 16\n"
+    "  SL $9, $2, 16\n"
+    "  STTU $9, $1, 20\n"
+    "  LDT $10, $1, 20\n"
+    "  LDTU $11, $1, 20\n"
+    "  STBU $2, $1, 24\n"
+    "  LDOU $12, $1, 24\n"
+    "  INT 0\n";
+
+const char calls[] =
+    "main SETW $1, 10\n"
+    "  PUSH $1\n"
+    "  CALL fact\n"
+    "  OR $255, $2, 0\n"
+    "  INT 3\n"
+    "  SETW $255, 10\n"
+    "  INT 1\n"
+    "  GETA $255, msg\n"
+    "  INT 2\n"
+    "  SETW $10, 5\n"
+    "  SETW $11, 6\n"
+    "  SETW $12, 7\n"
+    "  OR $20, $253, 0\n"
+    "  SAVE $253, $10, $12\n"
+    "  SUB $21, $253, $20\n"
+    "  SETW $10, 0\n"
+    "  SETW $11, 0\n"
+    "  SETW $12, 0\n"
+    "  REST $253, $10, $12\n"
+    "  INT 0\n"
+    "fact SUB $254, $253, 16\n"
+    "  LDO $1, $254, 0\n"
+    "  JNZ $1, rec\n"
+    "  SETW $2, 1\n"
+    "  RET 1\n"
+    "rec SUB $1, $1, 1\n"
+    "  PUSH $1\n"
+    "  CALL fact\n"
+    "  SUB $254, $253, 16\n"
+    "  LDO $1, $254, 0\n"
+    "  MUL $2, $2, $1\n"
+    "  RET 1\n"
+    "msg STR \"done\"\n";
+
+const char jumps[] =
+    "  SETW $1, 3\n"
+    "  SUB $2, $0, 3\n"
+    "  JP $1, a\n"
+    "  INT 9\n"
+    "a JN $2, b\n"
+    "  INT 9\n"
+    "b JNN $2, bad\n"
+    "  JNP $1, bad\n"
+    "  JZ $1, bad\n"
+    "  JMP c\n"
+    "bad INT 9\n"
+    "c SUB $1, $1, 1\n"
+    "  ADD $3, $3, 1\n"
+    "  JNZ $1, c\n"
+    "  JZ $1, d\n"
+    "  INT 9\n"
+    "d NOP\n"
+    "  INT 0\n";
+
+// GETA into the scratch registers of the long expansions must give the
+// same address as into any other register
+const char scratch_geta[] =
+    "  GETA $1, msg\n"
+    "  GETA $251, msg\n"
+    "  SUB $2, $251, $1\n"
+    "  GETA $252, msg\n"
+    "  SUB $3, $252, $1\n"
+    "  SETW $1, 0\n"
+    "  INT 0\n"
+    "msg STR \"x\"\n";
+
+// The second time through the loop, patch is ADD $3, $3, 10: the
+// program stores it over the ADD $3, $3, 1 run the first time
+const char patched[] =
+    "  SETW $1, 2\n"
+    "  SETW $6, 8451\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 3\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 10\n"
+    "loop GETA $5, patch\n"
+    "patch ADD $3, $3, 1\n"
+    "  STT $6, $5, 0\n"
+    "  SUB $1, $1, 1\n"
+    "  JNZ $1, loop\n"
+    "  INT 0\n";
+
+// Hot loops, for the JIT: fills a buffer in the stack and sums it, then
+// calls a function in a loop that stores into a buffer in the middle
+// of the code, which translated code leaves to the interpreter
+const char loops[] =
+    "  JMP start\n"
+    "buf STR \"0123456789abcdef\"\n"
+    "start OR $1, $253, 0\n"
+    "  SETW $22, 800\n"
+    "  ADD $253, $253, $22\n"
+    "  SETW $2, 100\n"
+    "fill SUB $2, $2, 1\n"
+    "  SL $3, $2, 3\n"
+    "  MUL $4, $2, $2\n"
+    "  STO $4, $1, $3\n"
+    "  JNZ $2, fill\n"
+    "  SETW $2, 100\n"
+    "sum SUB $2, $2, 1\n"
+    "  SL $3, $2, 3\n"
+    "  LDO $4, $1, $3\n"
+    "  ADD $5, $5, $4\n"
+    "  SR $9, $4, 1\n"
+    "  CMPU $10, $9, $5\n"
+    "  CMP $11, $10, 0\n"
+    "  LDT $12, $1, $3\n"
+    "  NXOR $13, $13, $12\n"
+    "  LDB $14, $1, $3\n"
+    "  LDWU $15, $1, $3\n"
+    "  SL $16, $4, $2\n"
+    "  SRU $17, $4, $2\n"
+    "  NEG $18, 0, $4\n"
+    "  SR $19, $18, $2\n"
+    "  MULU $20, $18, $18\n"
+    "  JP $2, sum\n"
+    "  GETA $7, buf\n"
+    "  SETW $2, 50\n"
+    "poke AND $3, $2, 15\n"
+    "  ADD $8, $2, 65\n"
+    "  STB $8, $7, $3\n"
+    "  CALL twice\n"
+    "  SUB $2, $2, 1\n"
+    "  JNZ $2, poke\n"
+    "  OR $255, $7, 0\n"
+    "  INT 2\n"
+    "  INT 0\n"
+    "twice ADD $21, $21, 2\n"
+    "  RET 0\n";
+
+// A hot loop that the program patches into ADD $3, $3, 10 after its
+// first run
+const char hot_patch[] =
+    "  SETW $1, 2\n"
+    "  SETW $6, 8451\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 3\n"
+    "  SL $6, $6, 8\n"
+    "  OR $6, $6, 10\n"
+    "outer SETW $2, 100\n"
+    "inner ADD $3, $3, 1\n"
+    "  SUB $2, $2, 1\n"
+    "  JNZ $2, inner\n"
+    "  GETA $5, inner\n"
+    "  STT $6, $5, 0\n"
+    "  SUB $1, $1, 1\n"
+    "  JNZ $1, outer\n"
+    "  INT 0\n";
+
+// A hot loop storing past the code, last into a function run before
+// and after it, which it patches into DIVU $5, $10, 1
+const char far_patch[] =
+    "  SETW $8, 7\n"
+    "  SETW $10, 42\n"
+    "  SETW $6, 14085\n"
+    "  SL $6, $6, 16\n"
+    "  SETW $9, 2561\n"
+    "  OR $6, $6, $9\n"
+    "  GETA $7, divide\n"
+    "  CALL divide\n"
+    "  SETW $1, 100\n"
+    "loop SUB $1, $1, 1\n"
+    "  MUL $11, $1, 16\n"
+    "  STT $6, $7, $11\n"
+    "  JNZ $1, loop\n"
+    "  CALL divide\n"
+    "  OR $255, $5, 0\n"
+    "  INT 3\n"
+    "  INT 0\n"
+    "divide DIVU $5, $8, 1\n"
+    "  RET 0\n";
+
+// Accesses far apart in the largest memory, the last octa of it among
+// them, in a loop going through a page at each turn, also reading pages
+// never written
+const char sparse[] =
+    "  SETW $1, 1\n"
+    "  SL $1, $1, 40\n"
+    "  SETW $2, 65535\n"
+    "  SL $3, $2, 16\n"
+    "  OR $3, $3, $2\n"
+    "  SL $3, $3, 16\n"
+    "  OR $3, $3, $2\n"
+    "  SUB $3, $3, 7\n"
+    "  SETW $4, 4660\n"
+    "  STO $4, $1, 0\n"
+    "  STW $4, $3, 6\n"
+    "  LDO $5, $1, 0\n"
+    "  LDWU $6, $3, 6\n"
+    "  LDO $7, $1, 8\n"
+    "  SL $8, $1, 1\n"
+    "  LDO $9, $8, 0\n"
+    "  SETW $10, 20\n"
+    "  OR $11, $1, 0\n"
+    "  SETW $12, 1\n"
+    "  SL $12, $12, 16\n"
+    "walk STO $10, $11, 0\n"
+    "  LDO $13, $11, 0\n"
+    "  ADD $14, $14, $13\n"
+    "  LDT $15, $11, $8\n"
+    "  ADD $14, $14, $15\n"
+    "  ADD $11, $11, $12\n"
+    "  SUB $10, $10, 1\n"
+    "  JNZ $10, walk\n"
+    "  INT 0\n";
+
+// Check that the JIT runs most of the hot loops natively
+void test_jit()
+{
+    char out[256];
+    int n;
+    utetra *code = assemble(loops, &n);
+    Machine *M = run(code, n, 1 << 16, JIT, out);
+
+    if (jit_available() && M->native_steps < M->steps / 2)
+        die("only %llu of %llu steps run natively.", M->native_steps,
+            M->steps);
+    sim_destroy(M);
+    free(code);
+}
+
+// Trap that forgets the decoded instructions, and counts its calls
+int flush_trap(Machine *M, unsigned code)
+{
+    sim_flush(M);
+    (*(int *) M->ctx)++;
+    return code == 4;
+}
+
+// Check that a trap can flush the decoded instructions, in every mode
+// and with a profile
+void test_trap()
+{
+    int n;
+    utetra *code = assemble("  SETW $1, 10\n"
+                            "loop INT 4\n"
+                            "  ADD $2, $2, $1\n"
+                            "  SUB $1, $1, 1\n"
+                            "  JNZ $1, loop\n"
+                            "  INT 0\n", &n);
+
+    for (int mode = THREADED; mode <= MODES; mode++)
+    {
+        Machine *M = create(1 << 16, mode < MODES ? mode : THREADED);
+        int calls = 0;
+
+        M->trap = flush_trap;
+        M->ctx = &calls;
+        if (!sim_load(M, code, n))
+            die(0);
+        if (mode == MODES)
+            sim_profile(M, 0);
+        if (sim_run(M, 0) != SIM_HALTED)
+            die("%s", estrdup(get_error_msg()));
+        // The copy of the machine checking the JIT traps too
+        int expected = mode == JIT_CHECK ? 20 : 10;
+
+        if (M->reg[2] != 55 || calls != expected)
+            die("mode %d: $2 is %llu after %d traps, expected 55 after %d.",
+                mode, M->reg[2], calls, expected);
+        sim_destroy(M);
+    }
+    free(code);
+}
+
+// Code of a source with every jump, GETA and CALL to a label in its
+// version of the given reach, laid out by hand and encoded by
+// relax_program
+utetra *assemble_reach(const char *src, int reach, int *n)
+{
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    SymbolTable labels = stable_create_kind(STABLE_HASH);
+    const Instruction *bad;
+    Instruction *head;
+
+    if (!parse_source(src, aliases, &head, 0))
+        die(0);
+
+    int count = 0, size = 0;
+    for (Instruction *instr = head; instr; instr = instr->next)
+        count++;
+    unsigned char *reaches = emalloc(count);
+
+    int i = 0;
+    for (Instruction *instr = head; instr; instr = instr->next, i++)
+    {
+        int r = encode_size_reach(instr, reach) != encode_size(instr)
+                ? reach : REACH_SHORT;
+        reaches[i] = r;
+        if (instr->label)
+            stable_insert(labels, instr->label).data->i = size;
+        size += encode_size_reach(instr, r);
+    }
+
+    utetra *code = emalloc(size * sizeof(utetra));
+    if (relax_program(head, labels, reaches, code, &bad) != size)
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+
+    free(reaches);
+    stable_destroy(labels);
+    stable_destroy(aliases);
+    *n = size;
+    return code;
+}
+
+// Run src with its jumps in the long versions, and check the output
+// and the registers that do not hold addresses against the short code
+void test_reach(const char *src)
+{
+    char out[256], expected[256];
+    Machine *S = run_source(src, expected);
+
+    for (int reach = REACH_NEAR; reach <= REACH_FAR; reach++)
+    {
+        int n;
+        utetra *code = assemble_reach(src, reach, &n);
+        Machine *M = run_all(code, n, 1 << 16, out);
+
+        expect_output(out, expected);
+        for (int r = 0; r < 256; r++)
+            if (r != REG_SP && r != REG_X && r != REG_Y && r != 20
+                && r < 254)
+                expect(M, r, S->reg[r]);
+        sim_destroy(M);
+        free(code);
+    }
+
+    sim_destroy(S);
+}
+
+void test_faults()
+{
+    utetra loop[] = { JMP << 24 };
+    utetra bad_op[] = { NOP << 24, 0x60000000 };
+    utetra bad_pc[] = { JMP << 24 | 100 };
+    utetra bad_addr[] = { LDOI << 24 | 1 << 16 | 255 << 8 | 0, INT << 24 };
+
+    for (int mode = THREADED; mode < MODES; mode++)
+    {
+        Machine *M = create(64, mode);
+
+        sim_load(M, loop, 1);
+        if (sim_run(M, 1000) != SIM_LIMIT || M->steps != 1000 || M->pc)
+            die("step limit not kept.");
+
+        M->steps = 0;
+        sim_load(M, bad_op, 2);
+        if (sim_run(M, 0) != SIM_FAULT || M->pc != 4)
+            die("unknown opcode run.");
+
+        sim_load(M, bad_pc, 1);
+        if (sim_run(M, 0) != SIM_FAULT || M->pc != 400)
+            die("jump out of memory not caught.");
+
+        sim_load(M, bad_addr, 1);
+        M->reg[255] = 64;
+        if (sim_run(M, 0) != SIM_FAULT || M->pc)
+            die("load out of memory not caught.");
+
+        sim_destroy(M);
+
+        M = create(SIM_MEMSIZE_MAX, mode);
+        sim_load(M, bad_addr, 2);
+        M->reg[255] = SIM_MEMSIZE_MAX - 8;
+        if (sim_run(M, 0) != SIM_HALTED)
+            die("load from the end of memory failed.");
+        sim_load(M, bad_addr, 1);
+        M->reg[255] = SIM_MEMSIZE_MAX;
+        if (sim_run(M, 0) != SIM_FAULT || M->pc)
+            die("load out of the largest memory not caught.");
+        sim_destroy(M);
+    }
+}
+
+// Time a loop of 3 instructions run n times, rounded down to a multiple
+// of 10000, with each dispatcher and with the JIT
+void benchmark(int n)
+{
+    char src[256];
+    int size;
+    double mips[MODES];
+    uocta sum[MODES];
+
+    sprintf(src,
+            "  SETW $1, %d\n"
+            "  MUL $1, $1, 100\n"
+            "  MUL $1, $1, 100\n"
+            "loop ADD $2, $2, $1\n"
+            "  SUB $1, $1, 1\n"
+            "  JNZ $1, loop\n"
+            "  INT 0\n", n / 10000);
+    utetra *code = assemble(src, &size);
+
+    for (int mode = THREADED; mode < MODES; mode++)
+    {
+        if (mode == JIT_CHECK)
+            continue;
+        Machine *M = create(1 << 16, mode);
+        sim_load(M, code, size);
+        double t0 = now();
+        if (sim_run(M, 0) != SIM_HALTED)
+            die(0);
+        double t1 = now();
+        mips[mode] = M->steps / (t1 - t0) * 1e-6;
+        sum[mode] = M->reg[2];
+        sim_destroy(M);
+    }
+
+    uocta m = n / 10000 * 10000ull;
+    if (sum[THREADED] != m * (m + 1) / 2 || sum[SWITCH] != sum[THREADED]
+        || sum[JIT] != sum[THREADED])
+        die("wrong sum in the loop.");
+
+    printf("%llu iterations: %s %.0f MIPS, switch %.0f MIPS, %s %.0f MIPS\n",
+           m, sim_threaded() ? "threaded" : "switch", mips[THREADED],
+           mips[SWITCH], jit_available() ? "jit" : "no jit", mips[JIT]);
+    free(code);
+}
+
+// Time passes summing an array of 2^20 octas at 2^40, after filling
+// it, with each dispatcher, with the JIT, and in C
+void benchmark_memory(int passes)
+{
+    char src[512];
+    int size;
+    double mbs[MODES + 1];
+    uocta sum[MODES + 1];
+    uocta bytes = (passes + 1ull) * (8 << 20);
+
+    sprintf(src,
+            "  SETW $1, 1\n"
+            "  SL $1, $1, 40\n"
+            "  SETW $7, 1\n"
+            "  SL $7, $7, 20\n"
+            "  OR $2, $7, 0\n"
+            "fill SUB $2, $2, 1\n"
+            "  SL $3, $2, 3\n"
+            "  STO $2, $1, $3\n"
+            "  JNZ $2, fill\n"
+            "  SETW $4, %d\n"
+            "pass OR $2, $7, 0\n"
+            "sum SUB $2, $2, 1\n"
+            "  SL $3, $2, 3\n"
+            "  LDO $5, $1, $3\n"
+            "  ADD $6, $6, $5\n"
+            "  JNZ $2, sum\n"
+            "  SUB $4, $4, 1\n"
+            "  JNZ $4, pass\n"
+            "  INT 0\n", passes);
+    utetra *code = assemble(src, &size);
+
+    for (int mode = THREADED; mode < MODES; mode++)
+    {
+        if (mode == JIT_CHECK)
+            continue;
+        Machine *M = create(SIM_MEMSIZE_MAX, mode);
+        sim_load(M, code, size);
+        double t0 = now();
+        if (sim_run(M, 0) != SIM_HALTED)
+            die(0);
+        double t1 = now();
+        mbs[mode] = bytes / (t1 - t0) * 1e-6;
+        sum[mode] = M->reg[6];
+        sim_destroy(M);
+    }
+
+    uocta *a = emalloc(sizeof(uocta) << 20);
+    double t0 = now();
+    for (uocta i = 1 << 20; i--; )
+        a[i] = i;
+    sum[MODES] = 0;
+    for (int p = 0; p < passes; p++)
+        for (uocta i = 1 << 20; i--; )
+            sum[MODES] += a[i];
+    double t1 = now();
+    mbs[MODES] = bytes / (t1 - t0) * 1e-6;
+    free(a);
+
+    uocta m = 1 << 20;
+    for (int mode = THREADED; mode <= MODES; mode++)
+        if (mode != JIT_CHECK && sum[mode] != passes * (m * (m - 1) / 2))
+            die("wrong sum of the array in mode %d.", mode);
+
+    printf("%llu MB of octas: %s %.0f MB/s, switch %.0f MB/s, %s %.0f "
+           "MB/s, C %.0f MB/s\n", bytes >> 20,
+           sim_threaded() ? "threaded" : "switch", mbs[THREADED],
+           mbs[SWITCH], jit_available() ? "jit" : "no jit", mbs[JIT],
+           mbs[MODES]);
+    free(code);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = argc > 1 ? atoi(argv[1]) : 20000000;
+    char out[256];
+    Machine *M;
+
+    set_prog_name("sim_test");
+
+    M = run_source(arith, out);
+    expect(M, 2, 1024);
+    expect(M, 3, -24);
+    expect(M, 4, 576);
+    expect(M, 5, 142);
+    expect(M, 6, -4);
+    expect(M, 7, -1000);
+    expect(M, 8, -1);
+    expect(M, 9, 1);
+    expect(M, 10, -6);
+    expect(M, 11, 15);
+    expect(M, 12, 8000);
+    expect(M, 13, -1);
+    expect(M, 14, 1000 & 240);
+    expect(M, 15, 1000 ^ 0xff);
+    expect(M, 16, 576);
+    if (M->rH != (uocta)-48)
+        die("rH is %#llx, expected -48.", M->rH);
+    expect(M, 18, 0);
+    if (M->rR != 1000)
+        die("rR is %lld, expected 1000.", M->rR);
+    expect(M, 19, -1);
+    sim_destroy(M);
+
+    M = run_source(memory, out);
+    expect(M, 3, 0xffffffffffff8081ull);
+    expect(M, 4, 0x8081);
+    expect(M, 5, -127);
+    expect(M, 6, 0x81);
+    expect(M, 7, 0xffffffffffff8081ull);
+    expect(M, 8, 0x8081);
+    expect(M, 10, 0xffffffff80810000ull);
+    expect(M, 11, 0x80810000);
+    expect(M, 12, 0x8100000000000000ull);
+    sim_destroy(M);
+
+    M = run_source(calls, out);
+    expect_output(out, "3628800\ndone");
+    expect(M, 10, 5);
+    expect(M, 11, 6);
+    expect(M, 12, 7);
+    expect(M, 21, 24);
+    if (M->reg[REG_SP] != M->reg[20])
+        die("stack pointer not restored.");
+    sim_destroy(M);
+
+    M = run_source(jumps, out);
+    expect(M, 3, 3);
+    sim_destroy(M);
+
+    M = run_source(patched, out);
+    expect(M, 3, 11);
+    sim_destroy(M);
+
+    M = run_source(loops, out);
+    expect_output(out, "QBCDEFGHIJKLMNOP");
+    expect(M, 5, 328350);
+    expect(M, 21, 100);
+    sim_destroy(M);
+
+    M = run_source(hot_patch, out);
+    expect(M, 3, 1100);
+    sim_destroy(M);
+
+    M = run_source(far_patch, out);
+    expect_output(out, "42");
+    sim_destroy(M);
+
+    int size;
+    utetra *code = assemble(sparse, &size);
+    M = run_all(code, size, SIM_MEMSIZE_MAX, out);
+    expect(M, 5, 4660);
+    expect(M, 6, 4660);
+    expect(M, 7, 0);
+    expect(M, 9, 0);
+    expect(M, 14, 210);
+    if (vmem_pages(M->mem) != 22)
+        die("%llu pages allocated, expected 22.", vmem_pages(M->mem));
+    sim_destroy(M);
+    free(code);
+
+    test_jit();
+    test_trap();
+    test_reach(calls);
+    test_reach(jumps);
+    test_reach(scratch_geta);
+    test_faults();
+    benchmark(n);
+    benchmark_memory(4);
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "stable.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Runs the same checks on every kind of symbol table: lookups, visits
+// and reinsertions after freezing, and prefix cursors before and after.
+
+#define NKEYS 20000
+
+const char *kind_name[] = { "tree", "hash", "concurrent" };
+
+// Key of number k, in an order unlike that of the numbers
+void key_of(int k, char *key)
+{
+    sprintf(key, "s%d_%x", k % 89, k);
+}
+
+// Keys visited, in order
+char **visited;
+int nvisited;
+
+int collect(const char *key, EntryData *data)
+{
+    visited[nvisited++] = strdup(key);
+    return 1;
+}
+
+void forget()
+{
+    for (int i = 0; i < nvisited; i++)
+        free(visited[i]);
+    nvisited = 0;
+}
+
+void test_freeze(StableKind kind)
+{
+    const char *name = kind_name[kind];
+    SymbolTable table = stable_create_kind(kind);
+    EntryData **before = malloc(NKEYS * sizeof(EntryData *));
+    char **order = malloc(NKEYS * sizeof(char *));
+    char key[32];
+
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        InsertionResult r = stable_insert(table, key);
+        r.data->i = i;
+        before[i] = r.data;
+    }
+    stable_visit(table, collect);
+    if (nvisited != NKEYS)
+        die("%s: %d keys visited, expected %d.", name, nvisited, NKEYS);
+    memcpy(order, visited, NKEYS * sizeof(char *));
+    nvisited = 0;
+
+    stable_freeze(table);
+
+    StableStats stats;
+    stable_stats(table, &stats);
+    if (stats.entries != NKEYS)
+        die("%s: %zu entries frozen, expected %d.", name, stats.entries,
+            NKEYS);
+
+    // Lookups keep the data, at new addresses: the pointers given
+    // before freezing are not valid any more
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        EntryData *d = stable_find(table, key);
+        if (!d || d->i != i)
+            die("%s: frozen table lost %s.", name, key);
+        if (d == before[i])
+            die("%s: %s kept its data pointer.", name, key);
+        d->i = -i;
+    }
+    if (stable_find(table, "") || stable_find(table, "s1")
+        || stable_find(table, "s1_1x") || stable_find(table, "t"))
+        die("%s: frozen table found a key never inserted.", name);
+
+    // Inserting a key already there gives its data, which keeps the
+    // value written through stable_find
+    for (int i = 0; i < NKEYS; i += 11)
+    {
+        key_of(i, key);
+        InsertionResult r = stable_insert(table, key);
+        if (r.new || r.data != stable_find(table, key) || r.data->i != -i)
+            die("%s: reinsertion of %s into frozen table.", name, key);
+    }
+
+    // Freezing again changes nothing
+    EntryData *first = stable_find(table, order[0]);
+    stable_freeze(table);
+    if (stable_find(table, order[0]) != first)
+        die("%s: second freeze moved the data.", name);
+
+    // Visits give the same keys in the same order as before freezing
+    stable_visit(table, collect);
+    if (nvisited != NKEYS)
+        die("%s: %d frozen keys visited, expected %d.", name, nvisited,
+            NKEYS);
+    for (int i = 0; i < NKEYS; i++)
+        if (strcmp(visited[i], order[i]))
+            die("%s: frozen key %d is %s, expected %s.", name, i,
+                visited[i], order[i]);
+    forget();
+
+    for (int i = 0; i < NKEYS; i++)
+        free(order[i]);
+    free(order);
+    free(before);
+    stable_destroy(table);
+
+    // An empty table freezes to an empty table
+    table = stable_create_kind(kind);
+    stable_freeze(table);
+    if (stable_find(table, "") || stable_find(table, "s0_0"))
+        die("%s: empty frozen table found a key.", name);
+    stable_visit(table, collect);
+    if (nvisited)
+        die("%s: empty frozen table visited %d keys.", name, nvisited);
+    stable_destroy(table);
+}
+
+int by_key(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+// Checks that the cursor on prefix gives exactly the keys of sorted
+// starting with it, in order, with their data.
+void check_prefix(SymbolTable table, const char *name, char **sorted,
+                  int n, const char *prefix)
+{
+    const char *p = prefix ? prefix : "";
+    size_t len = strlen(p);
+    StableIter it = stable_iter_begin(table, prefix);
+    const char *key;
+    EntryData *data;
+    int i = 0;
+
+    while (stable_iter_next(it, &key, &data))
+    {
+        while (i < n && strncmp(sorted[i], p, len))
+            i++;
+        if (i == n || strcmp(key, sorted[i]))
+            die("%s: cursor on \"%s\" gave %s, expected %s.", name, p,
+                key, i == n ? "the end" : sorted[i]);
+        if (data != stable_find(table, key))
+            die("%s: cursor on \"%s\" gave other data for %s.", name, p,
+                key);
+        i++;
+    }
+    stable_iter_end(it);
+
+    while (i < n && strncmp(sorted[i], p, len))
+        i++;
+    if (i != n)
+        die("%s: cursor on \"%s\" missed %s.", name, p, sorted[i]);
+}
+
+void check_prefixes(SymbolTable table, const char *name, char **sorted,
+                    int n)
+{
+    const char *prefixes[] = {
+        0, "",       // every key
+        "s1",        // a key, and the start of many others
+        "s17_",      // the start of some keys only
+        "s17_11",    // a key, and the start of a few others
+        "s63_4e1f",  // a key and nothing more
+        "s9z", "a", "zz", "s17_11x"  // no keys
+    };
+
+    for (int p = 0; p < sizeof(prefixes) / sizeof(*prefixes); p++)
+        check_prefix(table, name, sorted, n, prefixes[p]);
+}
+
+void test_prefix(StableKind kind)
+{
+    const char *name = kind_name[kind];
+    SymbolTable table = stable_create_kind(kind);
+    char **sorted = malloc((NKEYS + 1) * sizeof(char *));
+    char key[32];
+
+    // Key numbers 0..NKEYS-1, and key "s1", which prefixes many
+    for (int i = 0; i < NKEYS; i++)
+    {
+        key_of(i, key);
+        stable_insert(table, key).data->i = i;
+        sorted[i] = strdup(key);
+    }
+    stable_insert(table, "s1").data->i = -1;
+    sorted[NKEYS] = strdup("s1");
+    qsort(sorted, NKEYS + 1, sizeof(char *), by_key);
+
+    check_prefixes(table, name, sorted, NKEYS + 1);
+    stable_freeze(table);
+    check_prefixes(table, name, sorted, NKEYS + 1);
+
+    for (int i = 0; i <= NKEYS; i++)
+        free(sorted[i]);
+    free(sorted);
+    stable_destroy(table);
+
+    // An empty table has no keys under any prefix
+    table = stable_create_kind(kind);
+    check_prefixes(table, name, 0, 0);
+    stable_destroy(table);
+}
+
+int main()
+{
+    set_prog_name("stable_test");
+
+    visited = malloc(NKEYS * sizeof(char *));
+
+    test_freeze(STABLE_TST);
+    test_freeze(STABLE_HASH);
+    test_freeze(STABLE_CONCURRENT);
+    test_prefix(STABLE_TST);
+    test_prefix(STABLE_HASH);
+    test_prefix(STABLE_CONCURRENT);
+
+    free(visited);
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "testasm.h"
+#include "parser.h"
+#include "stable.h"
+#include "error.h"
+#include <string.h>
+
+Assembler *assemble_source(const char *src)
+{
+    SymbolTable aliases = stable_create_kind(STABLE_HASH);
+    const Instruction *bad;
+    Instruction *head;
+
+    if (!parse_source(src, aliases, &head, 0))
+        die(0);
+    Assembler *A = asm_create();
+    if (!asm_list(A, head, &bad))
+        die("line %d: %s", bad->lineno, estrdup(get_error_msg()));
+    asm_finish(A);
+    stable_destroy(aliases);
+    return A;
+}
+
+utetra *assemble(const char *src, int *n)
+{
+    Assembler *A = assemble_source(src);
+
+    if (A->nrelocs)
+        die("undefined label %s.", A->relocs[0].name);
+
+    utetra *code = emalloc(A->n * sizeof(utetra) + 1);
+    memcpy(code, A->code, A->n * sizeof(utetra));
+    *n = A->n;
+    asm_destroy(A);
+    return code;
+}
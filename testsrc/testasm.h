@@ -0,0 +1,26 @@
+/*
+  testasm.h
+
+  Assembly of small programs for the tests of the assembler and what
+  comes after it. Tests using it link testasm.o along with the parser
+  and the assembler.
+*/
+
+#ifndef __TESTASM_H__
+#define __TESTASM_H__
+
+#include "assembler.h"
+
+/*
+  Parse and assemble src in one pass, dying on any error, and return
+  the assembler, finished: labels left undefined are relocations.
+*/
+Assembler *assemble_source(const char *src);
+
+/*
+  Return a new copy of the code of src, a program that defines every
+  label it uses, dying otherwise, and store its size in words in *n.
+*/
+utetra *assemble(const char *src, int *n);
+
+#endif
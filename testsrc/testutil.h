@@ -0,0 +1,16 @@
+/*
+  testutil.h
+
+  Helpers shared by the tests; see also testasm.h.
+*/
+
+#ifndef __TESTUTIL_H__
+#define __TESTUTIL_H__
+
+/*
+  Return the time in seconds from some fixed point, for measuring
+  intervals.
+*/
+double now();
+
+#endif